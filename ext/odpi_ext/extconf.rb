@@ -70,7 +70,7 @@ open('rbdpi-func.c', 'w') do |f|
 #include <ruby.h>
 #include <ruby/thread.h>
 #include <dpi.h>
-#include "rbdpi-func.h"
+#include "rbdpi.h"
 EOS
   func_defs.each do |func|
     f.print(<<EOS)
@@ -104,7 +104,7 @@ EOS
 EOS
     end
     f.print(<<EOS)
-    rv = rb_thread_call_without_gvl(#{func.name}_cb, &arg, #{func.cancel_cb});
+    rv = rbdpi_call_without_gvl(#{func.name}_cb, &arg, #{func.cancel_cb});
     return (int)(size_t)rv;
 }
 EOS
@@ -113,6 +113,12 @@ end
 
 $CFLAGS += " -I../../odpi/include"
 
+have_header('ruby/fiber/scheduler.h')
+have_func('rb_fiber_scheduler_current', 'ruby/fiber/scheduler.h')
+have_header('sys/eventfd.h')
+have_func('rb_ext_ractor_safe', 'ruby.h')
+have_func('rb_ractor_local_storage_value_newkey', 'ruby/ractor.h')
+
 $objs = (Dir['../../odpi/src/*.c'] + Dir['*.c']).collect do |src|
   File.basename(src, '.c') + '.o'
 end
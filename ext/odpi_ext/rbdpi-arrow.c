@@ -0,0 +1,2122 @@
+/*
+ * rbdpi-arrow.c -- part of ruby-odpi
+ *
+ * URL: https://github.com/kubo/ruby-odpi
+ *
+ * ------------------------------------------------------
+ *
+ * Copyright 2017 Kubo Takehiro <kubo@jiubao.org>
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice, this list of
+ *       conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *       of conditions and the following disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ * or implied, of the authors.
+ *
+ */
+#include "rbdpi.h"
+#include <stdlib.h>
+
+/*
+ * Apache Arrow IPC format
+ *
+ * Messages are FlatBuffers tables defined in Schema.fbs, Message.fbs and
+ * File.fbs of the Arrow project. They are small and fixed, so they are
+ * built here by a minimal FlatBuffers builder instead of depending on the
+ * Arrow or FlatBuffers libraries.
+ */
+
+#define DEFAULT_CHUNK_SIZE 65536
+#define FB_MAX_FIELDS 8
+#define ARROW_CONTINUATION 0xFFFFFFFFu
+#define ARROW_MAGIC "ARROW1"
+
+/* MetadataVersion */
+#define ARROW_METADATA_V5 4
+/* MessageHeader */
+#define ARROW_HEADER_SCHEMA 1
+#define ARROW_HEADER_RECORD_BATCH 3
+/* Type */
+#define ARROW_TYPE_INT 2
+#define ARROW_TYPE_FLOATING_POINT 3
+#define ARROW_TYPE_BINARY 4
+#define ARROW_TYPE_UTF8 5
+#define ARROW_TYPE_BOOL 6
+#define ARROW_TYPE_DECIMAL 7
+#define ARROW_TYPE_DATE 8
+#define ARROW_TYPE_TIMESTAMP 10
+#define ARROW_TYPE_INTERVAL 11
+#define ARROW_TYPE_DURATION 18
+/* Precision */
+#define ARROW_PRECISION_SINGLE 1
+#define ARROW_PRECISION_DOUBLE 2
+/* TimeUnit */
+#define ARROW_UNIT_SECOND 0
+#define ARROW_UNIT_MICROSECOND 2
+/* IntervalUnit */
+#define ARROW_INTERVAL_YEAR_MONTH 0
+
+static VALUE sym_arrow_stream;
+static VALUE sym_arrow_file;
+static VALUE sym_text;
+static VALUE sym_float64;
+static VALUE sym_length;
+static ID id_call;
+static ID id_read;
+static ID writer_keyword_ids[3];
+static ID loader_keyword_ids[3];
+
+/*
+ * Text conversion
+ *
+ * Arrow utf8 columns must hold valid UTF-8. Invalid or unmappable
+ * characters are replaced rather than copied through.
+ */
+static VALUE encode_text(VALUE str, rb_encoding *enc)
+{
+    return rb_str_encode(str, rb_enc_from_encoding(enc), ECONV_INVALID_REPLACE | ECONV_UNDEF_REPLACE, Qnil);
+}
+
+/* Returns a scrubbed copy of ptr, or Qnil when it is already valid UTF-8. */
+static VALUE utf8_scrub(const char *ptr, long len)
+{
+    long idx = 0;
+
+    while (idx < len) {
+        int clen;
+
+        if ((unsigned char)ptr[idx] < 0x80) {
+            idx++;
+            continue;
+        }
+        clen = rb_enc_precise_mbclen(ptr + idx, ptr + len, rb_utf8_encoding());
+        if (!MBCLEN_CHARFOUND_P(clen)) {
+            return rb_str_scrub(rb_utf8_str_new(ptr, len), Qnil);
+        }
+        idx += MBCLEN_CHARFOUND_LEN(clen);
+    }
+    return Qnil;
+}
+
+/*
+ * FlatBuffers builder
+ *
+ * Data is built from the end of the buffer toward the beginning as the
+ * official builders do. Offsets are measured from the end of the buffer.
+ */
+typedef struct {
+    VALUE str;
+    uint32_t cap;
+    uint32_t len;
+    uint32_t minalign;
+    uint32_t table_start;
+    uint32_t num_fields;
+    uint32_t fields[FB_MAX_FIELDS];
+} fb_builder_t;
+
+static void fb_init(fb_builder_t *fb)
+{
+    fb->cap = 1024;
+    fb->str = rb_str_new(NULL, fb->cap);
+    fb->len = 0;
+    fb->minalign = 1;
+}
+
+static void fb_reset(fb_builder_t *fb)
+{
+    fb->len = 0;
+    fb->minalign = 1;
+}
+
+static inline char *fb_ptr(fb_builder_t *fb)
+{
+    return RSTRING_PTR(fb->str) + fb->cap - fb->len;
+}
+
+static char *fb_alloc(fb_builder_t *fb, uint32_t size)
+{
+    if (fb->cap - fb->len < size) {
+        uint32_t newcap = fb->cap;
+        char *ptr;
+
+        while (newcap - fb->len < size) {
+            newcap *= 2;
+        }
+        rb_str_resize(fb->str, newcap);
+        ptr = RSTRING_PTR(fb->str);
+        memmove(ptr + newcap - fb->len, ptr + fb->cap - fb->len, fb->len);
+        fb->cap = newcap;
+    }
+    fb->len += size;
+    return fb_ptr(fb);
+}
+
+static void fb_pad(fb_builder_t *fb, uint32_t size)
+{
+    if (size > 0) {
+        memset(fb_alloc(fb, size), 0, size);
+    }
+}
+
+/* Aligns the buffer so that it is aligned to 'size' after 'additional' bytes are written. */
+static void fb_prep(fb_builder_t *fb, uint32_t size, uint32_t additional)
+{
+    if (fb->minalign < size) {
+        fb->minalign = size;
+    }
+    fb_pad(fb, (~(fb->len + additional) + 1) & (size - 1));
+}
+
+static void fb_place(fb_builder_t *fb, uint64_t val, uint32_t size)
+{
+    unsigned char *ptr = (unsigned char *)fb_alloc(fb, size);
+    uint32_t idx;
+
+    for (idx = 0; idx < size; idx++) {
+        ptr[idx] = (unsigned char)(val >> (idx * 8));
+    }
+}
+
+static void fb_put(fb_builder_t *fb, uint64_t val, uint32_t size)
+{
+    fb_prep(fb, size, 0);
+    fb_place(fb, val, size);
+}
+
+static void fb_put_uoffset(fb_builder_t *fb, uint32_t off)
+{
+    fb_prep(fb, 4, 0);
+    fb_place(fb, fb->len - off + 4, 4);
+}
+
+static uint32_t fb_create_string(fb_builder_t *fb, const char *str, uint32_t len)
+{
+    fb_prep(fb, 4, len + 1);
+    fb_pad(fb, 1);
+    if (len > 0) {
+        memcpy(fb_alloc(fb, len), str, len);
+    }
+    fb_place(fb, len, 4);
+    return fb->len;
+}
+
+static uint32_t fb_create_offset_vector(fb_builder_t *fb, const uint32_t *offs, uint32_t num)
+{
+    uint32_t idx;
+
+    fb_prep(fb, 4, 4 * num);
+    for (idx = num; idx > 0; idx--) {
+        fb_put_uoffset(fb, offs[idx - 1]);
+    }
+    fb_place(fb, num, 4);
+    return fb->len;
+}
+
+/* Call this, put struct elements in reverse order and then call fb_end_vector(). */
+static void fb_start_struct_vector(fb_builder_t *fb, uint32_t elem_size, uint32_t num, uint32_t align)
+{
+    fb_prep(fb, 4, elem_size * num);
+    fb_prep(fb, align, elem_size * num);
+}
+
+static uint32_t fb_end_vector(fb_builder_t *fb, uint32_t num)
+{
+    fb_put(fb, num, 4);
+    return fb->len;
+}
+
+static void fb_start_table(fb_builder_t *fb, uint32_t num_fields)
+{
+    memset(fb->fields, 0, sizeof(fb->fields));
+    fb->num_fields = num_fields;
+    fb->table_start = fb->len;
+}
+
+static void fb_add_scalar(fb_builder_t *fb, uint32_t slot, uint64_t val, uint32_t size)
+{
+    fb_put(fb, val, size);
+    fb->fields[slot] = fb->len;
+}
+
+static void fb_add_offset(fb_builder_t *fb, uint32_t slot, uint32_t off)
+{
+    fb_put_uoffset(fb, off);
+    fb->fields[slot] = fb->len;
+}
+
+static uint32_t fb_end_table(fb_builder_t *fb)
+{
+    uint32_t obj, vt, idx;
+    uint32_t num_fields = fb->num_fields;
+    unsigned char *ptr;
+
+    fb_put(fb, 0, 4); /* placeholder of the offset to vtable */
+    obj = fb->len;
+    while (num_fields > 0 && fb->fields[num_fields - 1] == 0) {
+        num_fields--;
+    }
+    for (idx = num_fields; idx > 0; idx--) {
+        uint32_t field = fb->fields[idx - 1];
+        fb_put(fb, field ? obj - field : 0, 2);
+    }
+    fb_put(fb, obj - fb->table_start, 2);
+    fb_put(fb, (num_fields + 2) * 2, 2);
+    vt = fb->len;
+    /* The vtable precedes the table. */
+    ptr = (unsigned char *)RSTRING_PTR(fb->str) + fb->cap - obj;
+    for (idx = 0; idx < 4; idx++) {
+        ptr[idx] = (unsigned char)((vt - obj) >> (idx * 8));
+    }
+    return obj;
+}
+
+static void fb_finish(fb_builder_t *fb, uint32_t root)
+{
+    fb_prep(fb, fb->minalign, 4);
+    fb_put_uoffset(fb, root);
+}
+
+/*
+ * Arrow writer
+ */
+typedef enum {
+    ARROW_INT64,
+    ARROW_UINT64,
+    ARROW_FLOAT32,
+    ARROW_FLOAT64,
+    ARROW_DECIMAL128,
+    ARROW_UTF8,
+    ARROW_BINARY,
+    ARROW_BOOLEAN,
+    ARROW_TIMESTAMP_S,
+    ARROW_TIMESTAMP_US,
+    ARROW_TIMESTAMP_US_UTC,
+    ARROW_DURATION_US,
+    ARROW_INTERVAL_YM,
+} arrow_type_t;
+
+typedef struct {
+    const var_t *var;
+    dpiData *data;
+    arrow_type_t type;
+    int32_t precision;
+    int32_t scale;
+    int nullable;
+    VALUE name; /* UTF-8 */
+    rb_encoding *conv_enc; /* non-NULL when text must be converted to UTF-8 */
+    VALUE validity;
+    VALUE values;
+    VALUE offsets;
+    int64_t null_count;
+} arrow_col_t;
+
+typedef struct {
+    int64_t offset;
+    int64_t length;
+} arrow_buffer_t;
+
+typedef struct {
+    int64_t offset;
+    int32_t meta_len;
+    int64_t body_len;
+} arrow_block_t;
+
+typedef struct {
+    stmt_t *stmt;
+    conn_t *conn;
+    VALUE io;
+    VALUE buf;
+    VALUE blocks; /* packed arrow_block_t for the file footer */
+    fb_builder_t fb;
+    long chunk_size;
+    int64_t pos; /* number of bytes written so far */
+    uint32_t num_cols;
+    arrow_col_t *cols;
+    arrow_buffer_t *buffers;
+    uint32_t num_buffers;
+    uint64_t num_rows;
+    VALUE progress;
+    int number_as_float; /* lossy FLOAT64 for numbers which don't fit decimal128 */
+} arrow_writer_t;
+
+static int is_big_endian(void)
+{
+    const uint16_t val = 1;
+    return *(const uint8_t *)&val == 0;
+}
+
+static inline void out_cat(arrow_writer_t *w, const void *ptr, long len)
+{
+    rb_str_cat(w->buf, ptr, len);
+    w->pos += len;
+}
+
+static void out_pad(arrow_writer_t *w)
+{
+    static const char zeros[8] = {0,};
+    long pad = (8 - (w->pos & 7)) & 7;
+
+    if (pad > 0) {
+        out_cat(w, zeros, pad);
+    }
+}
+
+static void out_le32(arrow_writer_t *w, uint32_t val)
+{
+    unsigned char buf[4];
+
+    buf[0] = (unsigned char)val;
+    buf[1] = (unsigned char)(val >> 8);
+    buf[2] = (unsigned char)(val >> 16);
+    buf[3] = (unsigned char)(val >> 24);
+    out_cat(w, buf, 4);
+}
+
+static void out_flush(arrow_writer_t *w)
+{
+    if (RSTRING_LEN(w->buf) > 0) {
+        rb_io_write(w->io, w->buf);
+        /* The IO may keep the written string. Don't reuse it. */
+        w->buf = rb_str_buf_new(w->chunk_size);
+    }
+}
+
+/* Writes the encapsulated message in the builder and returns its metadata length. */
+static int32_t write_message(arrow_writer_t *w)
+{
+    uint32_t len = w->fb.len;
+    uint32_t padded = ((len + 8 + 7) & ~7u) - 8;
+
+    out_le32(w, ARROW_CONTINUATION);
+    out_le32(w, padded);
+    out_cat(w, fb_ptr(&w->fb), len);
+    out_pad(w);
+    return (int32_t)(8 + padded);
+}
+
+static uint32_t build_message(fb_builder_t *fb, uint8_t header_type, uint32_t header, int64_t body_len)
+{
+    fb_start_table(fb, 5);
+    fb_add_scalar(fb, 3, (uint64_t)body_len, 8);
+    fb_add_offset(fb, 2, header);
+    fb_add_scalar(fb, 0, ARROW_METADATA_V5, 2);
+    fb_add_scalar(fb, 1, header_type, 1);
+    return fb_end_table(fb);
+}
+
+static uint32_t build_field_type(fb_builder_t *fb, const arrow_col_t *col, uint8_t *type_type)
+{
+    uint32_t tz = 0;
+
+    if (col->type == ARROW_TIMESTAMP_US_UTC) {
+        tz = fb_create_string(fb, "UTC", 3);
+    }
+    fb_start_table(fb, 3);
+    switch (col->type) {
+    case ARROW_INT64:
+    case ARROW_UINT64:
+        *type_type = ARROW_TYPE_INT;
+        fb_add_scalar(fb, 0, 64, 4);
+        fb_add_scalar(fb, 1, col->type == ARROW_INT64, 1);
+        break;
+    case ARROW_FLOAT32:
+        *type_type = ARROW_TYPE_FLOATING_POINT;
+        fb_add_scalar(fb, 0, ARROW_PRECISION_SINGLE, 2);
+        break;
+    case ARROW_FLOAT64:
+        *type_type = ARROW_TYPE_FLOATING_POINT;
+        fb_add_scalar(fb, 0, ARROW_PRECISION_DOUBLE, 2);
+        break;
+    case ARROW_DECIMAL128:
+        *type_type = ARROW_TYPE_DECIMAL;
+        fb_add_scalar(fb, 0, (uint32_t)col->precision, 4);
+        fb_add_scalar(fb, 1, (uint32_t)col->scale, 4);
+        fb_add_scalar(fb, 2, 128, 4);
+        break;
+    case ARROW_UTF8:
+        *type_type = ARROW_TYPE_UTF8;
+        break;
+    case ARROW_BINARY:
+        *type_type = ARROW_TYPE_BINARY;
+        break;
+    case ARROW_BOOLEAN:
+        *type_type = ARROW_TYPE_BOOL;
+        break;
+    case ARROW_TIMESTAMP_S:
+        *type_type = ARROW_TYPE_TIMESTAMP;
+        fb_add_scalar(fb, 0, ARROW_UNIT_SECOND, 2);
+        break;
+    case ARROW_TIMESTAMP_US:
+        *type_type = ARROW_TYPE_TIMESTAMP;
+        fb_add_scalar(fb, 0, ARROW_UNIT_MICROSECOND, 2);
+        break;
+    case ARROW_TIMESTAMP_US_UTC:
+        *type_type = ARROW_TYPE_TIMESTAMP;
+        fb_add_scalar(fb, 0, ARROW_UNIT_MICROSECOND, 2);
+        fb_add_offset(fb, 1, tz);
+        break;
+    case ARROW_DURATION_US:
+        *type_type = ARROW_TYPE_DURATION;
+        fb_add_scalar(fb, 0, ARROW_UNIT_MICROSECOND, 2);
+        break;
+    case ARROW_INTERVAL_YM:
+        *type_type = ARROW_TYPE_INTERVAL;
+        fb_add_scalar(fb, 0, ARROW_INTERVAL_YEAR_MONTH, 2);
+        break;
+    }
+    return fb_end_table(fb);
+}
+
+static uint32_t build_schema(arrow_writer_t *w)
+{
+    fb_builder_t *fb = &w->fb;
+    VALUE tmp = rb_str_tmp_new(w->num_cols * sizeof(uint32_t));
+    uint32_t *fields = (uint32_t *)RSTRING_PTR(tmp);
+    uint32_t idx, vec;
+
+    for (idx = 0; idx < w->num_cols; idx++) {
+        const arrow_col_t *col = &w->cols[idx];
+        uint32_t name, type, children;
+        uint8_t type_type;
+
+        name = fb_create_string(fb, RSTRING_PTR(col->name), (uint32_t)RSTRING_LEN(col->name));
+        type = build_field_type(fb, col, &type_type);
+        children = fb_create_offset_vector(fb, NULL, 0);
+        fb_start_table(fb, 7);
+        fb_add_offset(fb, 0, name);
+        fb_add_offset(fb, 3, type);
+        fb_add_offset(fb, 5, children);
+        fb_add_scalar(fb, 1, col->nullable, 1);
+        fb_add_scalar(fb, 2, type_type, 1);
+        fields[idx] = fb_end_table(fb);
+    }
+    vec = fb_create_offset_vector(fb, fields, w->num_cols);
+    fb_start_table(fb, 4);
+    fb_add_offset(fb, 1, vec);
+    fb_add_scalar(fb, 0, is_big_endian(), 2);
+    RB_GC_GUARD(tmp);
+    return fb_end_table(fb);
+}
+
+static void write_schema(arrow_writer_t *w)
+{
+    uint32_t schema;
+
+    fb_reset(&w->fb);
+    schema = build_schema(w);
+    fb_finish(&w->fb, build_message(&w->fb, ARROW_HEADER_SCHEMA, schema, 0));
+    write_message(w);
+}
+
+/*
+ * value conversion
+ */
+static int64_t days_from_civil(int64_t y, unsigned m, unsigned d)
+{
+    int64_t era;
+    unsigned yoe, doy, doe;
+
+    y -= m <= 2;
+    era = (y >= 0 ? y : y - 399) / 400;
+    yoe = (unsigned)(y - era * 400);
+    doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int64_t)doe - 719468;
+}
+
+static int64_t timestamp_to_epoch(const dpiTimestamp *ts, int utc)
+{
+    int64_t sec = days_from_civil(ts->year, ts->month, ts->day) * 86400
+        + ts->hour * 3600 + ts->minute * 60 + ts->second;
+
+    if (utc) {
+        sec -= ts->tzHourOffset * 3600 + ts->tzMinuteOffset * 60;
+    }
+    return sec;
+}
+
+/* 128-bit integer as four 32-bit little-endian limbs */
+static void dec128_mul_add(uint32_t *w, uint32_t mul, uint32_t add)
+{
+    uint64_t carry = add;
+    int idx;
+
+    for (idx = 0; idx < 4; idx++) {
+        uint64_t t = (uint64_t)w[idx] * mul + carry;
+        w[idx] = (uint32_t)t;
+        carry = t >> 32;
+    }
+}
+
+static uint32_t dec128_div10(uint32_t *w)
+{
+    uint64_t rem = 0;
+    int idx;
+
+    for (idx = 3; idx >= 0; idx--) {
+        uint64_t t = (rem << 32) | w[idx];
+        w[idx] = (uint32_t)(t / 10);
+        rem = t % 10;
+    }
+    return (uint32_t)rem;
+}
+
+static void dec128_negate(uint32_t *w)
+{
+    uint64_t carry = 1;
+    int idx;
+
+    for (idx = 0; idx < 4; idx++) {
+        uint64_t t = (uint64_t)(uint32_t)~w[idx] + carry;
+        w[idx] = (uint32_t)t;
+        carry = t >> 32;
+    }
+}
+
+/* Converts the decimal text of an Oracle number to a 128-bit integer scaled by 'scale'. */
+static int decimal128_from_text(const char *p, uint32_t len, int32_t scale, unsigned char *out)
+{
+    const char *end = p + len;
+    uint32_t w[4] = {0, 0, 0, 0};
+    int neg = 0;
+    int dot = 0;
+    int32_t shift = scale;
+    int idx;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        neg = (*p++ == '-');
+    }
+    for (; p < end; p++) {
+        if ('0' <= *p && *p <= '9') {
+            dec128_mul_add(w, 10, *p - '0');
+            if (dot) {
+                shift--;
+            }
+        } else if (*p == '.' && !dot) {
+            dot = 1;
+        } else if (*p == 'E' || *p == 'e') {
+            char *endp;
+            long exp = strtol(p + 1, &endp, 10);
+
+            if (endp != end) {
+                return 0;
+            }
+            shift += (int32_t)exp;
+            break;
+        } else {
+            return 0;
+        }
+    }
+    for (; shift > 0; shift--) {
+        dec128_mul_add(w, 10, 0);
+    }
+    for (; shift < 0; shift++) {
+        dec128_div10(w);
+    }
+    if (neg) {
+        dec128_negate(w);
+    }
+    /* Arrow data in the body follows the endianness declared in the schema. */
+    for (idx = 0; idx < 4; idx++) {
+        uint32_t limb = is_big_endian() ? w[3 - idx] : w[idx];
+        memcpy(out + idx * 4, &limb, 4);
+    }
+    return 1;
+}
+
+/* Sets precision and scale of decimal128 columns. */
+static arrow_type_t arrow_type_of(const var_t *var, const dpiQueryInfo *info, uint32_t pos,
+                                  int number_as_float, int32_t *precision, int32_t *scale)
+{
+    switch (var->native_type) {
+    case DPI_NATIVE_TYPE_INT64:
+        return ARROW_INT64;
+    case DPI_NATIVE_TYPE_UINT64:
+        return ARROW_UINT64;
+    case DPI_NATIVE_TYPE_FLOAT:
+        return ARROW_FLOAT32;
+    case DPI_NATIVE_TYPE_DOUBLE:
+        return ARROW_FLOAT64;
+    case DPI_NATIVE_TYPE_BOOLEAN:
+        return ARROW_BOOLEAN;
+    case DPI_NATIVE_TYPE_ROWID:
+        return ARROW_UTF8;
+    case DPI_NATIVE_TYPE_INTERVAL_DS:
+        return ARROW_DURATION_US;
+    case DPI_NATIVE_TYPE_INTERVAL_YM:
+        return ARROW_INTERVAL_YM;
+    case DPI_NATIVE_TYPE_TIMESTAMP:
+        switch (var->oracle_type) {
+        case DPI_ORACLE_TYPE_DATE:
+            return ARROW_TIMESTAMP_S;
+        case DPI_ORACLE_TYPE_TIMESTAMP_TZ:
+        case DPI_ORACLE_TYPE_TIMESTAMP_LTZ:
+            return ARROW_TIMESTAMP_US_UTC;
+        default:
+            return ARROW_TIMESTAMP_US;
+        }
+    case DPI_NATIVE_TYPE_BYTES:
+        switch (var->oracle_type) {
+        case DPI_ORACLE_TYPE_NUMBER:
+            {
+                int32_t p = info->typeInfo.precision;
+                int32_t s = info->typeInfo.scale;
+
+                /* The scale of FLOAT and NUMBER without precision is -127. */
+                if (0 < p && p <= 38 && s != -127) {
+                    /* A negative scale rounds to the left of the decimal point,
+                     * and a scale above the precision adds leading zeros. */
+                    int32_t digits = s < 0 ? p - s : (s > p ? s : p);
+
+                    if (digits <= 38) {
+                        *precision = digits;
+                        *scale = s < 0 ? 0 : s;
+                        return ARROW_DECIMAL128;
+                    }
+                }
+                /* The decimal text is exact. */
+                return number_as_float ? ARROW_FLOAT64 : ARROW_UTF8;
+            }
+        case DPI_ORACLE_TYPE_RAW:
+        case DPI_ORACLE_TYPE_LONG_RAW:
+            return ARROW_BINARY;
+        default:
+            return ARROW_UTF8;
+        }
+    }
+    rb_raise(rb_eArgError, "unsupported column type %s at position %u",
+             rb_id2name(SYM2ID(rbdpi_from_dpiOracleTypeNum(var->oracle_type))), pos);
+}
+
+/*
+ * record batch
+ */
+static void add_buffer(arrow_writer_t *w, int64_t *offset, long len)
+{
+    arrow_buffer_t *buf = &w->buffers[w->num_buffers++];
+
+    buf->offset = *offset;
+    buf->length = len;
+    *offset += (len + 7) & ~7L;
+}
+
+static char *values_reserve(VALUE str, long len)
+{
+    rb_str_resize(str, len);
+    return RSTRING_PTR(str);
+}
+
+static void encode_column(arrow_writer_t *w, arrow_col_t *col, uint32_t index, uint32_t rows)
+{
+    unsigned char *validity = (unsigned char *)values_reserve(col->validity, (rows + 7) / 8);
+    char *values = NULL;
+    int32_t offset = 0;
+    uint32_t row;
+
+    memset(validity, 0, (rows + 7) / 8);
+    col->null_count = 0;
+    switch (col->type) {
+    case ARROW_UTF8:
+    case ARROW_BINARY:
+        values_reserve(col->offsets, (rows + 1) * sizeof(int32_t));
+        memcpy(RSTRING_PTR(col->offsets), &offset, sizeof(int32_t));
+        rb_str_set_len(col->values, 0);
+        break;
+    case ARROW_BOOLEAN:
+        values = values_reserve(col->values, (rows + 7) / 8);
+        memset(values, 0, (rows + 7) / 8);
+        break;
+    case ARROW_DECIMAL128:
+        values = values_reserve(col->values, rows * 16);
+        break;
+    case ARROW_FLOAT32:
+    case ARROW_INTERVAL_YM:
+        values = values_reserve(col->values, rows * 4);
+        break;
+    default:
+        values = values_reserve(col->values, rows * 8);
+    }
+    if (values != NULL) {
+        memset(values, 0, RSTRING_LEN(col->values));
+    }
+
+    for (row = 0; row < rows; row++) {
+        const dpiData *data = &col->data[index + row];
+
+        if (data->isNull) {
+            col->null_count++;
+            if (col->type == ARROW_UTF8 || col->type == ARROW_BINARY) {
+                memcpy(RSTRING_PTR(col->offsets) + (row + 1) * sizeof(int32_t), &offset, sizeof(int32_t));
+            }
+            continue;
+        }
+        validity[row / 8] |= 1 << (row % 8);
+        switch (col->type) {
+        case ARROW_INT64:
+        case ARROW_UINT64:
+            memcpy(values + row * 8, &data->value.asInt64, 8);
+            break;
+        case ARROW_FLOAT32:
+            memcpy(values + row * 4, &data->value.asFloat, 4);
+            break;
+        case ARROW_FLOAT64:
+            if (col->var->native_type == DPI_NATIVE_TYPE_BYTES) {
+                char buf[64];
+                uint32_t len = data->value.asBytes.length;
+                double dval;
+
+                if (len >= sizeof(buf)) {
+                    len = sizeof(buf) - 1;
+                }
+                memcpy(buf, data->value.asBytes.ptr, len);
+                buf[len] = '\0';
+                dval = strtod(buf, NULL);
+                memcpy(values + row * 8, &dval, 8);
+            } else {
+                memcpy(values + row * 8, &data->value.asDouble, 8);
+            }
+            break;
+        case ARROW_DECIMAL128:
+            if (!decimal128_from_text(data->value.asBytes.ptr, data->value.asBytes.length,
+                                      col->scale, (unsigned char *)values + row * 16)) {
+                rb_raise(rb_eRuntimeError, "invalid number: %.*s",
+                         (int)data->value.asBytes.length, data->value.asBytes.ptr);
+            }
+            break;
+        case ARROW_UTF8:
+        case ARROW_BINARY:
+            {
+                const char *ptr;
+                uint32_t len;
+
+                if (col->var->native_type == DPI_NATIVE_TYPE_ROWID) {
+                    CHK(dpiRowid_getStringValue(data->value.asRowid, &ptr, &len));
+                    rb_str_cat(col->values, ptr, len);
+                } else if (col->conv_enc != NULL) {
+                    VALUE str = rb_enc_str_new(data->value.asBytes.ptr, data->value.asBytes.length, col->conv_enc);
+
+                    str = encode_text(str, rb_utf8_encoding());
+                    rb_str_cat(col->values, RSTRING_PTR(str), RSTRING_LEN(str));
+                } else {
+                    VALUE str = Qnil;
+
+                    if (col->type == ARROW_UTF8) {
+                        str = utf8_scrub(data->value.asBytes.ptr, data->value.asBytes.length);
+                    }
+                    if (NIL_P(str)) {
+                        rb_str_cat(col->values, data->value.asBytes.ptr, data->value.asBytes.length);
+                    } else {
+                        rb_str_cat(col->values, RSTRING_PTR(str), RSTRING_LEN(str));
+                    }
+                }
+                if (RSTRING_LEN(col->values) > INT32_MAX) {
+                    rb_raise(rb_eRuntimeError, "too large data in a record batch");
+                }
+                offset = (int32_t)RSTRING_LEN(col->values);
+                memcpy(RSTRING_PTR(col->offsets) + (row + 1) * sizeof(int32_t), &offset, sizeof(int32_t));
+            }
+            break;
+        case ARROW_BOOLEAN:
+            if (data->value.asBoolean) {
+                values[row / 8] |= 1 << (row % 8);
+            }
+            break;
+        case ARROW_TIMESTAMP_S:
+            {
+                int64_t sec = timestamp_to_epoch(&data->value.asTimestamp, 0);
+                memcpy(values + row * 8, &sec, 8);
+            }
+            break;
+        case ARROW_TIMESTAMP_US:
+        case ARROW_TIMESTAMP_US_UTC:
+            {
+                const dpiTimestamp *ts = &data->value.asTimestamp;
+                int64_t usec = timestamp_to_epoch(ts, col->type == ARROW_TIMESTAMP_US_UTC) * 1000000
+                    + ts->fsecond / 1000;
+                memcpy(values + row * 8, &usec, 8);
+            }
+            break;
+        case ARROW_DURATION_US:
+            {
+                const dpiIntervalDS *ds = &data->value.asIntervalDS;
+                int64_t usec = (((int64_t)ds->days * 24 + ds->hours) * 60 + ds->minutes) * 60 + ds->seconds;
+
+                usec = usec * 1000000 + ds->fseconds / 1000;
+                memcpy(values + row * 8, &usec, 8);
+            }
+            break;
+        case ARROW_INTERVAL_YM:
+            {
+                int32_t months = data->value.asIntervalYM.years * 12 + data->value.asIntervalYM.months;
+                memcpy(values + row * 4, &months, 4);
+            }
+            break;
+        }
+    }
+}
+
+static void out_body_buffer(arrow_writer_t *w, VALUE str, long len)
+{
+    if (len > 0) {
+        out_cat(w, RSTRING_PTR(str), len);
+        out_pad(w);
+    }
+}
+
+static void write_record_batch(arrow_writer_t *w, uint32_t index, uint32_t rows)
+{
+    fb_builder_t *fb = &w->fb;
+    int64_t body_len = 0;
+    int64_t start;
+    int32_t meta_len;
+    uint32_t nodes, buffers, batch;
+    uint32_t idx;
+
+    w->num_buffers = 0;
+    for (idx = 0; idx < w->num_cols; idx++) {
+        arrow_col_t *col = &w->cols[idx];
+
+        encode_column(w, col, index, rows);
+        /* The validity bitmap may be omitted when there are no nulls. */
+        add_buffer(w, &body_len, col->null_count ? RSTRING_LEN(col->validity) : 0);
+        if (col->type == ARROW_UTF8 || col->type == ARROW_BINARY) {
+            add_buffer(w, &body_len, RSTRING_LEN(col->offsets));
+        }
+        add_buffer(w, &body_len, RSTRING_LEN(col->values));
+    }
+
+    fb_reset(fb);
+    fb_start_struct_vector(fb, 16, w->num_buffers, 8);
+    for (idx = w->num_buffers; idx > 0; idx--) {
+        fb_put(fb, (uint64_t)w->buffers[idx - 1].length, 8);
+        fb_put(fb, (uint64_t)w->buffers[idx - 1].offset, 8);
+    }
+    buffers = fb_end_vector(fb, w->num_buffers);
+    fb_start_struct_vector(fb, 16, w->num_cols, 8);
+    for (idx = w->num_cols; idx > 0; idx--) {
+        fb_put(fb, (uint64_t)w->cols[idx - 1].null_count, 8);
+        fb_put(fb, rows, 8);
+    }
+    nodes = fb_end_vector(fb, w->num_cols);
+    fb_start_table(fb, 4);
+    fb_add_scalar(fb, 0, rows, 8);
+    fb_add_offset(fb, 1, nodes);
+    fb_add_offset(fb, 2, buffers);
+    batch = fb_end_table(fb);
+    fb_finish(fb, build_message(fb, ARROW_HEADER_RECORD_BATCH, batch, body_len));
+
+    start = w->pos;
+    meta_len = write_message(w);
+    for (idx = 0; idx < w->num_cols; idx++) {
+        arrow_col_t *col = &w->cols[idx];
+
+        out_body_buffer(w, col->validity, col->null_count ? RSTRING_LEN(col->validity) : 0);
+        if (col->type == ARROW_UTF8 || col->type == ARROW_BINARY) {
+            out_body_buffer(w, col->offsets, RSTRING_LEN(col->offsets));
+        }
+        out_body_buffer(w, col->values, RSTRING_LEN(col->values));
+    }
+    if (!NIL_P(w->blocks)) {
+        arrow_block_t block;
+
+        block.offset = start;
+        block.meta_len = meta_len;
+        block.body_len = body_len;
+        rb_str_cat(w->blocks, (const char *)&block, sizeof(block));
+    }
+}
+
+static void write_footer(arrow_writer_t *w)
+{
+    fb_builder_t *fb = &w->fb;
+    const arrow_block_t *blocks = (const arrow_block_t *)RSTRING_PTR(w->blocks);
+    uint32_t num_blocks = (uint32_t)(RSTRING_LEN(w->blocks) / sizeof(arrow_block_t));
+    uint32_t schema, batches, dicts, footer, idx;
+
+    fb_reset(fb);
+    schema = build_schema(w);
+    fb_start_struct_vector(fb, 24, 0, 8);
+    dicts = fb_end_vector(fb, 0);
+    fb_start_struct_vector(fb, 24, num_blocks, 8);
+    for (idx = num_blocks; idx > 0; idx--) {
+        fb_put(fb, (uint64_t)blocks[idx - 1].body_len, 8);
+        fb_pad(fb, 4);
+        fb_put(fb, (uint32_t)blocks[idx - 1].meta_len, 4);
+        fb_put(fb, (uint64_t)blocks[idx - 1].offset, 8);
+    }
+    batches = fb_end_vector(fb, num_blocks);
+    fb_start_table(fb, 5);
+    fb_add_offset(fb, 1, schema);
+    fb_add_offset(fb, 2, dicts);
+    fb_add_offset(fb, 3, batches);
+    fb_add_scalar(fb, 0, ARROW_METADATA_V5, 2);
+    footer = fb_end_table(fb);
+    fb_finish(fb, footer);
+    out_cat(w, fb_ptr(fb), fb->len);
+    out_le32(w, fb->len);
+    out_cat(w, ARROW_MAGIC, 6);
+}
+
+VALUE rbdpi_stmt_copy_to_arrow(VALUE self, VALUE conn, VALUE vars, VALUE io, VALUE format, VALUE params)
+{
+    VALUE kwargs[3];
+    arrow_writer_t w = {0,};
+    VALUE gc_guard = rb_ary_new();
+    VALUE buffers;
+    uint32_t num_cols;
+    uint32_t fetch_size;
+    uint32_t idx;
+    int more_rows;
+
+    w.stmt = rbdpi_to_stmt(self);
+    w.conn = rbdpi_to_conn(conn);
+    w.io = io;
+    w.chunk_size = DEFAULT_CHUNK_SIZE;
+    w.progress = Qnil;
+    if (format == sym_arrow_file) {
+        w.blocks = rb_str_buf_new(0);
+    } else if (format == sym_arrow_stream) {
+        w.blocks = Qnil;
+    } else {
+        rb_raise(rb_eArgError, "unknown format: %"PRIsVALUE, rb_inspect(format));
+    }
+
+    if (!NIL_P(params)) {
+        rb_get_kwargs(params, writer_keyword_ids, 0, -3-1, kwargs);
+        /* chunk_size */
+        if (kwargs[0] != Qundef) {
+            w.chunk_size = NUM2LONG(kwargs[0]);
+            if (w.chunk_size <= 0) {
+                rb_raise(rb_eArgError, "chunk_size must be positive");
+            }
+        }
+        /* progress */
+        if (kwargs[1] != Qundef) {
+            w.progress = kwargs[1];
+        }
+        /* number */
+        if (kwargs[2] != Qundef) {
+            if (kwargs[2] == sym_float64) {
+                w.number_as_float = 1;
+            } else if (kwargs[2] != sym_text) {
+                rb_raise(rb_eArgError, "number must be :text or :float64");
+            }
+        }
+    }
+
+    CHK(dpiStmt_getNumQueryColumns(w.stmt->handle, &num_cols));
+    Check_Type(vars, T_ARRAY);
+    if (num_cols == 0) {
+        rb_raise(rb_eRuntimeError, "not a query");
+    }
+    if (RARRAY_LEN(vars) != num_cols) {
+        rb_raise(rb_eArgError, "the number of variables %ld doesn't match the number of columns %u",
+                 RARRAY_LEN(vars), num_cols);
+    }
+    w.num_cols = num_cols;
+    w.cols = ALLOCA_N(arrow_col_t, num_cols);
+    buffers = rb_str_tmp_new(num_cols * 3 * sizeof(arrow_buffer_t));
+    w.buffers = (arrow_buffer_t *)RSTRING_PTR(buffers);
+    for (idx = 0; idx < num_cols; idx++) {
+        arrow_col_t *col = &w.cols[idx];
+        dpiQueryInfo info;
+        rb_encoding *enc;
+        uint32_t num;
+
+        memset(col, 0, sizeof(*col));
+        col->var = rbdpi_to_var(RARRAY_AREF(vars, idx));
+        CHK(dpiStmt_getQueryInfo(w.stmt->handle, idx + 1, &info));
+        col->precision = info.typeInfo.precision;
+        col->scale = info.typeInfo.scale;
+        col->type = arrow_type_of(col->var, &info, idx + 1, w.number_as_float, &col->precision, &col->scale);
+        col->nullable = info.nullOk;
+        enc = (rb_encoding *)w.stmt->enc.enc;
+        col->name = encode_text(rb_enc_str_new(info.name, info.nameLength, enc), rb_utf8_encoding());
+        if (col->type == ARROW_UTF8 && col->var->native_type == DPI_NATIVE_TYPE_BYTES) {
+            enc = (rb_encoding *)(rbdpi_ora2enc_type(col->var->oracle_type) == ENC_TYPE_NCHAR ?
+                                  col->var->enc.nenc : col->var->enc.enc);
+            if (enc != rb_utf8_encoding()) {
+                col->conv_enc = enc;
+            }
+        }
+        col->validity = rb_str_buf_new(0);
+        col->values = rb_str_buf_new(0);
+        col->offsets = rb_str_buf_new(0);
+        rb_ary_push(gc_guard, col->name);
+        rb_ary_push(gc_guard, col->validity);
+        rb_ary_push(gc_guard, col->values);
+        rb_ary_push(gc_guard, col->offsets);
+        CHK(dpiVar_getData(col->var->handle, &num, &col->data));
+    }
+    CHK(dpiStmt_getFetchArraySize(w.stmt->handle, &fetch_size));
+
+    fb_init(&w.fb);
+    w.buf = rb_str_buf_new(w.chunk_size);
+    if (!NIL_P(w.blocks)) {
+        out_cat(&w, ARROW_MAGIC "\0\0", 8);
+    }
+    write_schema(&w);
+    do {
+        uint32_t index, rows;
+
+        CHK(dpiStmt_fetchRows_without_gvl(w.conn->handle, w.stmt->handle, fetch_size,
+                                          &index, &rows, &more_rows));
+        if (rows > 0) {
+            write_record_batch(&w, index, rows);
+            w.num_rows += rows;
+            if (RSTRING_LEN(w.buf) >= w.chunk_size) {
+                out_flush(&w);
+            }
+            if (!NIL_P(w.progress)) {
+                rb_funcall(w.progress, id_call, 1, ULL2NUM(w.num_rows));
+            }
+        }
+    } while (more_rows);
+    /* end-of-stream marker */
+    out_le32(&w, ARROW_CONTINUATION);
+    out_le32(&w, 0);
+    if (!NIL_P(w.blocks)) {
+        write_footer(&w);
+    }
+    out_flush(&w);
+    RB_GC_GUARD(w.buf);
+    RB_GC_GUARD(w.blocks);
+    RB_GC_GUARD(w.fb.str);
+    RB_GC_GUARD(buffers);
+    RB_GC_GUARD(gc_guard);
+    return ULL2NUM(w.num_rows);
+}
+
+/*
+ * FlatBuffers reader
+ *
+ * Input data comes from outside. All offsets are checked against the buffer.
+ */
+typedef struct {
+    const unsigned char *buf;
+    uint32_t len;
+} fb_reader_t;
+
+typedef struct {
+    const fb_reader_t *r;
+    uint32_t pos;
+    uint32_t vt;
+    uint32_t vt_len;
+} fb_table_t;
+
+NORETURN(static void fb_invalid(void));
+
+static void fb_invalid(void)
+{
+    rb_raise(rb_eRuntimeError, "invalid Arrow IPC data");
+}
+
+static uint64_t fb_read(const fb_reader_t *r, uint32_t pos, uint32_t size)
+{
+    uint64_t val = 0;
+    uint32_t idx;
+
+    if (pos > r->len || r->len - pos < size) {
+        fb_invalid();
+    }
+    for (idx = size; idx > 0; idx--) {
+        val = (val << 8) | r->buf[pos + idx - 1];
+    }
+    return val;
+}
+
+static void fb_table_at(const fb_reader_t *r, uint32_t pos, fb_table_t *t)
+{
+    int32_t soff = (int32_t)fb_read(r, pos, 4);
+
+    t->r = r;
+    t->pos = pos;
+    t->vt = pos - soff;
+    t->vt_len = (uint32_t)fb_read(r, t->vt, 2);
+}
+
+static void fb_root(const fb_reader_t *r, fb_table_t *t)
+{
+    fb_table_at(r, (uint32_t)fb_read(r, 0, 4), t);
+}
+
+/* Returns the position of the field or 0 when it is absent. */
+static uint32_t fb_field(const fb_table_t *t, uint32_t slot)
+{
+    uint32_t off = 4 + 2 * slot;
+
+    if (off + 2 > t->vt_len) {
+        return 0;
+    }
+    off = (uint32_t)fb_read(t->r, t->vt + off, 2);
+    return off ? t->pos + off : 0;
+}
+
+static uint64_t fb_get(const fb_table_t *t, uint32_t slot, uint32_t size, uint64_t defval)
+{
+    uint32_t pos = fb_field(t, slot);
+    return pos ? fb_read(t->r, pos, size) : defval;
+}
+
+static uint32_t fb_get_ref(const fb_table_t *t, uint32_t slot)
+{
+    uint32_t pos = fb_field(t, slot);
+    return pos ? pos + (uint32_t)fb_read(t->r, pos, 4) : 0;
+}
+
+static int fb_get_table(const fb_table_t *t, uint32_t slot, fb_table_t *out)
+{
+    uint32_t pos = fb_get_ref(t, slot);
+
+    if (pos == 0) {
+        return 0;
+    }
+    fb_table_at(t->r, pos, out);
+    return 1;
+}
+
+/* Returns the number of elements and sets the position of the first element. */
+static uint32_t fb_get_vector(const fb_table_t *t, uint32_t slot, uint32_t elem_size, uint32_t *elems)
+{
+    uint32_t pos = fb_get_ref(t, slot);
+    uint32_t num;
+
+    if (pos == 0) {
+        *elems = 0;
+        return 0;
+    }
+    num = (uint32_t)fb_read(t->r, pos, 4);
+    *elems = pos + 4;
+    if (num > 0) {
+        fb_read(t->r, *elems, 0);
+        if ((t->r->len - *elems) / elem_size < num) {
+            fb_invalid();
+        }
+    }
+    return num;
+}
+
+static const char *fb_get_string(const fb_table_t *t, uint32_t slot, uint32_t *len)
+{
+    uint32_t elems;
+
+    *len = fb_get_vector(t, slot, 1, &elems);
+    return *len ? (const char *)t->r->buf + elems : NULL;
+}
+
+/*
+ * Arrow loader
+ */
+typedef enum {
+    LOAD_INT,
+    LOAD_UINT,
+    LOAD_FLOAT32,
+    LOAD_FLOAT64,
+    LOAD_BOOLEAN,
+    LOAD_UTF8,
+    LOAD_BINARY,
+    LOAD_TIMESTAMP,
+    LOAD_DATE32,
+    LOAD_DATE64,
+    LOAD_DECIMAL128,
+} load_type_t;
+
+typedef struct {
+    load_type_t type;
+    uint32_t width;     /* byte width of LOAD_INT and LOAD_UINT */
+    int64_t per_sec;    /* units per second of LOAD_TIMESTAMP */
+    int tz;             /* LOAD_TIMESTAMP with time zone */
+    int32_t scale;      /* LOAD_DECIMAL128 */
+    VALUE bind_name;    /* Qnil to bind by position */
+    VALUE var;
+    dpiData *data;
+    uint32_t var_size;
+    /* arrays in the current record batch */
+    const unsigned char *validity;
+    const int32_t *offsets;
+    const char *values;
+} load_col_t;
+
+typedef struct {
+    stmt_t *stmt;
+    conn_t *conn;
+    VALUE gc_guard;
+    VALUE errors;
+    VALUE progress;
+    rb_encoding *conv_enc; /* non-NULL when text must be converted from UTF-8 */
+    uint32_t num_cols;
+    load_col_t *cols;
+    uint32_t batch_size;
+    dpiExecMode exec_mode;
+    long max_errors;
+    uint64_t row_no;
+    uint64_t num_rows;
+} arrow_loader_t;
+
+static int64_t floor_div(int64_t a, int64_t b)
+{
+    int64_t q = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+static void epoch_to_timestamp(int64_t sec, uint32_t nsec, dpiTimestamp *ts)
+{
+    int64_t days = floor_div(sec, 86400);
+    int64_t rem = sec - days * 86400;
+    int64_t z = days + 719468;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    unsigned doe = (unsigned)(z - era * 146097);
+    unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    unsigned mp = (5 * doy + 2) / 153;
+    unsigned month = mp < 10 ? mp + 3 : mp - 9;
+
+    memset(ts, 0, sizeof(*ts));
+    ts->year = (int16_t)(yoe + era * 400 + (month <= 2));
+    ts->month = month;
+    ts->day = doy - (153 * mp + 2) / 5 + 1;
+    ts->hour = (uint8_t)(rem / 3600);
+    ts->minute = (uint8_t)(rem / 60 % 60);
+    ts->second = (uint8_t)(rem % 60);
+    ts->fsecond = nsec;
+}
+
+static long decimal128_to_text(const unsigned char *ptr, int32_t scale, char *buf)
+{
+    uint32_t w[4];
+    char digits[48];
+    int neg, n = 0;
+    long len = 0;
+    int idx;
+
+    memcpy(w, ptr, 16);
+    neg = (w[3] >> 31) != 0;
+    if (neg) {
+        dec128_negate(w);
+    }
+    while (w[0] | w[1] | w[2] | w[3]) {
+        digits[n++] = '0' + dec128_div10(w);
+    }
+    while (n <= scale && n < 40) {
+        digits[n++] = '0';
+    }
+    if (neg) {
+        buf[len++] = '-';
+    }
+    for (idx = n - 1; idx >= 0; idx--) {
+        buf[len++] = digits[idx];
+        if (idx == scale && idx > 0) {
+            buf[len++] = '.';
+        }
+    }
+    for (idx = scale; idx < 0 && len < 80; idx++) {
+        buf[len++] = '0';
+    }
+    return len;
+}
+
+static void loader_bind(arrow_loader_t *ld, load_col_t *col, uint32_t pos, dpiOracleTypeNum oracle_type, dpiNativeTypeNum native_type, uint32_t size)
+{
+    dpiVar *handle;
+    dpiData *data;
+
+    CHK(dpiConn_newVar(ld->conn->handle, oracle_type, native_type, ld->batch_size,
+                       size, 1, 0, NULL, &handle, &data));
+    col->var = rbdpi_from_var(handle, &ld->conn->enc, oracle_type, native_type, Qnil);
+    rb_ary_push(ld->gc_guard, col->var);
+    col->data = data;
+    col->var_size = size;
+    if (NIL_P(col->bind_name)) {
+        CHK(dpiStmt_bindByPos(ld->stmt->handle, pos, handle));
+    } else {
+        CHK(dpiStmt_bindByName(ld->stmt->handle, RSTRING_PTR(col->bind_name),
+                               (uint32_t)RSTRING_LEN(col->bind_name), handle));
+    }
+}
+
+/* Creates bind variables. Variable-length columns are rebound when values don't fit. */
+static void loader_prepare_vars(arrow_loader_t *ld, uint32_t start, uint32_t rows)
+{
+    uint32_t idx, row;
+
+    for (idx = 0; idx < ld->num_cols; idx++) {
+        load_col_t *col = &ld->cols[idx];
+        uint32_t size = 0;
+
+        switch (col->type) {
+        case LOAD_UTF8:
+        case LOAD_BINARY:
+            for (row = start; row < start + rows; row++) {
+                int32_t len = col->offsets[row + 1] - col->offsets[row];
+                if (len < 0) {
+                    fb_invalid();
+                }
+                if (size < (uint32_t)len) {
+                    size = len;
+                }
+            }
+            if (size == 0) {
+                size = 1;
+            }
+            if (NIL_P(col->var) || col->var_size < size) {
+                if (col->type == LOAD_UTF8) {
+                    loader_bind(ld, col, idx + 1, DPI_ORACLE_TYPE_VARCHAR, DPI_NATIVE_TYPE_BYTES, size);
+                } else {
+                    loader_bind(ld, col, idx + 1, DPI_ORACLE_TYPE_RAW, DPI_NATIVE_TYPE_BYTES, size);
+                }
+            }
+            break;
+        default:
+            if (!NIL_P(col->var)) {
+                break;
+            }
+            switch (col->type) {
+            case LOAD_UINT:
+                if (col->width == 8) {
+                    loader_bind(ld, col, idx + 1, DPI_ORACLE_TYPE_NUMBER, DPI_NATIVE_TYPE_UINT64, 0);
+                    break;
+                }
+                /* FALLTHROUGH */
+            case LOAD_INT:
+            case LOAD_BOOLEAN:
+                loader_bind(ld, col, idx + 1, DPI_ORACLE_TYPE_NUMBER, DPI_NATIVE_TYPE_INT64, 0);
+                break;
+            case LOAD_FLOAT32:
+                loader_bind(ld, col, idx + 1, DPI_ORACLE_TYPE_NATIVE_FLOAT, DPI_NATIVE_TYPE_FLOAT, 0);
+                break;
+            case LOAD_FLOAT64:
+                loader_bind(ld, col, idx + 1, DPI_ORACLE_TYPE_NATIVE_DOUBLE, DPI_NATIVE_TYPE_DOUBLE, 0);
+                break;
+            case LOAD_TIMESTAMP:
+                loader_bind(ld, col, idx + 1, col->tz ? DPI_ORACLE_TYPE_TIMESTAMP_TZ : DPI_ORACLE_TYPE_TIMESTAMP,
+                            DPI_NATIVE_TYPE_TIMESTAMP, 0);
+                break;
+            case LOAD_DATE32:
+            case LOAD_DATE64:
+                loader_bind(ld, col, idx + 1, DPI_ORACLE_TYPE_DATE, DPI_NATIVE_TYPE_TIMESTAMP, 0);
+                break;
+            case LOAD_DECIMAL128:
+                loader_bind(ld, col, idx + 1, DPI_ORACLE_TYPE_NUMBER, DPI_NATIVE_TYPE_BYTES, 48);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+}
+
+static void loader_set_value(arrow_loader_t *ld, load_col_t *col, uint32_t idx, uint32_t row)
+{
+    dpiData *data = &col->data[idx];
+    const var_t *var = rbdpi_to_var(col->var);
+
+    if (col->validity != NULL && !(col->validity[row / 8] & (1 << (row % 8)))) {
+        data->isNull = 1;
+        return;
+    }
+    data->isNull = 0;
+    switch (col->type) {
+    case LOAD_INT:
+        switch (col->width) {
+        case 1:
+            data->value.asInt64 = ((const int8_t *)col->values)[row];
+            break;
+        case 2:
+            data->value.asInt64 = ((const int16_t *)col->values)[row];
+            break;
+        case 4:
+            data->value.asInt64 = ((const int32_t *)col->values)[row];
+            break;
+        default:
+            data->value.asInt64 = ((const int64_t *)col->values)[row];
+        }
+        break;
+    case LOAD_UINT:
+        switch (col->width) {
+        case 1:
+            data->value.asInt64 = ((const uint8_t *)col->values)[row];
+            break;
+        case 2:
+            data->value.asInt64 = ((const uint16_t *)col->values)[row];
+            break;
+        case 4:
+            data->value.asInt64 = ((const uint32_t *)col->values)[row];
+            break;
+        default:
+            data->value.asUint64 = ((const uint64_t *)col->values)[row];
+        }
+        break;
+    case LOAD_FLOAT32:
+        data->value.asFloat = ((const float *)col->values)[row];
+        break;
+    case LOAD_FLOAT64:
+        data->value.asDouble = ((const double *)col->values)[row];
+        break;
+    case LOAD_BOOLEAN:
+        data->value.asInt64 = (col->values[row / 8] >> (row % 8)) & 1;
+        break;
+    case LOAD_UTF8:
+    case LOAD_BINARY:
+        {
+            const char *ptr = col->values + col->offsets[row];
+            uint32_t len = col->offsets[row + 1] - col->offsets[row];
+
+            VALUE str = Qnil;
+
+            if (col->type == LOAD_UTF8) {
+                if (ld->conv_enc != NULL) {
+                    str = encode_text(rb_utf8_str_new(ptr, len), ld->conv_enc);
+                } else {
+                    str = utf8_scrub(ptr, len);
+                }
+            }
+            if (!NIL_P(str)) {
+                CHK(dpiVar_setFromBytes(var->handle, idx, RSTRING_PTR(str), (uint32_t)RSTRING_LEN(str)));
+                RB_GC_GUARD(str);
+            } else {
+                CHK(dpiVar_setFromBytes(var->handle, idx, ptr, len));
+            }
+        }
+        break;
+    case LOAD_TIMESTAMP:
+        {
+            int64_t val = ((const int64_t *)col->values)[row];
+            int64_t sec = floor_div(val, col->per_sec);
+
+            epoch_to_timestamp(sec, (uint32_t)((val - sec * col->per_sec) * (1000000000 / col->per_sec)),
+                               &data->value.asTimestamp);
+        }
+        break;
+    case LOAD_DATE32:
+        epoch_to_timestamp((int64_t)((const int32_t *)col->values)[row] * 86400, 0, &data->value.asTimestamp);
+        break;
+    case LOAD_DATE64:
+        epoch_to_timestamp(floor_div(((const int64_t *)col->values)[row], 1000), 0, &data->value.asTimestamp);
+        break;
+    case LOAD_DECIMAL128:
+        {
+            char buf[96];
+            long len = decimal128_to_text((const unsigned char *)col->values + row * 16, col->scale, buf);
+
+            CHK(dpiVar_setFromBytes(var->handle, idx, buf, (uint32_t)len));
+        }
+        break;
+    }
+}
+
+static void loader_add_error(arrow_loader_t *ld, uint64_t row_no, VALUE exc)
+{
+    rb_ary_push(ld->errors, rb_ary_new_from_args(2, ULL2NUM(row_no), exc));
+    if (ld->max_errors >= 0 && RARRAY_LEN(ld->errors) > ld->max_errors) {
+        rb_exc_raise(exc);
+    }
+}
+
+/* Loads a record batch whose arrays are set to ld->cols. */
+static void loader_load_batch(arrow_loader_t *ld, uint32_t length)
+{
+    uint32_t start, idx, row;
+
+    for (start = 0; start < length; start += ld->batch_size) {
+        uint32_t rows = length - start;
+        uint32_t count;
+
+        if (rows > ld->batch_size) {
+            rows = ld->batch_size;
+        }
+        loader_prepare_vars(ld, start, rows);
+        for (idx = 0; idx < ld->num_cols; idx++) {
+            for (row = 0; row < rows; row++) {
+                loader_set_value(ld, &ld->cols[idx], row, start + row);
+            }
+        }
+        CHK(dpiStmt_executeMany_without_gvl(ld->conn->handle, ld->stmt->handle, ld->exec_mode, rows));
+        CHK(dpiStmt_getBatchErrorCount(ld->stmt->handle, &count));
+        if (count > 0) {
+            VALUE tmp = rb_str_tmp_new(count * sizeof(dpiErrorInfo));
+            dpiErrorInfo *errors = (dpiErrorInfo *)RSTRING_PTR(tmp);
+
+            CHK(dpiStmt_getBatchErrors(ld->stmt->handle, count, errors));
+            for (idx = 0; idx < count; idx++) {
+                loader_add_error(ld, ld->row_no + errors[idx].offset + 1, rbdpi_from_dpiErrorInfo(&errors[idx]));
+            }
+            RB_GC_GUARD(tmp);
+        }
+        ld->row_no += rows;
+        ld->num_rows += rows - count;
+        if (!NIL_P(ld->progress)) {
+            rb_funcall(ld->progress, id_call, 1, ULL2NUM(ld->num_rows));
+        }
+    }
+}
+
+static void loader_init(arrow_loader_t *ld, VALUE self, VALUE conn, VALUE batch_size, VALUE params)
+{
+    VALUE kwargs[3];
+    rb_encoding *enc;
+
+    memset(ld, 0, sizeof(*ld));
+    ld->stmt = rbdpi_to_stmt(self);
+    ld->conn = rbdpi_to_conn(conn);
+    ld->gc_guard = rb_ary_new();
+    ld->errors = rb_ary_new();
+    ld->progress = Qnil;
+    ld->batch_size = NUM2UINT(batch_size);
+    ld->exec_mode = DPI_MODE_EXEC_BATCH_ERRORS;
+    ld->max_errors = -1;
+    if (ld->batch_size == 0) {
+        rb_raise(rb_eArgError, "batch_size must be positive");
+    }
+    if (ld->batch_size > RBDPI_MAX_BATCH_SIZE) {
+        ld->batch_size = RBDPI_MAX_BATCH_SIZE;
+    }
+    enc = (rb_encoding *)ld->conn->enc.enc;
+    if (enc != rb_utf8_encoding()) {
+        ld->conv_enc = enc;
+    }
+    if (!NIL_P(params)) {
+        rb_get_kwargs(params, loader_keyword_ids, 0, -3-1, kwargs);
+        /* max_errors */
+        if (kwargs[0] != Qundef && !NIL_P(kwargs[0])) {
+            ld->max_errors = NUM2LONG(kwargs[0]);
+        }
+        /* commit */
+        if (kwargs[1] != Qundef && RTEST(kwargs[1])) {
+            ld->exec_mode |= DPI_MODE_EXEC_COMMIT_ON_SUCCESS;
+        }
+        /* progress */
+        if (kwargs[2] != Qundef) {
+            ld->progress = kwargs[2];
+        }
+    }
+}
+
+static void loader_alloc_cols(arrow_loader_t *ld, uint32_t num_cols)
+{
+    VALUE tmp = rb_str_tmp_new(num_cols * sizeof(load_col_t));
+    uint32_t idx;
+
+    rb_ary_push(ld->gc_guard, tmp);
+    ld->num_cols = num_cols;
+    ld->cols = (load_col_t *)RSTRING_PTR(tmp);
+    memset(ld->cols, 0, num_cols * sizeof(load_col_t));
+    for (idx = 0; idx < num_cols; idx++) {
+        ld->cols[idx].bind_name = Qnil;
+        ld->cols[idx].var = Qnil;
+    }
+}
+
+static VALUE loader_result(arrow_loader_t *ld)
+{
+    RB_GC_GUARD(ld->gc_guard);
+    return rb_ary_new_from_args(2, ULL2NUM(ld->num_rows), ld->errors);
+}
+
+/* Returns the byte width of the values buffer, 0 for bit-packed values
+ * and -1 for variable-length values.
+ */
+static int load_type_width(const load_col_t *col)
+{
+    switch (col->type) {
+    case LOAD_INT:
+    case LOAD_UINT:
+        return col->width;
+    case LOAD_FLOAT32:
+    case LOAD_DATE32:
+        return 4;
+    case LOAD_FLOAT64:
+    case LOAD_TIMESTAMP:
+    case LOAD_DATE64:
+        return 8;
+    case LOAD_DECIMAL128:
+        return 16;
+    case LOAD_BOOLEAN:
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+static int64_t time_unit_per_sec(int unit)
+{
+    static const int64_t per_sec[] = {1, 1000, 1000000, 1000000000};
+
+    if (unit < 0 || unit > 3) {
+        fb_invalid();
+    }
+    return per_sec[unit];
+}
+
+/*
+ * Arrow IPC stream reader
+ */
+static VALUE read_bytes(VALUE io, long len, int eof_ok)
+{
+    VALUE str = rb_funcall(io, id_read, 1, LONG2NUM(len));
+
+    if (NIL_P(str) && eof_ok) {
+        return Qnil;
+    }
+    if (NIL_P(str) || RSTRING_LEN(StringValue(str)) != len) {
+        rb_raise(rb_eEOFError, "unexpected end of Arrow IPC data");
+    }
+    return str;
+}
+
+static uint32_t le32(const char *ptr)
+{
+    const unsigned char *p = (const unsigned char *)ptr;
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Reads the next message. Returns Qnil at the end of stream. */
+static VALUE read_message(VALUE io, VALUE *first, fb_reader_t *r, int64_t *body_len, uint8_t *header_type, fb_table_t *header)
+{
+    VALUE prefix = NIL_P(*first) ? read_bytes(io, 8, 1) : *first;
+    VALUE meta;
+    uint32_t len;
+    fb_table_t msg;
+
+    *first = Qnil;
+    if (NIL_P(prefix)) {
+        return Qnil;
+    }
+    len = le32(RSTRING_PTR(prefix));
+    if (len == ARROW_CONTINUATION) {
+        len = le32(RSTRING_PTR(prefix) + 4);
+        if (len == 0) {
+            return Qnil;
+        }
+        meta = read_bytes(io, len, 0);
+    } else {
+        /* format before Arrow 0.15 without the continuation marker */
+        if (len == 0) {
+            return Qnil;
+        }
+        if (len < 4) {
+            fb_invalid();
+        }
+        meta = rb_str_plus(rb_str_subseq(prefix, 4, 4), read_bytes(io, len - 4, 0));
+    }
+    r->buf = (const unsigned char *)RSTRING_PTR(meta);
+    r->len = (uint32_t)RSTRING_LEN(meta);
+    fb_root(r, &msg);
+    *header_type = (uint8_t)fb_get(&msg, 1, 1, 0);
+    *body_len = (int64_t)fb_get(&msg, 3, 8, 0);
+    if (!fb_get_table(&msg, 2, header) || *body_len < 0) {
+        fb_invalid();
+    }
+    return meta;
+}
+
+static void read_schema(arrow_loader_t *ld, const fb_table_t *schema)
+{
+    uint32_t elems, num_cols, idx;
+
+    if (fb_get(schema, 0, 2, 0) != (uint64_t)is_big_endian()) {
+        rb_raise(rb_eNotImpError, "Arrow data in non-native byte order is not supported");
+    }
+    num_cols = fb_get_vector(schema, 1, 4, &elems);
+    if (num_cols == 0) {
+        rb_raise(rb_eArgError, "no columns in the Arrow schema");
+    }
+    loader_alloc_cols(ld, num_cols);
+    for (idx = 0; idx < num_cols; idx++) {
+        load_col_t *col = &ld->cols[idx];
+        uint32_t pos = elems + idx * 4;
+        uint32_t children;
+        fb_table_t field, type;
+        uint8_t type_type;
+        uint32_t name_len;
+        const char *name;
+
+        fb_table_at(schema->r, pos + (uint32_t)fb_read(schema->r, pos, 4), &field);
+        name = fb_get_string(&field, 0, &name_len);
+        type_type = (uint8_t)fb_get(&field, 2, 1, 0);
+        if (!fb_get_table(&field, 3, &type)) {
+            fb_invalid();
+        }
+        if (fb_get_ref(&field, 4) != 0 || fb_get_vector(&field, 5, 4, &children) != 0) {
+            goto unsupported;
+        }
+        switch (type_type) {
+        case ARROW_TYPE_INT:
+            col->width = (uint32_t)fb_get(&type, 0, 4, 0) / 8;
+            col->type = fb_get(&type, 1, 1, 0) ? LOAD_INT : LOAD_UINT;
+            if (col->width != 1 && col->width != 2 && col->width != 4 && col->width != 8) {
+                goto unsupported;
+            }
+            break;
+        case ARROW_TYPE_FLOATING_POINT:
+            switch (fb_get(&type, 0, 2, 0)) {
+            case ARROW_PRECISION_SINGLE:
+                col->type = LOAD_FLOAT32;
+                break;
+            case ARROW_PRECISION_DOUBLE:
+                col->type = LOAD_FLOAT64;
+                break;
+            default:
+                goto unsupported;
+            }
+            break;
+        case ARROW_TYPE_BOOL:
+            col->type = LOAD_BOOLEAN;
+            break;
+        case ARROW_TYPE_UTF8:
+            col->type = LOAD_UTF8;
+            break;
+        case ARROW_TYPE_BINARY:
+            col->type = LOAD_BINARY;
+            break;
+        case ARROW_TYPE_TIMESTAMP:
+            col->type = LOAD_TIMESTAMP;
+            col->per_sec = time_unit_per_sec((int)fb_get(&type, 0, 2, 0));
+            col->tz = fb_get_ref(&type, 1) != 0;
+            break;
+        case ARROW_TYPE_DATE:
+            col->type = fb_get(&type, 0, 2, 1) == 0 ? LOAD_DATE32 : LOAD_DATE64;
+            break;
+        case ARROW_TYPE_DECIMAL:
+            if (fb_get(&type, 2, 4, 128) != 128) {
+                goto unsupported;
+            }
+            col->type = LOAD_DECIMAL128;
+            col->scale = (int32_t)fb_get(&type, 1, 4, 0);
+            break;
+        default:
+            goto unsupported;
+        }
+        continue;
+unsupported:
+        rb_raise(rb_eArgError, "unsupported Arrow type of column %.*s", (int)name_len, name ? name : "");
+    }
+}
+
+static const char *body_buffer(const fb_reader_t *r, uint32_t elems, uint32_t num_buffers, uint32_t *buf_idx, VALUE body, int64_t min_len, int64_t *len)
+{
+    int64_t offset, length;
+    uint32_t pos;
+
+    if (*buf_idx >= num_buffers) {
+        fb_invalid();
+    }
+    pos = elems + (*buf_idx)++ * 16;
+    offset = (int64_t)fb_read(r, pos, 8);
+    length = (int64_t)fb_read(r, pos + 8, 8);
+    if (offset < 0 || length < min_len || offset > RSTRING_LEN(body) || RSTRING_LEN(body) - offset < length) {
+        fb_invalid();
+    }
+    if (len != NULL) {
+        *len = length;
+    }
+    return length > 0 ? RSTRING_PTR(body) + offset : NULL;
+}
+
+static void read_record_batch(arrow_loader_t *ld, const fb_table_t *batch, VALUE body)
+{
+    const fb_reader_t *r = batch->r;
+    int64_t length = (int64_t)fb_get(batch, 0, 8, 0);
+    uint32_t nodes, buffers, num_nodes, num_buffers;
+    uint32_t buf_idx = 0;
+    uint32_t idx;
+
+    if (fb_get_ref(batch, 3) != 0) {
+        rb_raise(rb_eNotImpError, "compressed Arrow record batches are not supported");
+    }
+    if (length < 0 || length > INT32_MAX) {
+        fb_invalid();
+    }
+    num_nodes = fb_get_vector(batch, 1, 16, &nodes);
+    num_buffers = fb_get_vector(batch, 2, 16, &buffers);
+    if (num_nodes != ld->num_cols) {
+        fb_invalid();
+    }
+    for (idx = 0; idx < ld->num_cols; idx++) {
+        load_col_t *col = &ld->cols[idx];
+        int64_t node_len = (int64_t)fb_read(r, nodes + idx * 16, 8);
+        int64_t null_count = (int64_t)fb_read(r, nodes + idx * 16 + 8, 8);
+        int width = load_type_width(col);
+
+        if (node_len != length) {
+            fb_invalid();
+        }
+        col->validity = (const unsigned char *)body_buffer(r, buffers, num_buffers, &buf_idx, body,
+                                                           null_count ? (length + 7) / 8 : 0, NULL);
+        if (null_count == 0) {
+            col->validity = NULL;
+        }
+        if (width < 0) {
+            int64_t data_len;
+
+            col->offsets = (const int32_t *)body_buffer(r, buffers, num_buffers, &buf_idx, body,
+                                                        length > 0 ? (length + 1) * 4 : 0, NULL);
+            col->values = body_buffer(r, buffers, num_buffers, &buf_idx, body, 0, &data_len);
+            if (length > 0) {
+                int64_t row;
+
+                for (row = 0; row <= length; row++) {
+                    if (col->offsets[row] < 0 || col->offsets[row] > data_len
+                        || (row > 0 && col->offsets[row] < col->offsets[row - 1])) {
+                        fb_invalid();
+                    }
+                }
+            }
+        } else {
+            col->values = body_buffer(r, buffers, num_buffers, &buf_idx, body,
+                                      width ? length * width : (length + 7) / 8, NULL);
+        }
+    }
+    if (length > 0) {
+        loader_load_batch(ld, (uint32_t)length);
+    }
+}
+
+VALUE rbdpi_stmt_copy_from_arrow(VALUE self, VALUE conn, VALUE io, VALUE batch_size, VALUE params)
+{
+    arrow_loader_t ld;
+    VALUE first = read_bytes(io, 8, 1);
+    VALUE meta;
+    fb_reader_t r;
+    int64_t body_len;
+    uint8_t header_type;
+    fb_table_t header;
+
+    loader_init(&ld, self, conn, batch_size, params);
+    if (!NIL_P(first) && memcmp(RSTRING_PTR(first), ARROW_MAGIC, 6) == 0) {
+        /* The file format contains the stream format after the magic. */
+        first = Qnil;
+    }
+    meta = read_message(io, &first, &r, &body_len, &header_type, &header);
+    if (NIL_P(meta) || header_type != ARROW_HEADER_SCHEMA) {
+        rb_raise(rb_eArgError, "no Arrow schema message");
+    }
+    read_schema(&ld, &header);
+    if (body_len > 0) {
+        read_bytes(io, (long)body_len, 0);
+    }
+    while (!NIL_P(meta = read_message(io, &first, &r, &body_len, &header_type, &header))) {
+        VALUE body = body_len > 0 ? read_bytes(io, (long)body_len, 0) : rb_str_new(NULL, 0);
+
+        switch (header_type) {
+        case ARROW_HEADER_RECORD_BATCH:
+            read_record_batch(&ld, &header, body);
+            break;
+        case ARROW_HEADER_SCHEMA:
+            fb_invalid();
+        default:
+            rb_raise(rb_eNotImpError, "unsupported Arrow IPC message type %d", header_type);
+        }
+        RB_GC_GUARD(meta);
+        RB_GC_GUARD(body);
+    }
+    return loader_result(&ld);
+}
+
+/*
+ * packed column buffers
+ */
+static const struct {
+    const char *name;
+    load_type_t type;
+    uint32_t width;
+} packed_types[] = {
+    {"int8", LOAD_INT, 1},
+    {"int16", LOAD_INT, 2},
+    {"int32", LOAD_INT, 4},
+    {"int64", LOAD_INT, 8},
+    {"uint8", LOAD_UINT, 1},
+    {"uint16", LOAD_UINT, 2},
+    {"uint32", LOAD_UINT, 4},
+    {"uint64", LOAD_UINT, 8},
+    {"float32", LOAD_FLOAT32, 4},
+    {"float64", LOAD_FLOAT64, 8},
+    {"bool", LOAD_BOOLEAN, 0},
+    {"utf8", LOAD_UTF8, 0},
+    {"binary", LOAD_BINARY, 0},
+    {"timestamp", LOAD_TIMESTAMP, 8},
+    {"date32", LOAD_DATE32, 4},
+};
+
+static VALUE packed_buffer(VALUE spec, const char *key, int required)
+{
+    VALUE val = rb_hash_aref(spec, ID2SYM(rb_intern(key)));
+
+    if (NIL_P(val)) {
+        if (required) {
+            rb_raise(rb_eArgError, "missing :%s", key);
+        }
+        return Qnil;
+    }
+    StringValue(val);
+    return val;
+}
+
+/* columns: {bind_name_or_position => {type:, values:, offsets:, validity:, unit:, tz:}, ...} */
+VALUE rbdpi_stmt_copy_from_columns(VALUE self, VALUE conn, VALUE columns, VALUE batch_size, VALUE params)
+{
+    arrow_loader_t ld;
+    VALUE keys;
+    VALUE num_rows = NIL_P(params) ? Qnil : rb_hash_delete(params, sym_length);
+    long length = NIL_P(num_rows) ? -1 : NUM2LONG(num_rows);
+    uint32_t idx;
+
+    if (!NIL_P(num_rows) && length < 0) {
+        rb_raise(rb_eArgError, "negative length");
+    }
+    loader_init(&ld, self, conn, batch_size, params);
+    Check_Type(columns, T_HASH);
+    keys = rb_funcall(columns, rb_intern("keys"), 0);
+    if (RARRAY_LEN(keys) == 0) {
+        rb_raise(rb_eArgError, "no columns");
+    }
+    loader_alloc_cols(&ld, (uint32_t)RARRAY_LEN(keys));
+    for (idx = 0; idx < ld.num_cols; idx++) {
+        load_col_t *col = &ld.cols[idx];
+        VALUE key = RARRAY_AREF(keys, idx);
+        VALUE spec = rb_hash_aref(columns, key);
+        VALUE type, values, offsets, validity, unit;
+        const char *type_name;
+        long len;
+        size_t i;
+        int width;
+
+        Check_Type(spec, T_HASH);
+        if (!FIXNUM_P(key)) {
+            VALUE name = SYMBOL_P(key) ? rb_sym2str(key) : key;
+            CHK_STR_ENC(name, ld.stmt->enc.enc);
+            col->bind_name = name;
+            rb_ary_push(ld.gc_guard, name);
+        } else if (FIX2LONG(key) != (long)idx + 1) {
+            rb_raise(rb_eArgError, "positions must be 1, 2, 3, ... in order");
+        }
+        type = rb_hash_aref(spec, ID2SYM(rb_intern("type")));
+        type_name = rb_id2name(SYM2ID(type));
+        for (i = 0; i < sizeof(packed_types) / sizeof(packed_types[0]); i++) {
+            if (strcmp(type_name, packed_types[i].name) == 0) {
+                break;
+            }
+        }
+        if (i == sizeof(packed_types) / sizeof(packed_types[0])) {
+            rb_raise(rb_eArgError, "unsupported type :%s", type_name);
+        }
+        col->type = packed_types[i].type;
+        col->width = packed_types[i].width;
+        if (col->type == LOAD_TIMESTAMP) {
+            static const char *const units[] = {"s", "ms", "us", "ns"};
+            int u = 2;
+
+            unit = rb_hash_aref(spec, ID2SYM(rb_intern("unit")));
+            if (!NIL_P(unit)) {
+                const char *unit_name = rb_id2name(SYM2ID(unit));
+
+                for (u = 0; u < 4 && strcmp(unit_name, units[u]) != 0; u++) {
+                }
+                if (u == 4) {
+                    rb_raise(rb_eArgError, "unknown time unit :%s", unit_name);
+                }
+            }
+            col->per_sec = time_unit_per_sec(u);
+            col->tz = RTEST(rb_hash_aref(spec, ID2SYM(rb_intern("tz"))));
+        }
+        values = packed_buffer(spec, "values", 1);
+        validity = packed_buffer(spec, "validity", 0);
+        rb_ary_push(ld.gc_guard, values);
+        col->values = RSTRING_PTR(values);
+        width = load_type_width(col);
+        if (width < 0) {
+            offsets = packed_buffer(spec, "offsets", 1);
+            rb_ary_push(ld.gc_guard, offsets);
+            len = RSTRING_LEN(offsets) / 4 - 1;
+            if (len < 0) {
+                rb_raise(rb_eArgError, "empty offsets");
+            }
+            col->offsets = (const int32_t *)RSTRING_PTR(offsets);
+            if (col->offsets[0] < 0 || col->offsets[len] > RSTRING_LEN(values)) {
+                rb_raise(rb_eArgError, "offsets out of range");
+            }
+            for (i = 0; i < (size_t)len; i++) {
+                if (col->offsets[i + 1] < col->offsets[i]) {
+                    rb_raise(rb_eArgError, "offsets out of range");
+                }
+            }
+        } else if (width == 0) {
+            /* The length of bit-packed values is determined by other columns. */
+            len = -1;
+        } else {
+            len = RSTRING_LEN(values) / width;
+        }
+        if (len >= 0) {
+            if (length >= 0 && length != len) {
+                rb_raise(rb_eArgError, "column lengths differ (%ld and %ld)", length, len);
+            }
+            length = len;
+        }
+        if (!NIL_P(validity)) {
+            rb_ary_push(ld.gc_guard, validity);
+            col->validity = (const unsigned char *)RSTRING_PTR(validity);
+        }
+    }
+    for (idx = 0; idx < ld.num_cols; idx++) {
+        load_col_t *col = &ld.cols[idx];
+        VALUE spec = rb_hash_aref(columns, RARRAY_AREF(keys, idx));
+
+        if (load_type_width(col) == 0) {
+            long len = RSTRING_LEN(rb_hash_aref(spec, ID2SYM(rb_intern("values"))));
+
+            if (length < 0) {
+                /* Padding bits make the number of bit-packed values unknown. */
+                rb_raise(rb_eArgError, "length: is required when all columns are :bool");
+            } else if (len < (length + 7) / 8) {
+                rb_raise(rb_eArgError, "too short values");
+            }
+        }
+        if (col->validity != NULL) {
+            if (RSTRING_LEN(rb_hash_aref(spec, ID2SYM(rb_intern("validity")))) < (length + 7) / 8) {
+                rb_raise(rb_eArgError, "too short validity bitmap");
+            }
+        }
+    }
+    if (length > UINT32_MAX) {
+        rb_raise(rb_eArgError, "too many rows");
+    }
+    if (length > 0) {
+        loader_load_batch(&ld, (uint32_t)length);
+    }
+    return loader_result(&ld);
+}
+
+void Init_rbdpi_arrow(void)
+{
+    writer_keyword_ids[0] = rb_intern("chunk_size");
+    writer_keyword_ids[1] = rb_intern("progress");
+    writer_keyword_ids[2] = rb_intern("number");
+    loader_keyword_ids[0] = rb_intern("max_errors");
+    loader_keyword_ids[1] = rb_intern("commit");
+    loader_keyword_ids[2] = rb_intern("progress");
+
+    sym_arrow_stream = ID2SYM(rb_intern("arrow_stream"));
+    sym_arrow_file = ID2SYM(rb_intern("arrow_file"));
+    sym_text = ID2SYM(rb_intern("text"));
+    sym_float64 = ID2SYM(rb_intern("float64"));
+    sym_length = ID2SYM(rb_intern("length"));
+    id_call = rb_intern("call");
+    id_read = rb_intern("read");
+}
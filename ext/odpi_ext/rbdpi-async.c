@@ -0,0 +1,463 @@
+/*
+ * rbdpi-async.c -- part of ruby-odpi
+ *
+ * URL: https://github.com/kubo/ruby-odpi
+ *
+ * ------------------------------------------------------
+ *
+ * Copyright 2017 Kubo Takehiro <kubo@jiubao.org>
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice, this list of
+ *       conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *       of conditions and the following disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ * or implied, of the authors.
+ *
+ */
+#include "rbdpi.h"
+#include <ruby/thread.h>
+#include <ruby/io.h>
+#include <errno.h>
+#include <string.h>
+#ifdef HAVE_RUBY_FIBER_SCHEDULER_H
+#include <ruby/fiber/scheduler.h>
+#include <ruby/ractor.h>
+#endif
+#ifndef WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#endif
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
+/* Blocking ODPI-C calls are passed to native worker threads only when
+ * the current thread has a fiber scheduler. The calling fiber waits for
+ * a notification descriptor by the scheduler's io_wait, so other fibers
+ * run meanwhile.
+ */
+#if defined(HAVE_RB_FIBER_SCHEDULER_CURRENT) && !defined(WIN32)
+#define USE_WORKER_POOL 1
+#endif
+
+#define DEFAULT_MAX_WORKERS 4
+#define ERROR_MESSAGE_SIZE 3072
+#define ERROR_NAME_SIZE 64
+
+/* dpiErrorInfo copied from a worker thread because ODPI-C keeps
+ * error information per thread. */
+typedef struct {
+    dpiErrorInfo info;
+    char message[ERROR_MESSAGE_SIZE];
+    char encoding[ERROR_NAME_SIZE];
+    char fn_name[ERROR_NAME_SIZE];
+    char action[ERROR_NAME_SIZE];
+    char sql_state[ERROR_NAME_SIZE];
+} async_error_t;
+
+static int max_workers = DEFAULT_MAX_WORKERS;
+
+#ifdef USE_WORKER_POOL
+typedef struct async_job {
+    struct async_job *next;
+    void *(*func)(void *);
+    void *arg;
+    void *result;
+    int done; /* accessed by async_job_done() and async_job_finish() */
+    async_error_t error;
+    int read_fd; /* non-blocking */
+    int write_fd; /* the same as read_fd when eventfd is used */
+    VALUE scheduler;
+    VALUE io;
+} async_job_t;
+
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static async_job_t *queue_head;
+static async_job_t **queue_tail = &queue_head;
+static int num_workers;
+static int num_idle_workers;
+
+/* The error of the last failed call, which rbdpi_async_take_error() returns
+ * to the Ruby thread which made the call. One per Ractor. */
+typedef struct {
+    async_error_t error;
+    VALUE thread;
+} last_error_t;
+
+static void last_error_mark(void *ptr)
+{
+    rb_gc_mark(((last_error_t *)ptr)->thread);
+}
+
+static const struct rb_ractor_local_storage_type last_error_type = {
+    last_error_mark, ruby_xfree,
+};
+
+static rb_ractor_local_key_t last_error_key;
+
+static last_error_t *get_last_error(int create)
+{
+    last_error_t *last_error = rb_ractor_local_storage_ptr(last_error_key);
+
+    if (last_error == NULL && create) {
+        last_error = RB_ZALLOC(last_error_t);
+        last_error->thread = Qnil;
+        rb_ractor_local_storage_ptr_set(last_error_key, last_error);
+    }
+    return last_error;
+}
+
+static void copy_error_str(char *buf, const char *str)
+{
+    if (str != NULL) {
+        strncpy(buf, str, ERROR_NAME_SIZE - 1);
+        buf[ERROR_NAME_SIZE - 1] = '\0';
+    }
+}
+
+/* Points the fields of err->info to the buffers in err. */
+static void async_error_relocate(async_error_t *err)
+{
+    dpiErrorInfo *info = &err->info;
+
+    info->message = err->message;
+    info->encoding = info->encoding ? err->encoding : NULL;
+    info->fnName = info->fnName ? err->fn_name : NULL;
+    info->action = info->action ? err->action : NULL;
+    info->sqlState = info->sqlState ? err->sql_state : NULL;
+}
+
+static void async_error_save(async_error_t *err)
+{
+    dpiErrorInfo *info = &err->info;
+
+    dpiContext_getError(rbdpi_g_context, info);
+    if (info->messageLength > ERROR_MESSAGE_SIZE) {
+        info->messageLength = ERROR_MESSAGE_SIZE;
+    }
+    memcpy(err->message, info->message, info->messageLength);
+    copy_error_str(err->encoding, info->encoding);
+    copy_error_str(err->fn_name, info->fnName);
+    copy_error_str(err->action, info->action);
+    copy_error_str(err->sql_state, info->sqlState);
+    async_error_relocate(err);
+}
+
+static void async_job_notify(async_job_t *job)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+    uint64_t val = 1;
+#else
+    char val = 0;
+#endif
+    int rv;
+
+    do {
+        rv = write(job->write_fd, &val, sizeof(val));
+    } while (rv == -1 && errno == EINTR);
+}
+
+/* Returns nonzero when the notification was read. */
+static int async_job_drain(async_job_t *job)
+{
+    char dummy[64];
+    int notified = 0;
+    int rv;
+
+    do {
+        rv = read(job->read_fd, dummy, sizeof(dummy));
+        if (rv > 0) {
+            notified = 1;
+        }
+    } while (rv > 0 || (rv == -1 && errno == EINTR));
+    return notified;
+}
+
+static int async_job_done(async_job_t *job)
+{
+    return __atomic_load_n(&job->done, __ATOMIC_ACQUIRE);
+}
+
+/* The worker notifies before it sets done, which is its last access to
+ * job because the waiter may free job as soon as it sees done. */
+static void async_job_finish(async_job_t *job)
+{
+    async_job_notify(job);
+    __atomic_store_n(&job->done, 1, __ATOMIC_RELEASE);
+}
+
+/* Waits for the worker between the notification and setting done. */
+static void async_job_wait_finish(async_job_t *job)
+{
+    while (!async_job_done(job)) {
+        sched_yield();
+    }
+}
+
+static void *worker_main(void *dummy)
+{
+    async_job_t *job;
+
+    pthread_mutex_lock(&queue_mutex);
+    for (;;) {
+        while (queue_head == NULL) {
+            num_idle_workers++;
+            pthread_cond_wait(&queue_cond, &queue_mutex);
+            num_idle_workers--;
+        }
+        job = queue_head;
+        queue_head = job->next;
+        if (queue_head == NULL) {
+            queue_tail = &queue_head;
+        }
+        pthread_mutex_unlock(&queue_mutex);
+
+        job->result = job->func(job->arg);
+        if ((int)(size_t)job->result == DPI_FAILURE) {
+            async_error_save(&job->error);
+        }
+        async_job_finish(job);
+
+        pthread_mutex_lock(&queue_mutex);
+    }
+    return NULL;
+}
+
+/* Returns zero when no worker is available. */
+static int async_job_submit(async_job_t *job)
+{
+    pthread_mutex_lock(&queue_mutex);
+    if (num_idle_workers == 0 && num_workers < max_workers) {
+        pthread_attr_t attr;
+        pthread_t thread;
+        int rv;
+
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        rv = pthread_create(&thread, &attr, worker_main, NULL);
+        pthread_attr_destroy(&attr);
+        if (rv == 0) {
+            num_workers++;
+        } else if (num_workers == 0) {
+            pthread_mutex_unlock(&queue_mutex);
+            return 0;
+        }
+    }
+    job->next = NULL;
+    *queue_tail = job;
+    queue_tail = &job->next;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_mutex);
+    return 1;
+}
+
+static int async_job_open(async_job_t *job)
+{
+#ifdef HAVE_SYS_EVENTFD_H
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (fd == -1) {
+        return 0;
+    }
+    job->read_fd = job->write_fd = fd;
+#else
+    int fds[2];
+
+    if (pipe(fds) != 0) {
+        return 0;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL, 0) | O_NONBLOCK);
+    job->read_fd = fds[0];
+    job->write_fd = fds[1];
+#endif
+    return 1;
+}
+
+static void async_job_close(async_job_t *job)
+{
+    if (job->write_fd != job->read_fd) {
+        close(job->write_fd);
+    }
+    if (!NIL_P(job->io)) {
+        rb_io_close(job->io);
+    } else {
+        close(job->read_fd);
+    }
+}
+
+static VALUE async_job_wait(VALUE arg)
+{
+    async_job_t *job = (async_job_t *)arg;
+
+    job->io = rb_io_fdopen(job->read_fd, O_RDONLY, NULL);
+    while (!async_job_done(job)) {
+        if (async_job_drain(job)) {
+            async_job_wait_finish(job);
+            break;
+        }
+        rb_fiber_scheduler_io_wait(job->scheduler, job->io, RB_INT2NUM(RUBY_IO_READABLE), Qnil);
+    }
+    return Qnil;
+}
+
+static void *async_job_wait_done(void *arg)
+{
+    async_job_t *job = (async_job_t *)arg;
+    int flags = fcntl(job->read_fd, F_GETFL, 0);
+
+    fcntl(job->read_fd, F_SETFL, flags & ~O_NONBLOCK);
+    while (!async_job_done(job)) {
+        char dummy[8];
+        int rv = read(job->read_fd, dummy, sizeof(dummy));
+
+        if (rv > 0) {
+            async_job_wait_finish(job);
+        } else if (rv == -1 && errno != EINTR) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static int call_in_worker(VALUE scheduler, void *(*func)(void *), void *arg,
+                          rb_unblock_function_t *ubf, void *ubf_arg, void **result)
+{
+    async_job_t job = {0,};
+    int state = 0;
+
+    job.func = func;
+    job.arg = arg;
+    job.scheduler = scheduler;
+    job.io = Qnil;
+    if (!async_job_open(&job)) {
+        return 0;
+    }
+    if (!async_job_submit(&job)) {
+        async_job_close(&job);
+        return 0;
+    }
+    rb_protect(async_job_wait, (VALUE)&job, &state);
+    if (state) {
+        /* The fiber was interrupted. Break the call and wait for the
+         * worker because job is on the stack. */
+        if (ubf != NULL) {
+            ubf(ubf_arg);
+        }
+        while (!async_job_done(&job)) {
+            rb_thread_call_without_gvl(async_job_wait_done, &job, NULL, NULL);
+        }
+    }
+    async_job_close(&job);
+    RB_GC_GUARD(job.io);
+    if (state) {
+        rb_jump_tag(state);
+    }
+    if ((int)(size_t)job.result == DPI_FAILURE) {
+        last_error_t *last_error = get_last_error(1);
+
+        last_error->error = job.error;
+        async_error_relocate(&last_error->error);
+        last_error->thread = rb_thread_current();
+    }
+    *result = job.result;
+    return 1;
+}
+#endif
+
+/* Returns the error of the last call failed in a worker thread on behalf
+ * of the current thread, or NULL. */
+const dpiErrorInfo *rbdpi_async_take_error(void)
+{
+#ifdef USE_WORKER_POOL
+    last_error_t *last_error = get_last_error(0);
+
+    if (last_error != NULL && last_error->thread == rb_thread_current()) {
+        last_error->thread = Qnil;
+        return &last_error->error.info;
+    }
+#endif
+    return NULL;
+}
+
+void *rbdpi_call_without_gvl(void *(*func)(void *), void *arg, rb_unblock_function_t *ubf, void *ubf_arg)
+{
+#ifdef USE_WORKER_POOL
+    last_error_t *last_error = get_last_error(0);
+
+    if (last_error != NULL) {
+        last_error->thread = Qnil;
+    }
+    if (max_workers > 0) {
+        VALUE scheduler = rb_fiber_scheduler_current();
+        void *result;
+
+        if (!NIL_P(scheduler) && call_in_worker(scheduler, func, arg, ubf, ubf_arg, &result)) {
+            return result;
+        }
+    }
+#endif
+    return rb_thread_call_without_gvl(func, arg, ubf, ubf_arg);
+}
+
+#ifdef USE_WORKER_POOL
+/* Worker threads don't exist in a forked child process. Jobs queued by
+ * other threads of the parent are dropped as well. */
+static void async_atfork_child(void)
+{
+    pthread_mutex_init(&queue_mutex, NULL);
+    pthread_cond_init(&queue_cond, NULL);
+    queue_head = NULL;
+    queue_tail = &queue_head;
+    num_workers = 0;
+    num_idle_workers = 0;
+}
+#endif
+
+static VALUE get_max_async_workers(VALUE module)
+{
+    return INT2FIX(max_workers);
+}
+
+/* Already started workers are kept when it is decreased. */
+static VALUE set_max_async_workers(VALUE module, VALUE num)
+{
+    int n = NUM2INT(num);
+
+    if (n < 0) {
+        rb_raise(rb_eArgError, "negative number of workers: %d", n);
+    }
+    max_workers = n;
+    return num;
+}
+
+void Init_rbdpi_async(VALUE mODPI)
+{
+#ifdef USE_WORKER_POOL
+    last_error_key = rb_ractor_local_storage_ptr_newkey(&last_error_type);
+    pthread_atfork(NULL, NULL, async_atfork_child);
+#endif
+    rb_define_module_function(mODPI, "max_async_workers", get_max_async_workers, 0);
+    rb_define_module_function(mODPI, "max_async_workers=", set_max_async_workers, 1);
+}
@@ -48,7 +48,9 @@ static void conn_free(void *arg)
 {
     conn_t *conn = (conn_t *)arg;
 
-    if (conn->handle != NULL) {
+    /* A handle inherited from the parent process is abandoned because
+     * releasing it could send messages on the parent's socket. */
+    if (conn->handle != NULL && conn->pid == rbdpi_pid) {
         dpiConn_release(conn->handle);
     }
     xfree(arg);
@@ -89,11 +91,12 @@ static VALUE conn_initialize(VALUE self, VALUE username, VALUE password, VALUE d
     if (NIL_P(username) && NIL_P(password)) {
         create_params.externalAuth = 1;
     }
-    CHK(dpiConn_create_without_gvl(rbdpi_g_context,
+    CHK(dpiConn_create_without_gvl(rbdpi_context(),
                                    NSTR_PTR(username), NSTR_LEN(username),
                                    NSTR_PTR(password), NSTR_LEN(password),
                                    NSTR_PTR(database), NSTR_LEN(database),
                                    &common_params, &create_params, &conn->handle));
+    conn->pid = rbdpi_pid;
     RB_GC_GUARD(username);
     RB_GC_GUARD(password);
     RB_GC_GUARD(database);
@@ -266,7 +269,8 @@ static VALUE conn_get_ltxid(VALUE self)
     uint32_t len;
 
     CHK(dpiConn_getLTXID(conn->handle, &val, &len));
-    return NSTR_NEW_ENC(val, len, conn->enc.enc);
+    /* LTXID is opaque binary data. */
+    return len ? rb_str_new(val, len) : Qnil;
 }
 
 static VALUE conn_get_object_type(VALUE self, VALUE name)
@@ -311,6 +315,26 @@ static VALUE conn_get_stmt_cache_size(VALUE self)
     return ULONG2NUM(size);
 }
 
+/* the tag of the session acquired from a pool */
+static VALUE conn_get_tag(VALUE self)
+{
+    return rbdpi_to_conn(self)->tag;
+}
+
+/* counters of execute and fetch calls which released the GVL */
+static VALUE conn_get_stats(VALUE self)
+{
+    conn_t *conn = rbdpi_to_conn(self);
+    VALUE hash = rb_hash_new();
+
+    rb_hash_aset(hash, ID2SYM(rb_intern("executes")), ULL2NUM(conn->stats.executes));
+    rb_hash_aset(hash, ID2SYM(rb_intern("execute_time")), DBL2NUM(conn->stats.execute_ns / 1e9));
+    rb_hash_aset(hash, ID2SYM(rb_intern("fetches")), ULL2NUM(conn->stats.fetches));
+    rb_hash_aset(hash, ID2SYM(rb_intern("fetch_time")), DBL2NUM(conn->stats.fetch_ns / 1e9));
+    rb_hash_aset(hash, ID2SYM(rb_intern("fetched_rows")), ULL2NUM(conn->stats.fetched_rows));
+    return hash;
+}
+
 static VALUE conn_new_deq_options(VALUE self)
 {
     conn_t *conn = rbdpi_to_conn(self);
@@ -370,7 +394,7 @@ static VALUE conn_ping(VALUE self)
 {
     conn_t *conn = rbdpi_to_conn(self);
 
-    CHK(dpiConn_ping(conn->handle));
+    CHK(dpiConn_ping_without_gvl(conn->handle));
     return self;
 }
 
@@ -529,6 +553,8 @@ void Init_rbdpi_conn(VALUE mDpi)
     rb_define_method(cConn, "server_release", conn_get_server_release, 0);
     rb_define_method(cConn, "server_version", conn_get_server_version, 0);
     rb_define_method(cConn, "stmt_cache_size", conn_get_stmt_cache_size, 0);
+    rb_define_method(cConn, "tag", conn_get_tag, 0);
+    rb_define_method(cConn, "stats", conn_get_stats, 0);
     rb_define_method(cConn, "new_deq_options", conn_new_deq_options, 0);
     rb_define_method(cConn, "new_enq_options", conn_new_enq_options, 0);
     rb_define_method(cConn, "new_msg_props", conn_new_msg_props, 0);
@@ -558,6 +584,7 @@ VALUE rbdpi_from_conn(dpiConn *handle, dpiConnCreateParams *params, rbdpi_enc_t
 
     conn->handle = handle;
     conn->enc = *enc;
+    conn->pid = rbdpi_pid;
     if (params->outTag != NULL && params->outTagLength != 0) {
         conn->tag = rb_external_str_new_with_enc(params->outTag, params->outTagLength, enc->enc);
     } else {
@@ -573,5 +600,8 @@ conn_t *rbdpi_to_conn(VALUE obj)
     if (conn->handle == NULL) {
         rb_raise(rb_eRuntimeError, "%s isn't initialized", rb_obj_classname(obj));
     }
+    if (conn->pid != rbdpi_pid) {
+        rb_raise(rb_eRuntimeError, "%s was created by the parent process", rb_obj_classname(obj));
+    }
     return conn;
 }
@@ -0,0 +1,913 @@
+/*
+ * rbdpi-copy-from.c -- part of ruby-odpi
+ *
+ * URL: https://github.com/kubo/ruby-odpi
+ *
+ * ------------------------------------------------------
+ *
+ * Copyright 2017 Kubo Takehiro <kubo@jiubao.org>
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice, this list of
+ *       conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *       of conditions and the following disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ * or implied, of the authors.
+ *
+ */
+#include "rbdpi.h"
+#include <stdlib.h>
+#include <errno.h>
+
+#define DEFAULT_CHUNK_SIZE 65536
+#define NUM_BUF_SIZE 64
+
+static VALUE sym_csv;
+static VALUE sym_tsv;
+static ID id_call;
+static ID id_read;
+static ID copy_from_keyword_ids[10];
+
+typedef struct {
+    const var_t *var;
+    dpiData *data;
+    int nchar_conv; /* NCHAR column whose encoding differs from the input */
+} load_col_t;
+
+typedef struct {
+    stmt_t *stmt;
+    conn_t *conn;
+    VALUE io;
+    VALUE scratch;
+    VALUE raw_buf;
+    VALUE errors;
+    VALUE gc_guard;
+    VALUE record_error;
+    rb_encoding *enc;
+    long chunk_size;
+    uint32_t num_cols;
+    load_col_t *cols;
+    dpiExecMode exec_mode;
+    long max_errors;
+    /* batch */
+    uint32_t batch_size;
+    uint32_t batch_rows;
+    uint64_t *record_nos; /* record number of each row in the batch */
+    /* counters */
+    uint64_t record_no;
+    uint64_t num_rows;
+    uint32_t field_idx;
+    int skip_record;
+    VALUE progress;
+    /* format */
+    int tsv;
+    int headers;
+    char quote_char;
+    const char *col_sep;
+    long col_sep_len;
+    const char *null_value;
+    long null_value_len;
+    const char *date_format;
+    const char *timestamp_format;
+} copy_from_t;
+
+/*
+ * value conversion
+ */
+static int parse_digits(const char **p, const char *end, int min_width, int max_width, int *out)
+{
+    const char *s = *p;
+    int val = 0;
+    int n = 0;
+
+    while (s < end && n < max_width && '0' <= *s && *s <= '9') {
+        val = val * 10 + (*s - '0');
+        s++;
+        n++;
+    }
+    if (n < min_width) {
+        return 0;
+    }
+    *p = s;
+    *out = val;
+    return 1;
+}
+
+static int parse_fraction(const char **p, const char *end, uint32_t *out)
+{
+    const char *s = *p;
+    uint32_t val = 0;
+    int n = 0;
+
+    while (s < end && '0' <= *s && *s <= '9') {
+        if (n < 9) {
+            val = val * 10 + (*s - '0');
+        }
+        s++;
+        n++;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    for (; n < 9; n++) {
+        val *= 10;
+    }
+    *p = s;
+    *out = val;
+    return 1;
+}
+
+static int parse_tz_offset(const char **p, const char *end, int colon, dpiTimestamp *ts)
+{
+    const char *s = *p;
+    int sign, hour, minute;
+
+    if (s < end && *s == 'Z') {
+        ts->tzHourOffset = 0;
+        ts->tzMinuteOffset = 0;
+        *p = s + 1;
+        return 1;
+    }
+    if (s == end || (*s != '+' && *s != '-')) {
+        return 0;
+    }
+    sign = (*s++ == '-') ? -1 : 1;
+    if (!parse_digits(&s, end, 2, 2, &hour)) {
+        return 0;
+    }
+    if (s < end && *s == ':') {
+        s++;
+    } else if (colon) {
+        return 0;
+    }
+    if (!parse_digits(&s, end, 2, 2, &minute) || hour > 14 || minute > 59) {
+        return 0;
+    }
+    ts->tzHourOffset = sign * hour;
+    ts->tzMinuteOffset = sign * minute;
+    *p = s;
+    return 1;
+}
+
+static int check_timestamp(const dpiTimestamp *ts)
+{
+    return 1 <= ts->month && ts->month <= 12 && 1 <= ts->day && ts->day <= 31
+        && ts->hour < 24 && ts->minute < 60 && ts->second < 60;
+}
+
+/* YYYY-MM-DD[( |T)HH:MM[:SS[.F...]]][ ][Z|+HH:MM|+HHMM] */
+static int parse_iso_timestamp(const char *s, const char *end, dpiTimestamp *ts)
+{
+    int neg = 0;
+    int year, month, day, hour = 0, minute = 0, second = 0;
+
+    memset(ts, 0, sizeof(*ts));
+    if (s < end && *s == '-') {
+        neg = 1;
+        s++;
+    }
+    if (!parse_digits(&s, end, 4, 4, &year) || s == end || *s++ != '-'
+        || !parse_digits(&s, end, 2, 2, &month) || s == end || *s++ != '-'
+        || !parse_digits(&s, end, 2, 2, &day)) {
+        return 0;
+    }
+    if (s < end && (*s == ' ' || *s == 'T') && s + 1 < end && '0' <= s[1] && s[1] <= '9') {
+        s++;
+        if (!parse_digits(&s, end, 2, 2, &hour) || s == end || *s++ != ':'
+            || !parse_digits(&s, end, 2, 2, &minute)) {
+            return 0;
+        }
+        if (s < end && *s == ':') {
+            s++;
+            if (!parse_digits(&s, end, 2, 2, &second)) {
+                return 0;
+            }
+            if (s < end && *s == '.') {
+                s++;
+                if (!parse_fraction(&s, end, &ts->fsecond)) {
+                    return 0;
+                }
+            }
+        }
+    }
+    if (s < end && *s == ' ') {
+        s++;
+    }
+    if (s < end && !parse_tz_offset(&s, end, 0, ts)) {
+        return 0;
+    }
+    ts->year = neg ? -year : year;
+    ts->month = month;
+    ts->day = day;
+    ts->hour = hour;
+    ts->minute = minute;
+    ts->second = second;
+    return s == end && check_timestamp(ts);
+}
+
+/* The counterpart of format_timestamp() in rbdpi-copy-to.c */
+static int parse_timestamp(const char *s, const char *end, const char *fmt, dpiTimestamp *ts)
+{
+    int val;
+
+    if (fmt == NULL) {
+        return parse_iso_timestamp(s, end, ts);
+    }
+    memset(ts, 0, sizeof(*ts));
+    ts->month = 1;
+    ts->day = 1;
+    while (*fmt != '\0') {
+        if (*fmt != '%' || fmt[1] == '%') {
+            if (s == end || *s != *fmt) {
+                return 0;
+            }
+            s++;
+            fmt += (*fmt == '%') ? 2 : 1;
+            continue;
+        }
+        fmt++;
+        if ('1' <= *fmt && *fmt <= '9' && fmt[1] == 'N') {
+            fmt++;
+        }
+        switch (*fmt) {
+        case 'Y':
+            {
+                int neg = 0;
+
+                if (s < end && *s == '-') {
+                    neg = 1;
+                    s++;
+                }
+                if (!parse_digits(&s, end, 1, 4, &val)) {
+                    return 0;
+                }
+                ts->year = neg ? -val : val;
+            }
+            break;
+        case 'm':
+            if (!parse_digits(&s, end, 1, 2, &val)) {
+                return 0;
+            }
+            ts->month = val;
+            break;
+        case 'd':
+            if (!parse_digits(&s, end, 1, 2, &val)) {
+                return 0;
+            }
+            ts->day = val;
+            break;
+        case 'H':
+            if (!parse_digits(&s, end, 1, 2, &val)) {
+                return 0;
+            }
+            ts->hour = val;
+            break;
+        case 'M':
+            if (!parse_digits(&s, end, 1, 2, &val)) {
+                return 0;
+            }
+            ts->minute = val;
+            break;
+        case 'S':
+            if (!parse_digits(&s, end, 1, 2, &val)) {
+                return 0;
+            }
+            ts->second = val;
+            break;
+        case 'L':
+        case 'N':
+            if (!parse_fraction(&s, end, &ts->fsecond)) {
+                return 0;
+            }
+            break;
+        case ':':
+            if (fmt[1] != 'z' || !parse_tz_offset(&s, end, 1, ts)) {
+                return 0;
+            }
+            fmt++;
+            break;
+        case 'z':
+            if (!parse_tz_offset(&s, end, 0, ts)) {
+                return 0;
+            }
+            break;
+        default:
+            return 0;
+        }
+        fmt++;
+    }
+    return s == end && check_timestamp(ts);
+}
+
+static int hex_value(char c)
+{
+    if ('0' <= c && c <= '9') {
+        return c - '0';
+    } else if ('A' <= c && c <= 'F') {
+        return c - 'A' + 10;
+    } else if ('a' <= c && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+static void set_record_error(copy_from_t *ctx, const char *fmt, uint32_t pos)
+{
+    if (NIL_P(ctx->record_error)) {
+        ctx->record_error = rb_exc_new_str(rb_eArgError, rb_sprintf(fmt, pos));
+    }
+}
+
+static int check_length(copy_from_t *ctx, const load_col_t *col, long len, uint32_t pos)
+{
+    if (col->var->max_bytes != 0 && (unsigned long)len > col->var->max_bytes) {
+        set_record_error(ctx, "value too long at field %u", pos);
+        return 0;
+    }
+    return 1;
+}
+
+static VALUE nchar_encode(VALUE arg)
+{
+    VALUE *args = (VALUE *)arg;
+
+    return rb_str_encode(args[0], args[1], 0, Qnil);
+}
+
+static VALUE nchar_encode_failed(VALUE arg, VALUE exc)
+{
+    return Qnil;
+}
+
+static void set_field(copy_from_t *ctx, const char *ptr, long len, int quoted)
+{
+    load_col_t *col;
+    dpiData *data;
+    uint32_t row = ctx->batch_rows;
+    uint32_t pos;
+
+    if (ctx->skip_record || !NIL_P(ctx->record_error)) {
+        ctx->field_idx++;
+        return;
+    }
+    if (ctx->field_idx >= ctx->num_cols) {
+        ctx->record_error = rb_exc_new_str(rb_eArgError,
+                                           rb_sprintf("too many fields (expected %u)", ctx->num_cols));
+        return;
+    }
+    pos = ctx->field_idx + 1;
+    col = &ctx->cols[ctx->field_idx++];
+    data = &col->data[row];
+    if (len == 0 || (!quoted && len == ctx->null_value_len && memcmp(ptr, ctx->null_value, len) == 0)) {
+        data->isNull = 1;
+        return;
+    }
+    switch (col->var->native_type) {
+    case DPI_NATIVE_TYPE_BYTES:
+        switch (col->var->oracle_type) {
+        case DPI_ORACLE_TYPE_RAW:
+        case DPI_ORACLE_TYPE_LONG_RAW:
+            {
+                char *raw;
+                long idx;
+
+                if (len % 2 != 0) {
+                    set_record_error(ctx, "invalid hex string at field %u", pos);
+                    return;
+                }
+                if (!check_length(ctx, col, len / 2, pos)) {
+                    return;
+                }
+                /* ptr may point into scratch. */
+                rb_str_resize(ctx->raw_buf, len / 2);
+                raw = RSTRING_PTR(ctx->raw_buf);
+                for (idx = 0; idx < len; idx += 2) {
+                    int hi = hex_value(ptr[idx]);
+                    int lo = hex_value(ptr[idx + 1]);
+
+                    if (hi < 0 || lo < 0) {
+                        set_record_error(ctx, "invalid hex string at field %u", pos);
+                        return;
+                    }
+                    raw[idx / 2] = (char)((hi << 4) | lo);
+                }
+                CHK(dpiVar_setFromBytes(col->var->handle, row, raw, len / 2));
+                return;
+            }
+        }
+        if (col->nchar_conv) {
+            VALUE args[2];
+            VALUE str;
+
+            args[0] = rb_enc_str_new(ptr, len, ctx->enc);
+            args[1] = rb_enc_from_encoding((rb_encoding *)col->var->enc.nenc);
+            str = rb_rescue2(nchar_encode, (VALUE)args, nchar_encode_failed, Qnil, rb_eEncodingError, (VALUE)0);
+            if (NIL_P(str)) {
+                set_record_error(ctx, "invalid or unconvertible character at field %u", pos);
+                return;
+            }
+            if (!check_length(ctx, col, RSTRING_LEN(str), pos)) {
+                return;
+            }
+            CHK(dpiVar_setFromBytes(col->var->handle, row, RSTRING_PTR(str), RSTRING_LEN(str)));
+            RB_GC_GUARD(args[0]);
+            RB_GC_GUARD(str);
+            return;
+        }
+        if (!check_length(ctx, col, len, pos)) {
+            return;
+        }
+        CHK(dpiVar_setFromBytes(col->var->handle, row, ptr, len));
+        return;
+    case DPI_NATIVE_TYPE_INT64:
+    case DPI_NATIVE_TYPE_UINT64:
+    case DPI_NATIVE_TYPE_FLOAT:
+    case DPI_NATIVE_TYPE_DOUBLE:
+        {
+            char buf[NUM_BUF_SIZE];
+            char *endp;
+
+            if (len >= NUM_BUF_SIZE) {
+                set_record_error(ctx, "invalid number at field %u", pos);
+                return;
+            }
+            memcpy(buf, ptr, len);
+            buf[len] = '\0';
+            errno = 0;
+            switch (col->var->native_type) {
+            case DPI_NATIVE_TYPE_INT64:
+                data->value.asInt64 = strtoll(buf, &endp, 10);
+                break;
+            case DPI_NATIVE_TYPE_UINT64:
+                data->value.asUint64 = strtoull(buf, &endp, 10);
+                break;
+            case DPI_NATIVE_TYPE_FLOAT:
+                data->value.asFloat = strtof(buf, &endp);
+                break;
+            default:
+                data->value.asDouble = strtod(buf, &endp);
+            }
+            if (errno != 0 || endp != buf + len) {
+                set_record_error(ctx, "invalid number at field %u", pos);
+                return;
+            }
+        }
+        break;
+    case DPI_NATIVE_TYPE_TIMESTAMP:
+        {
+            const char *fmt = (col->var->oracle_type == DPI_ORACLE_TYPE_DATE) ? ctx->date_format : ctx->timestamp_format;
+
+            if (!parse_timestamp(ptr, ptr + len, fmt, &data->value.asTimestamp)) {
+                set_record_error(ctx, "invalid timestamp at field %u", pos);
+                return;
+            }
+        }
+        break;
+    case DPI_NATIVE_TYPE_BOOLEAN:
+        if (len == 4 && memcmp(ptr, "true", 4) == 0) {
+            data->value.asBoolean = 1;
+        } else if (len == 5 && memcmp(ptr, "false", 5) == 0) {
+            data->value.asBoolean = 0;
+        } else {
+            set_record_error(ctx, "invalid boolean at field %u", pos);
+            return;
+        }
+        break;
+    default:
+        rb_raise(rb_eRuntimeError, "unknown native type %d", col->var->native_type);
+    }
+    data->isNull = 0;
+}
+
+/*
+ * batch execution
+ */
+static void add_error(copy_from_t *ctx, uint64_t record_no, VALUE exc)
+{
+    rb_ary_push(ctx->errors, rb_ary_new_from_args(2, ULL2NUM(record_no), exc));
+    if (ctx->max_errors >= 0 && RARRAY_LEN(ctx->errors) > ctx->max_errors) {
+        rb_exc_raise(exc);
+    }
+}
+
+static void execute_batch(copy_from_t *ctx)
+{
+    uint32_t count, idx;
+
+    CHK(dpiStmt_executeMany_without_gvl(ctx->conn->handle, ctx->stmt->handle,
+                                        ctx->exec_mode, ctx->batch_rows));
+    CHK(dpiStmt_getBatchErrorCount(ctx->stmt->handle, &count));
+    if (count > 0) {
+        VALUE tmp = rb_str_tmp_new(count * sizeof(dpiErrorInfo));
+        dpiErrorInfo *errors = (dpiErrorInfo *)RSTRING_PTR(tmp);
+
+        CHK(dpiStmt_getBatchErrors(ctx->stmt->handle, count, errors));
+        for (idx = 0; idx < count; idx++) {
+            /* offset is the row offset in the batch. */
+            add_error(ctx, ctx->record_nos[errors[idx].offset], rbdpi_from_dpiErrorInfo(&errors[idx]));
+        }
+        RB_GC_GUARD(tmp);
+    }
+    ctx->num_rows += ctx->batch_rows - count;
+    ctx->batch_rows = 0;
+    if (!NIL_P(ctx->progress)) {
+        rb_funcall(ctx->progress, id_call, 1, ULL2NUM(ctx->num_rows));
+    }
+}
+
+/*
+ * CSV and TSV parser
+ */
+static void begin_record(copy_from_t *ctx)
+{
+    ctx->field_idx = 0;
+    ctx->record_error = Qnil;
+}
+
+static void end_record(copy_from_t *ctx)
+{
+    if (ctx->skip_record) {
+        ctx->skip_record = 0;
+        return;
+    }
+    ctx->record_no++;
+    if (NIL_P(ctx->record_error) && ctx->field_idx < ctx->num_cols) {
+        ctx->record_error = rb_exc_new_str(rb_eArgError,
+                                           rb_sprintf("too few fields (expected %u but %u)",
+                                                      ctx->num_cols, ctx->field_idx));
+    }
+    if (!NIL_P(ctx->record_error)) {
+        add_error(ctx, ctx->record_no, ctx->record_error);
+        return;
+    }
+    ctx->record_nos[ctx->batch_rows++] = ctx->record_no;
+    if (ctx->batch_rows == ctx->batch_size) {
+        execute_batch(ctx);
+    }
+}
+
+static inline int at_col_sep(const copy_from_t *ctx, const char *p, const char *end)
+{
+    return *p == ctx->col_sep[0] && end - p >= ctx->col_sep_len
+        && memcmp(p, ctx->col_sep, ctx->col_sep_len) == 0;
+}
+
+/* Parses a quoted CSV field starting after the opening quote.
+ * Returns the position after the closing quote or NULL when more data is required.
+ */
+static const char *parse_quoted(copy_from_t *ctx, const char *p, const char *end, int eof, const char **fptr, long *flen)
+{
+    const char *seg = p;
+    int copied = 0;
+
+    while (1) {
+        const char *q = memchr(p, ctx->quote_char, end - p);
+
+        if (q == NULL) {
+            if (!eof) {
+                return NULL;
+            }
+            set_record_error(ctx, "unclosed quote at field %u", ctx->field_idx + 1);
+            *fptr = seg;
+            *flen = 0;
+            return end;
+        }
+        if (q + 1 == end && !eof) {
+            return NULL;
+        }
+        if (q + 1 < end && q[1] == ctx->quote_char) {
+            /* doubled quote */
+            if (!copied) {
+                rb_str_set_len(ctx->scratch, 0);
+                copied = 1;
+            }
+            rb_str_cat(ctx->scratch, seg, q + 1 - seg);
+            p = seg = q + 2;
+            continue;
+        }
+        if (copied) {
+            rb_str_cat(ctx->scratch, seg, q - seg);
+            *fptr = RSTRING_PTR(ctx->scratch);
+            *flen = RSTRING_LEN(ctx->scratch);
+        } else {
+            *fptr = seg;
+            *flen = q - seg;
+        }
+        return q + 1;
+    }
+}
+
+static void tsv_unescape(copy_from_t *ctx, const char **fptr, long *flen)
+{
+    const char *p = *fptr;
+    const char *end = p + *flen;
+    char *out;
+    long n = 0;
+
+    rb_str_resize(ctx->scratch, *flen);
+    out = RSTRING_PTR(ctx->scratch);
+    while (p < end) {
+        if (*p == '\\' && p + 1 < end) {
+            p++;
+            switch (*p) {
+            case 't':
+                out[n++] = '\t';
+                break;
+            case 'n':
+                out[n++] = '\n';
+                break;
+            case 'r':
+                out[n++] = '\r';
+                break;
+            default:
+                out[n++] = *p;
+            }
+            p++;
+        } else {
+            out[n++] = *p++;
+        }
+    }
+    *fptr = out;
+    *flen = n;
+}
+
+/* Parses one record. Returns the position of the next record or
+ * NULL when more data is required to complete the record.
+ */
+static const char *parse_record(copy_from_t *ctx, const char *p, const char *end, int eof)
+{
+    if (*p == '\n' || *p == '\r') {
+        /* skip an empty line */
+        if (*p == '\r' && p + 1 == end && !eof) {
+            return NULL;
+        }
+        return p + ((p[0] == '\r' && p + 1 < end && p[1] == '\n') ? 2 : 1);
+    }
+    begin_record(ctx);
+    while (1) {
+        const char *fptr;
+        long flen;
+        int quoted = 0;
+
+        if (!ctx->tsv && p < end && *p == ctx->quote_char) {
+            p = parse_quoted(ctx, p + 1, end, eof, &fptr, &flen);
+            if (p == NULL) {
+                return NULL;
+            }
+            quoted = 1;
+            if (p < end && *p != '\n' && *p != '\r' && !at_col_sep(ctx, p, end)) {
+                set_record_error(ctx, "unexpected character after quoted field %u", ctx->field_idx + 1);
+                while (p < end && *p != '\n' && *p != '\r' && !at_col_sep(ctx, p, end)) {
+                    p++;
+                }
+            }
+        } else {
+            fptr = p;
+            while (p < end && *p != '\n' && *p != '\r' && !at_col_sep(ctx, p, end)) {
+                p++;
+            }
+            flen = p - fptr;
+            if (ctx->tsv && memchr(fptr, '\\', flen) != NULL) {
+                tsv_unescape(ctx, &fptr, &flen);
+            }
+        }
+        if (p == end && !eof) {
+            return NULL;
+        }
+        set_field(ctx, fptr, flen, quoted);
+        if (p == end) {
+            end_record(ctx);
+            return p;
+        }
+        if (*p == '\n') {
+            end_record(ctx);
+            return p + 1;
+        }
+        if (*p == '\r') {
+            if (p + 1 == end && !eof) {
+                return NULL;
+            }
+            end_record(ctx);
+            return p + ((p + 1 < end && p[1] == '\n') ? 2 : 1);
+        }
+        p += ctx->col_sep_len;
+    }
+}
+
+/*
+ * driver
+ */
+static const char *get_cstr(copy_from_t *ctx, VALUE val, long *len)
+{
+    SafeStringValue(val);
+    rb_ary_push(ctx->gc_guard, val);
+    if (len != NULL) {
+        *len = RSTRING_LEN(val);
+    }
+    return StringValueCStr(val);
+}
+
+VALUE rbdpi_stmt_copy_from(VALUE self, VALUE conn, VALUE vars, VALUE io, VALUE format, VALUE params)
+{
+    VALUE kwargs[10];
+    copy_from_t ctx = {0,};
+    VALUE record_nos;
+    VALUE data = Qnil;
+    uint32_t num_cols;
+    uint32_t idx;
+    int eof = 0;
+
+    ctx.stmt = rbdpi_to_stmt(self);
+    ctx.conn = rbdpi_to_conn(conn);
+    ctx.io = io;
+    ctx.enc = (rb_encoding *)ctx.stmt->enc.enc;
+    ctx.scratch = rb_str_buf_new(0);
+    ctx.raw_buf = rb_str_buf_new(0);
+    ctx.errors = rb_ary_new();
+    ctx.gc_guard = rb_ary_new();
+    ctx.record_error = Qnil;
+    ctx.chunk_size = DEFAULT_CHUNK_SIZE;
+    ctx.exec_mode = DPI_MODE_EXEC_BATCH_ERRORS;
+    ctx.max_errors = -1;
+    ctx.progress = Qnil;
+    ctx.quote_char = '"';
+    ctx.null_value = "";
+
+    if (format == sym_csv) {
+        ctx.col_sep = ",";
+    } else if (format == sym_tsv) {
+        ctx.col_sep = "\t";
+        ctx.tsv = 1;
+    } else {
+        rb_raise(rb_eArgError, "unknown format: %"PRIsVALUE, rb_inspect(format));
+    }
+    ctx.col_sep_len = 1;
+
+    if (!NIL_P(params)) {
+        rb_get_kwargs(params, copy_from_keyword_ids, 0, -10-1, kwargs);
+        /* headers */
+        if (kwargs[0] != Qundef) {
+            ctx.headers = RTEST(kwargs[0]);
+        }
+        /* col_sep */
+        if (kwargs[1] != Qundef) {
+            ctx.col_sep = get_cstr(&ctx, kwargs[1], &ctx.col_sep_len);
+            if (ctx.col_sep_len == 0) {
+                rb_raise(rb_eArgError, "empty col_sep");
+            }
+        }
+        /* quote_char */
+        if (kwargs[2] != Qundef) {
+            long len;
+            const char *quote_char = get_cstr(&ctx, kwargs[2], &len);
+
+            if (len != 1) {
+                rb_raise(rb_eArgError, "quote_char must be a single byte");
+            }
+            ctx.quote_char = quote_char[0];
+        }
+        /* null_value */
+        if (kwargs[3] != Qundef) {
+            ctx.null_value = get_cstr(&ctx, kwargs[3], &ctx.null_value_len);
+        }
+        /* date_format */
+        if (kwargs[4] != Qundef && !NIL_P(kwargs[4])) {
+            ctx.date_format = get_cstr(&ctx, kwargs[4], NULL);
+        }
+        /* timestamp_format */
+        if (kwargs[5] != Qundef && !NIL_P(kwargs[5])) {
+            ctx.timestamp_format = get_cstr(&ctx, kwargs[5], NULL);
+        }
+        /* chunk_size */
+        if (kwargs[6] != Qundef) {
+            ctx.chunk_size = NUM2LONG(kwargs[6]);
+            if (ctx.chunk_size <= 0) {
+                rb_raise(rb_eArgError, "chunk_size must be positive");
+            }
+        }
+        /* max_errors */
+        if (kwargs[7] != Qundef && !NIL_P(kwargs[7])) {
+            ctx.max_errors = NUM2LONG(kwargs[7]);
+        }
+        /* commit */
+        if (kwargs[8] != Qundef && RTEST(kwargs[8])) {
+            ctx.exec_mode |= DPI_MODE_EXEC_COMMIT_ON_SUCCESS;
+        }
+        /* progress */
+        if (kwargs[9] != Qundef) {
+            ctx.progress = kwargs[9];
+        }
+    }
+
+    Check_Type(vars, T_ARRAY);
+    num_cols = (uint32_t)RARRAY_LEN(vars);
+    if (num_cols == 0) {
+        rb_raise(rb_eArgError, "no columns");
+    }
+    ctx.num_cols = num_cols;
+    ctx.cols = ALLOCA_N(load_col_t, num_cols);
+    ctx.batch_size = RBDPI_MAX_BATCH_SIZE;
+    for (idx = 0; idx < num_cols; idx++) {
+        load_col_t *col = &ctx.cols[idx];
+        uint32_t num;
+
+        col->var = rbdpi_to_var(RARRAY_AREF(vars, idx));
+        switch (col->var->native_type) {
+        case DPI_NATIVE_TYPE_INT64:
+        case DPI_NATIVE_TYPE_UINT64:
+        case DPI_NATIVE_TYPE_FLOAT:
+        case DPI_NATIVE_TYPE_DOUBLE:
+        case DPI_NATIVE_TYPE_BYTES:
+        case DPI_NATIVE_TYPE_TIMESTAMP:
+        case DPI_NATIVE_TYPE_BOOLEAN:
+            break;
+        default:
+            rb_raise(rb_eArgError, "unsupported column type %s at position %u",
+                     rb_id2name(SYM2ID(rbdpi_from_dpiOracleTypeNum(col->var->oracle_type))), idx + 1);
+        }
+        CHK(dpiVar_getData(col->var->handle, &num, &col->data));
+        if (ctx.batch_size > num) {
+            ctx.batch_size = num;
+        }
+        col->nchar_conv = rbdpi_ora2enc_type(col->var->oracle_type) == ENC_TYPE_NCHAR
+            && col->var->enc.nenc != col->var->enc.enc;
+    }
+    record_nos = rb_str_tmp_new(ctx.batch_size * sizeof(uint64_t));
+    ctx.record_nos = (uint64_t *)RSTRING_PTR(record_nos);
+    ctx.skip_record = ctx.headers;
+
+    while (!eof) {
+        VALUE chunk = rb_funcall(io, id_read, 1, LONG2NUM(ctx.chunk_size));
+        const char *start, *p, *end;
+
+        if (NIL_P(chunk)) {
+            eof = 1;
+            if (NIL_P(data)) {
+                break;
+            }
+        } else {
+            StringValue(chunk);
+            if (NIL_P(data)) {
+                /* chunk may be frozen or reused by io. */
+                data = rb_str_dup(chunk);
+            } else {
+                rb_str_cat(data, RSTRING_PTR(chunk), RSTRING_LEN(chunk));
+            }
+        }
+        start = p = RSTRING_PTR(data);
+        end = p + RSTRING_LEN(data);
+        while (p < end) {
+            const char *next = parse_record(&ctx, p, end, eof);
+
+            if (next == NULL) {
+                break;
+            }
+            p = next;
+        }
+        data = (p < end) ? rb_str_subseq(data, p - start, end - p) : Qnil;
+    }
+    if (ctx.batch_rows > 0) {
+        execute_batch(&ctx);
+    }
+    RB_GC_GUARD(record_nos);
+    RB_GC_GUARD(ctx.scratch);
+    RB_GC_GUARD(ctx.raw_buf);
+    RB_GC_GUARD(ctx.gc_guard);
+    return rb_ary_new_from_args(2, ULL2NUM(ctx.num_rows), ctx.errors);
+}
+
+void Init_rbdpi_copy_from(void)
+{
+    copy_from_keyword_ids[0] = rb_intern("headers");
+    copy_from_keyword_ids[1] = rb_intern("col_sep");
+    copy_from_keyword_ids[2] = rb_intern("quote_char");
+    copy_from_keyword_ids[3] = rb_intern("null_value");
+    copy_from_keyword_ids[4] = rb_intern("date_format");
+    copy_from_keyword_ids[5] = rb_intern("timestamp_format");
+    copy_from_keyword_ids[6] = rb_intern("chunk_size");
+    copy_from_keyword_ids[7] = rb_intern("max_errors");
+    copy_from_keyword_ids[8] = rb_intern("commit");
+    copy_from_keyword_ids[9] = rb_intern("progress");
+
+    sym_csv = ID2SYM(rb_intern("csv"));
+    sym_tsv = ID2SYM(rb_intern("tsv"));
+    id_call = rb_intern("call");
+    id_read = rb_intern("read");
+}
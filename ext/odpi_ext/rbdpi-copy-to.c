@@ -0,0 +1,926 @@
+/*
+ * rbdpi-copy-to.c -- part of ruby-odpi
+ *
+ * URL: https://github.com/kubo/ruby-odpi
+ *
+ * ------------------------------------------------------
+ *
+ * Copyright 2017 Kubo Takehiro <kubo@jiubao.org>
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are
+ * permitted provided that the following conditions are met:
+ *
+ *    1. Redistributions of source code must retain the above copyright notice, this list of
+ *       conditions and the following disclaimer.
+ *
+ *    2. Redistributions in binary form must reproduce the above copyright notice, this list
+ *       of conditions and the following disclaimer in the documentation and/or other materials
+ *       provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation are those of the
+ * authors and should not be interpreted as representing official policies, either expressed
+ * or implied, of the authors.
+ *
+ */
+#include "rbdpi.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#define DEFAULT_CHUNK_SIZE 65536
+#define DEFAULT_PROGRESS_INTERVAL 10000
+#define CELL_BUF_SIZE 256
+
+static VALUE sym_csv;
+static VALUE sym_tsv;
+static VALUE sym_ndjson;
+static VALUE sym_json_array;
+static VALUE sym_arrow_stream;
+static VALUE sym_arrow_file;
+static ID id_call;
+static ID copy_to_keyword_ids[12];
+
+typedef enum {
+    CELL_NULL,
+    CELL_STRING,
+    CELL_NUMBER,
+    CELL_BOOLEAN,
+    CELL_DATETIME,
+    CELL_BINARY,
+} cell_type_t;
+
+typedef struct {
+    const var_t *var;
+    dpiData *data;
+    rb_encoding *conv_enc; /* source encoding when it differs from the output */
+} copy_col_t;
+
+typedef struct copy_to copy_to_t;
+
+struct copy_to {
+    stmt_t *stmt;
+    conn_t *conn;
+    VALUE io;
+    VALUE buf;
+    VALUE tmp_str;
+    VALUE gc_guard;
+    rb_encoding *enc;
+    long chunk_size;
+    uint32_t num_cols;
+    copy_col_t *cols;
+    uint64_t num_rows;
+    VALUE progress;
+    uint64_t progress_interval;
+    const char *date_format;
+    const char *timestamp_format;
+    const char *timestamp_tz_format;
+    /* CSV and TSV */
+    int headers;
+    int force_quotes;
+    char quote_char;
+    const char *col_sep;
+    long col_sep_len;
+    const char *row_sep;
+    long row_sep_len;
+    const char *null_value;
+    long null_value_len;
+    /* JSON */
+    int json_array;
+    VALUE json_keys;
+};
+
+/* Converts str to enc, replacing invalid and undefined characters. */
+static VALUE conv_enc(VALUE str, rb_encoding *enc)
+{
+    return rb_str_encode(str, rb_enc_from_encoding(enc), ECONV_INVALID_REPLACE | ECONV_UNDEF_REPLACE, Qnil);
+}
+
+/*
+ * output buffer
+ */
+static VALUE new_buf(copy_to_t *ctx)
+{
+    VALUE buf = rb_str_buf_new(ctx->chunk_size + CELL_BUF_SIZE);
+
+    rb_enc_associate(buf, ctx->enc);
+    return buf;
+}
+
+static inline char *buf_reserve(copy_to_t *ctx, long len)
+{
+    long cur = RSTRING_LEN(ctx->buf);
+
+    rb_str_modify_expand(ctx->buf, len);
+    return RSTRING_PTR(ctx->buf) + cur;
+}
+
+static inline void buf_commit(copy_to_t *ctx, long len)
+{
+    rb_str_set_len(ctx->buf, RSTRING_LEN(ctx->buf) + len);
+}
+
+static inline void buf_cat(copy_to_t *ctx, const char *ptr, long len)
+{
+    if (len > 0) {
+        memcpy(buf_reserve(ctx, len), ptr, len);
+        buf_commit(ctx, len);
+    }
+}
+
+static inline void buf_putc(copy_to_t *ctx, char c)
+{
+    *buf_reserve(ctx, 1) = c;
+    buf_commit(ctx, 1);
+}
+
+static void buf_flush(copy_to_t *ctx)
+{
+    if (RSTRING_LEN(ctx->buf) > 0) {
+        rb_io_write(ctx->io, ctx->buf);
+        /* The IO may keep the written string. Don't reuse it. */
+        ctx->buf = new_buf(ctx);
+    }
+}
+
+/*
+ * cell formatting
+ */
+static int put_digits(char *buf, long rest, int num, int width)
+{
+    int idx;
+
+    if (rest < width) {
+        return 0;
+    }
+    for (idx = width - 1; idx >= 0; idx--) {
+        buf[idx] = '0' + (num % 10);
+        num /= 10;
+    }
+    return width;
+}
+
+/* strftime-like formatter for dpiTimestamp.
+ * Supported: %Y %m %d %H %M %S %L %N %3N %6N %9N %z %:z %%
+ */
+static long format_timestamp(char *buf, long size, const char *fmt, const dpiTimestamp *ts)
+{
+    long len = 0;
+
+    while (*fmt != '\0' && len < size) {
+        int width;
+
+        if (*fmt != '%') {
+            buf[len++] = *fmt++;
+            continue;
+        }
+        fmt++;
+        width = 9;
+        if ('1' <= *fmt && *fmt <= '9' && fmt[1] == 'N') {
+            width = *fmt - '0';
+            fmt++;
+        }
+        switch (*fmt) {
+        case 'Y':
+            if (ts->year < 0 && len < size) {
+                buf[len++] = '-';
+            }
+            len += put_digits(buf + len, size - len, ts->year < 0 ? -ts->year : ts->year, 4);
+            break;
+        case 'm':
+            len += put_digits(buf + len, size - len, ts->month, 2);
+            break;
+        case 'd':
+            len += put_digits(buf + len, size - len, ts->day, 2);
+            break;
+        case 'H':
+            len += put_digits(buf + len, size - len, ts->hour, 2);
+            break;
+        case 'M':
+            len += put_digits(buf + len, size - len, ts->minute, 2);
+            break;
+        case 'S':
+            len += put_digits(buf + len, size - len, ts->second, 2);
+            break;
+        case 'L':
+            width = 3;
+            /* FALLTHROUGH */
+        case 'N':
+            {
+                uint32_t fsec = ts->fsecond;
+                int n;
+
+                for (n = 9; n > width; n--) {
+                    fsec /= 10;
+                }
+                len += put_digits(buf + len, size - len, fsec, width);
+            }
+            break;
+        case ':':
+            if (fmt[1] != 'z') {
+                buf[len++] = '%';
+                continue;
+            }
+            fmt++;
+            /* FALLTHROUGH */
+        case 'z':
+            if (size - len >= 1) {
+                int neg = ts->tzHourOffset < 0 || ts->tzMinuteOffset < 0;
+
+                buf[len++] = neg ? '-' : '+';
+                len += put_digits(buf + len, size - len, abs(ts->tzHourOffset), 2);
+                if (fmt[-1] == ':' && len < size) {
+                    buf[len++] = ':';
+                }
+                len += put_digits(buf + len, size - len, abs(ts->tzMinuteOffset), 2);
+            }
+            break;
+        case '%':
+            buf[len++] = '%';
+            break;
+        case '\0':
+            buf[len++] = '%';
+            return len;
+        default:
+            buf[len++] = '%';
+            if (len < size) {
+                buf[len++] = *fmt;
+            }
+        }
+        fmt++;
+    }
+    return len;
+}
+
+static long format_double(char *buf, long size, double val)
+{
+    int len;
+
+    if (isnan(val)) {
+        return snprintf(buf, size, "NaN");
+    }
+    if (isinf(val)) {
+        return snprintf(buf, size, val > 0 ? "Infinity" : "-Infinity");
+    }
+    /* Use the shortest form which restores the same value. */
+    len = snprintf(buf, size, "%.15g", val);
+    if (strtod(buf, NULL) != val) {
+        len = snprintf(buf, size, "%.17g", val);
+    }
+    return len;
+}
+
+static long format_float(char *buf, long size, float val)
+{
+    int len;
+
+    if (isnan(val) || isinf(val)) {
+        return format_double(buf, size, val);
+    }
+    len = snprintf(buf, size, "%.7g", val);
+    if ((float)strtod(buf, NULL) != val) {
+        len = snprintf(buf, size, "%.9g", val);
+    }
+    return len;
+}
+
+static long format_interval_ds(char *buf, long size, const dpiIntervalDS *intvl)
+{
+    int neg = intvl->days < 0 || intvl->hours < 0 || intvl->minutes < 0
+        || intvl->seconds < 0 || intvl->fseconds < 0;
+
+    return snprintf(buf, size, "%c%d %02d:%02d:%02d.%09d", neg ? '-' : '+',
+                    abs(intvl->days), abs(intvl->hours), abs(intvl->minutes),
+                    abs(intvl->seconds), abs(intvl->fseconds));
+}
+
+static long format_interval_ym(char *buf, long size, const dpiIntervalYM *intvl)
+{
+    int neg = intvl->years < 0 || intvl->months < 0;
+
+    return snprintf(buf, size, "%c%d-%02d", neg ? '-' : '+',
+                    abs(intvl->years), abs(intvl->months));
+}
+
+/* Get the text representation of a cell.
+ * Strings and raw values point to the define buffer and others are
+ * formatted into buf, which must have CELL_BUF_SIZE bytes at least.
+ */
+static cell_type_t cell_text(copy_to_t *ctx, const copy_col_t *col, const dpiData *data,
+                             char *buf, const char **ptr, uint32_t *len)
+{
+    const var_t *var = col->var;
+
+    if (data->isNull) {
+        return CELL_NULL;
+    }
+    *ptr = buf;
+    switch (var->native_type) {
+    case DPI_NATIVE_TYPE_INT64:
+        *len = snprintf(buf, CELL_BUF_SIZE, "%" PRId64, data->value.asInt64);
+        return CELL_NUMBER;
+    case DPI_NATIVE_TYPE_UINT64:
+        *len = snprintf(buf, CELL_BUF_SIZE, "%" PRIu64, data->value.asUint64);
+        return CELL_NUMBER;
+    case DPI_NATIVE_TYPE_FLOAT:
+        *len = format_float(buf, CELL_BUF_SIZE, data->value.asFloat);
+        return CELL_NUMBER;
+    case DPI_NATIVE_TYPE_DOUBLE:
+        *len = format_double(buf, CELL_BUF_SIZE, data->value.asDouble);
+        return CELL_NUMBER;
+    case DPI_NATIVE_TYPE_BYTES:
+        *ptr = data->value.asBytes.ptr;
+        *len = data->value.asBytes.length;
+        switch (var->oracle_type) {
+        case DPI_ORACLE_TYPE_NUMBER:
+            return CELL_NUMBER;
+        case DPI_ORACLE_TYPE_RAW:
+        case DPI_ORACLE_TYPE_LONG_RAW:
+            return CELL_BINARY;
+        }
+        if (col->conv_enc != NULL) {
+            ctx->tmp_str = conv_enc(rb_enc_str_new(*ptr, *len, col->conv_enc), ctx->enc);
+            *ptr = RSTRING_PTR(ctx->tmp_str);
+            *len = RSTRING_LEN(ctx->tmp_str);
+        }
+        return CELL_STRING;
+    case DPI_NATIVE_TYPE_TIMESTAMP:
+        switch (var->oracle_type) {
+        case DPI_ORACLE_TYPE_DATE:
+            *len = format_timestamp(buf, CELL_BUF_SIZE, ctx->date_format, &data->value.asTimestamp);
+            break;
+        case DPI_ORACLE_TYPE_TIMESTAMP:
+            *len = format_timestamp(buf, CELL_BUF_SIZE, ctx->timestamp_format, &data->value.asTimestamp);
+            break;
+        default:
+            *len = format_timestamp(buf, CELL_BUF_SIZE, ctx->timestamp_tz_format, &data->value.asTimestamp);
+        }
+        return CELL_DATETIME;
+    case DPI_NATIVE_TYPE_INTERVAL_DS:
+        *len = format_interval_ds(buf, CELL_BUF_SIZE, &data->value.asIntervalDS);
+        return CELL_STRING;
+    case DPI_NATIVE_TYPE_INTERVAL_YM:
+        *len = format_interval_ym(buf, CELL_BUF_SIZE, &data->value.asIntervalYM);
+        return CELL_STRING;
+    case DPI_NATIVE_TYPE_BOOLEAN:
+        *len = snprintf(buf, CELL_BUF_SIZE, data->value.asBoolean ? "true" : "false");
+        return CELL_BOOLEAN;
+    case DPI_NATIVE_TYPE_ROWID:
+        CHK(dpiRowid_getStringValue(data->value.asRowid, ptr, len));
+        return CELL_STRING;
+    }
+    rb_raise(rb_eRuntimeError, "unknown native type %d", var->native_type);
+}
+
+static void put_hex(copy_to_t *ctx, const char *ptr, uint32_t len)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    char *out = buf_reserve(ctx, (long)len * 2);
+    uint32_t idx;
+
+    for (idx = 0; idx < len; idx++) {
+        unsigned char c = (unsigned char)ptr[idx];
+        out[idx * 2] = hex[c >> 4];
+        out[idx * 2 + 1] = hex[c & 0x0F];
+    }
+    buf_commit(ctx, (long)len * 2);
+}
+
+/*
+ * CSV
+ */
+static int csv_need_quote(const copy_to_t *ctx, const char *ptr, uint32_t len)
+{
+    uint32_t idx;
+
+    if (ctx->force_quotes) {
+        return 1;
+    }
+    for (idx = 0; idx < len; idx++) {
+        char c = ptr[idx];
+
+        if (c == ctx->quote_char || c == '\r' || c == '\n') {
+            return 1;
+        }
+        if (c == ctx->col_sep[0] && len - idx >= ctx->col_sep_len
+            && memcmp(ptr + idx, ctx->col_sep, ctx->col_sep_len) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void csv_put_field(copy_to_t *ctx, const char *ptr, uint32_t len)
+{
+    char *out;
+    long n = 0;
+    uint32_t idx;
+
+    if (!csv_need_quote(ctx, ptr, len)) {
+        buf_cat(ctx, ptr, len);
+        return;
+    }
+    out = buf_reserve(ctx, (long)len * 2 + 2);
+    out[n++] = ctx->quote_char;
+    for (idx = 0; idx < len; idx++) {
+        if (ptr[idx] == ctx->quote_char) {
+            out[n++] = ctx->quote_char;
+        }
+        out[n++] = ptr[idx];
+    }
+    out[n++] = ctx->quote_char;
+    buf_commit(ctx, n);
+}
+
+/* backslash escapes like PostgreSQL's text format */
+static void tsv_put_field(copy_to_t *ctx, const char *ptr, uint32_t len)
+{
+    char *out = buf_reserve(ctx, (long)len * 2);
+    long n = 0;
+    uint32_t idx;
+
+    for (idx = 0; idx < len; idx++) {
+        switch (ptr[idx]) {
+        case '\t':
+            out[n++] = '\\';
+            out[n++] = 't';
+            break;
+        case '\n':
+            out[n++] = '\\';
+            out[n++] = 'n';
+            break;
+        case '\r':
+            out[n++] = '\\';
+            out[n++] = 'r';
+            break;
+        case '\\':
+            out[n++] = '\\';
+            out[n++] = '\\';
+            break;
+        default:
+            out[n++] = ptr[idx];
+        }
+    }
+    buf_commit(ctx, n);
+}
+
+static void write_text_header(copy_to_t *ctx, void (*put_field)(copy_to_t *, const char *, uint32_t))
+{
+    uint32_t idx;
+
+    for (idx = 0; idx < ctx->num_cols; idx++) {
+        dpiQueryInfo info;
+
+        CHK(dpiStmt_getQueryInfo(ctx->stmt->handle, idx + 1, &info));
+        if (idx != 0) {
+            buf_cat(ctx, ctx->col_sep, ctx->col_sep_len);
+        }
+        put_field(ctx, info.name, info.nameLength);
+    }
+    buf_cat(ctx, ctx->row_sep, ctx->row_sep_len);
+}
+
+static void write_text_row(copy_to_t *ctx, uint32_t row, void (*put_field)(copy_to_t *, const char *, uint32_t))
+{
+    char cellbuf[CELL_BUF_SIZE];
+    uint32_t idx;
+
+    for (idx = 0; idx < ctx->num_cols; idx++) {
+        const copy_col_t *col = &ctx->cols[idx];
+        const char *ptr;
+        uint32_t len;
+
+        if (idx != 0) {
+            buf_cat(ctx, ctx->col_sep, ctx->col_sep_len);
+        }
+        switch (cell_text(ctx, col, &col->data[row], cellbuf, &ptr, &len)) {
+        case CELL_NULL:
+            buf_cat(ctx, ctx->null_value, ctx->null_value_len);
+            break;
+        case CELL_BINARY:
+            put_hex(ctx, ptr, len);
+            break;
+        default:
+            put_field(ctx, ptr, len);
+        }
+    }
+    buf_cat(ctx, ctx->row_sep, ctx->row_sep_len);
+}
+
+static void write_csv_row(copy_to_t *ctx, uint32_t row)
+{
+    write_text_row(ctx, row, csv_put_field);
+}
+
+static void write_tsv_row(copy_to_t *ctx, uint32_t row)
+{
+    write_text_row(ctx, row, tsv_put_field);
+}
+
+/*
+ * JSON
+ */
+static void json_put_string(copy_to_t *ctx, const char *ptr, uint32_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    char *out = buf_reserve(ctx, (long)len * 6 + 2);
+    long n = 0;
+    uint32_t idx;
+
+    out[n++] = '"';
+    for (idx = 0; idx < len; idx++) {
+        unsigned char c = (unsigned char)ptr[idx];
+
+        switch (c) {
+        case '"':
+        case '\\':
+            out[n++] = '\\';
+            out[n++] = c;
+            break;
+        case '\n':
+            out[n++] = '\\';
+            out[n++] = 'n';
+            break;
+        case '\r':
+            out[n++] = '\\';
+            out[n++] = 'r';
+            break;
+        case '\t':
+            out[n++] = '\\';
+            out[n++] = 't';
+            break;
+        default:
+            if (c < 0x20) {
+                out[n++] = '\\';
+                out[n++] = 'u';
+                out[n++] = '0';
+                out[n++] = '0';
+                out[n++] = hex[c >> 4];
+                out[n++] = hex[c & 0x0F];
+            } else if (c < 0x80) {
+                out[n++] = c;
+            } else {
+                /* Data in the database may be invalid in its own charset. */
+                int clen = rb_enc_precise_mbclen(ptr + idx, ptr + len, rb_utf8_encoding());
+
+                if (MBCLEN_CHARFOUND_P(clen)) {
+                    clen = MBCLEN_CHARFOUND_LEN(clen);
+                    memcpy(out + n, ptr + idx, clen);
+                    n += clen;
+                    idx += clen - 1;
+                } else {
+                    memcpy(out + n, "\\ufffd", 6);
+                    n += 6;
+                }
+            }
+        }
+    }
+    out[n++] = '"';
+    buf_commit(ctx, n);
+}
+
+/* Numbers are written from their decimal text. Oracle omits the zero
+ * before the decimal point, which JSON requires. Non-finite values are null.
+ */
+static void json_put_number(copy_to_t *ctx, const char *ptr, uint32_t len)
+{
+    uint32_t idx = (len > 0 && ptr[0] == '-') ? 1 : 0;
+
+    if (idx < len && ptr[idx] == '.') {
+        buf_cat(ctx, ptr, idx);
+        buf_putc(ctx, '0');
+        buf_cat(ctx, ptr + idx, len - idx);
+    } else if (idx < len && '0' <= ptr[idx] && ptr[idx] <= '9') {
+        buf_cat(ctx, ptr, len);
+    } else {
+        buf_cat(ctx, "null", 4);
+    }
+}
+
+static void make_json_keys(copy_to_t *ctx)
+{
+    rb_encoding *enc = (rb_encoding *)ctx->stmt->enc.enc;
+    VALUE buf = ctx->buf;
+    uint32_t idx;
+
+    ctx->json_keys = rb_ary_new_capa(ctx->num_cols);
+    for (idx = 0; idx < ctx->num_cols; idx++) {
+        dpiQueryInfo info;
+        VALUE name;
+
+        CHK(dpiStmt_getQueryInfo(ctx->stmt->handle, idx + 1, &info));
+        name = conv_enc(rb_enc_str_new(info.name, info.nameLength, enc), ctx->enc);
+        /* Format '"NAME":' once by the output buffer functions. */
+        ctx->buf = rb_str_buf_new(0);
+        if (idx != 0) {
+            buf_putc(ctx, ',');
+        }
+        json_put_string(ctx, RSTRING_PTR(name), (uint32_t)RSTRING_LEN(name));
+        buf_putc(ctx, ':');
+        rb_ary_push(ctx->json_keys, ctx->buf);
+    }
+    ctx->buf = buf;
+}
+
+static void write_json_row(copy_to_t *ctx, uint32_t row)
+{
+    char cellbuf[CELL_BUF_SIZE];
+    uint32_t idx;
+
+    if (ctx->json_array && ctx->num_rows > 0) {
+        buf_putc(ctx, ',');
+    }
+    buf_putc(ctx, '{');
+    for (idx = 0; idx < ctx->num_cols; idx++) {
+        const copy_col_t *col = &ctx->cols[idx];
+        VALUE key = RARRAY_AREF(ctx->json_keys, idx);
+        const char *ptr;
+        uint32_t len;
+
+        buf_cat(ctx, RSTRING_PTR(key), RSTRING_LEN(key));
+        switch (cell_text(ctx, col, &col->data[row], cellbuf, &ptr, &len)) {
+        case CELL_NULL:
+            buf_cat(ctx, "null", 4);
+            break;
+        case CELL_NUMBER:
+            json_put_number(ctx, ptr, len);
+            break;
+        case CELL_BOOLEAN:
+            buf_cat(ctx, ptr, len);
+            break;
+        case CELL_BINARY:
+            buf_putc(ctx, '"');
+            put_hex(ctx, ptr, len);
+            buf_putc(ctx, '"');
+            break;
+        default:
+            json_put_string(ctx, ptr, len);
+        }
+    }
+    buf_putc(ctx, '}');
+    if (!ctx->json_array) {
+        buf_cat(ctx, ctx->row_sep, ctx->row_sep_len);
+    }
+}
+
+/*
+ * driver
+ */
+static const char *get_cstr(copy_to_t *ctx, VALUE val, long *len)
+{
+    SafeStringValue(val);
+    rb_ary_push(ctx->gc_guard, val);
+    if (len != NULL) {
+        *len = RSTRING_LEN(val);
+    }
+    return StringValueCStr(val);
+}
+
+static void check_column_type(const var_t *var, uint32_t pos)
+{
+    switch (var->native_type) {
+    case DPI_NATIVE_TYPE_INT64:
+    case DPI_NATIVE_TYPE_UINT64:
+    case DPI_NATIVE_TYPE_FLOAT:
+    case DPI_NATIVE_TYPE_DOUBLE:
+    case DPI_NATIVE_TYPE_BYTES:
+    case DPI_NATIVE_TYPE_TIMESTAMP:
+    case DPI_NATIVE_TYPE_INTERVAL_DS:
+    case DPI_NATIVE_TYPE_INTERVAL_YM:
+    case DPI_NATIVE_TYPE_BOOLEAN:
+    case DPI_NATIVE_TYPE_ROWID:
+        return;
+    }
+    rb_raise(rb_eArgError, "unsupported column type %s at position %u",
+             rb_id2name(SYM2ID(rbdpi_from_dpiOracleTypeNum(var->oracle_type))), pos);
+}
+
+static void copy_to_progress(copy_to_t *ctx)
+{
+    rb_funcall(ctx->progress, id_call, 1, ULL2NUM(ctx->num_rows));
+}
+
+VALUE rbdpi_stmt_copy_to(VALUE self, VALUE conn, VALUE vars, VALUE io, VALUE format, VALUE params)
+{
+    VALUE kwargs[12];
+    copy_to_t ctx = {0,};
+    void (*write_row)(copy_to_t *, uint32_t);
+    uint32_t num_cols;
+    uint32_t fetch_size;
+    uint32_t idx;
+    int more_rows;
+
+    if (format == sym_arrow_stream || format == sym_arrow_file) {
+        return rbdpi_stmt_copy_to_arrow(self, conn, vars, io, format, params);
+    }
+
+    ctx.stmt = rbdpi_to_stmt(self);
+    ctx.conn = rbdpi_to_conn(conn);
+    ctx.io = io;
+    ctx.enc = (rb_encoding *)ctx.stmt->enc.enc;
+    ctx.tmp_str = Qnil;
+    ctx.json_keys = Qnil;
+    ctx.gc_guard = rb_ary_new();
+    ctx.chunk_size = DEFAULT_CHUNK_SIZE;
+    ctx.progress = Qnil;
+    ctx.progress_interval = DEFAULT_PROGRESS_INTERVAL;
+    ctx.date_format = "%Y-%m-%d %H:%M:%S";
+    ctx.timestamp_format = "%Y-%m-%d %H:%M:%S.%N";
+    ctx.timestamp_tz_format = "%Y-%m-%d %H:%M:%S.%N %:z";
+    ctx.quote_char = '"';
+    ctx.row_sep = "\n";
+    ctx.row_sep_len = 1;
+    ctx.null_value = "";
+    ctx.null_value_len = 0;
+
+    if (format == sym_csv) {
+        ctx.col_sep = ",";
+        write_row = write_csv_row;
+    } else if (format == sym_tsv) {
+        ctx.col_sep = "\t";
+        write_row = write_tsv_row;
+    } else if (format == sym_ndjson || format == sym_json_array) {
+        /* JSON text is UTF-8 with ISO 8601 date-times. */
+        ctx.enc = rb_utf8_encoding();
+        ctx.date_format = "%Y-%m-%dT%H:%M:%S";
+        ctx.timestamp_format = "%Y-%m-%dT%H:%M:%S.%N";
+        ctx.timestamp_tz_format = "%Y-%m-%dT%H:%M:%S.%N%:z";
+        ctx.json_array = (format == sym_json_array);
+        write_row = write_json_row;
+    } else {
+        rb_raise(rb_eArgError, "unknown format: %"PRIsVALUE, rb_inspect(format));
+    }
+    ctx.col_sep_len = 1;
+
+    if (!NIL_P(params)) {
+        rb_get_kwargs(params, copy_to_keyword_ids, 0, -12-1, kwargs);
+        /* headers */
+        if (kwargs[0] != Qundef) {
+            ctx.headers = RTEST(kwargs[0]);
+        }
+        /* col_sep */
+        if (kwargs[1] != Qundef) {
+            ctx.col_sep = get_cstr(&ctx, kwargs[1], &ctx.col_sep_len);
+            if (ctx.col_sep_len == 0) {
+                rb_raise(rb_eArgError, "empty col_sep");
+            }
+        }
+        /* row_sep */
+        if (kwargs[2] != Qundef) {
+            ctx.row_sep = get_cstr(&ctx, kwargs[2], &ctx.row_sep_len);
+        }
+        /* quote_char */
+        if (kwargs[3] != Qundef) {
+            long len;
+            const char *quote_char = get_cstr(&ctx, kwargs[3], &len);
+
+            if (len != 1) {
+                rb_raise(rb_eArgError, "quote_char must be a single byte");
+            }
+            ctx.quote_char = quote_char[0];
+        }
+        /* force_quotes */
+        if (kwargs[4] != Qundef) {
+            ctx.force_quotes = RTEST(kwargs[4]);
+        }
+        /* null_value */
+        if (kwargs[5] != Qundef) {
+            ctx.null_value = get_cstr(&ctx, kwargs[5], &ctx.null_value_len);
+        }
+        /* date_format */
+        if (kwargs[6] != Qundef) {
+            ctx.date_format = get_cstr(&ctx, kwargs[6], NULL);
+        }
+        /* timestamp_format */
+        if (kwargs[7] != Qundef) {
+            ctx.timestamp_format = get_cstr(&ctx, kwargs[7], NULL);
+        }
+        /* timestamp_tz_format */
+        if (kwargs[8] != Qundef) {
+            ctx.timestamp_tz_format = get_cstr(&ctx, kwargs[8], NULL);
+        }
+        /* chunk_size */
+        if (kwargs[9] != Qundef) {
+            ctx.chunk_size = NUM2LONG(kwargs[9]);
+            if (ctx.chunk_size <= 0) {
+                rb_raise(rb_eArgError, "chunk_size must be positive");
+            }
+        }
+        /* progress */
+        if (kwargs[10] != Qundef) {
+            ctx.progress = kwargs[10];
+        }
+        /* progress_interval */
+        if (kwargs[11] != Qundef) {
+            ctx.progress_interval = NUM2ULL(kwargs[11]);
+            if (ctx.progress_interval == 0) {
+                rb_raise(rb_eArgError, "progress_interval must be positive");
+            }
+        }
+    }
+
+    CHK(dpiStmt_getNumQueryColumns(ctx.stmt->handle, &num_cols));
+    Check_Type(vars, T_ARRAY);
+    if (num_cols == 0) {
+        rb_raise(rb_eRuntimeError, "not a query");
+    }
+    if (RARRAY_LEN(vars) != num_cols) {
+        rb_raise(rb_eArgError, "the number of variables %ld doesn't match the number of columns %u",
+                 RARRAY_LEN(vars), num_cols);
+    }
+    ctx.num_cols = num_cols;
+    ctx.cols = ALLOCA_N(copy_col_t, num_cols);
+    for (idx = 0; idx < num_cols; idx++) {
+        copy_col_t *col = &ctx.cols[idx];
+        rb_encoding *enc;
+        uint32_t num;
+
+        col->var = rbdpi_to_var(RARRAY_AREF(vars, idx));
+        check_column_type(col->var, idx + 1);
+        CHK(dpiVar_getData(col->var->handle, &num, &col->data));
+        switch (rbdpi_ora2enc_type(col->var->oracle_type)) {
+        case ENC_TYPE_CHAR:
+            enc = (rb_encoding *)col->var->enc.enc;
+            break;
+        case ENC_TYPE_NCHAR:
+            enc = (rb_encoding *)col->var->enc.nenc;
+            break;
+        default:
+            enc = ctx.enc;
+        }
+        col->conv_enc = (enc != ctx.enc) ? enc : NULL;
+    }
+    CHK(dpiStmt_getFetchArraySize(ctx.stmt->handle, &fetch_size));
+
+    ctx.buf = new_buf(&ctx);
+    if (write_row == write_json_row) {
+        make_json_keys(&ctx);
+        if (ctx.json_array) {
+            buf_putc(&ctx, '[');
+        }
+    } else if (ctx.headers) {
+        write_text_header(&ctx, write_row == write_csv_row ? csv_put_field : tsv_put_field);
+    }
+    do {
+        uint32_t index, rows;
+
+        CHK(dpiStmt_fetchRows_without_gvl(ctx.conn->handle, ctx.stmt->handle, fetch_size,
+                                          &index, &rows, &more_rows));
+        for (idx = 0; idx < rows; idx++) {
+            write_row(&ctx, index + idx);
+            if (RSTRING_LEN(ctx.buf) >= ctx.chunk_size) {
+                buf_flush(&ctx);
+            }
+            ctx.num_rows++;
+            if (!NIL_P(ctx.progress) && ctx.num_rows % ctx.progress_interval == 0) {
+                copy_to_progress(&ctx);
+            }
+        }
+    } while (more_rows);
+    if (ctx.json_array) {
+        buf_putc(&ctx, ']');
+    }
+    buf_flush(&ctx);
+    if (!NIL_P(ctx.progress) && ctx.num_rows % ctx.progress_interval != 0) {
+        copy_to_progress(&ctx);
+    }
+    RB_GC_GUARD(ctx.buf);
+    RB_GC_GUARD(ctx.tmp_str);
+    RB_GC_GUARD(ctx.json_keys);
+    RB_GC_GUARD(ctx.gc_guard);
+    return ULL2NUM(ctx.num_rows);
+}
+
+void Init_rbdpi_copy_to(void)
+{
+    copy_to_keyword_ids[0] = rb_intern("headers");
+    copy_to_keyword_ids[1] = rb_intern("col_sep");
+    copy_to_keyword_ids[2] = rb_intern("row_sep");
+    copy_to_keyword_ids[3] = rb_intern("quote_char");
+    copy_to_keyword_ids[4] = rb_intern("force_quotes");
+    copy_to_keyword_ids[5] = rb_intern("null_value");
+    copy_to_keyword_ids[6] = rb_intern("date_format");
+    copy_to_keyword_ids[7] = rb_intern("timestamp_format");
+    copy_to_keyword_ids[8] = rb_intern("timestamp_tz_format");
+    copy_to_keyword_ids[9] = rb_intern("chunk_size");
+    copy_to_keyword_ids[10] = rb_intern("progress");
+    copy_to_keyword_ids[11] = rb_intern("progress_interval");
+
+    sym_csv = ID2SYM(rb_intern("csv"));
+    sym_tsv = ID2SYM(rb_intern("tsv"));
+    sym_ndjson = ID2SYM(rb_intern("ndjson"));
+    sym_json_array = ID2SYM(rb_intern("json_array"));
+    sym_arrow_stream = ID2SYM(rb_intern("arrow_stream"));
+    sym_arrow_file = ID2SYM(rb_intern("arrow_file"));
+    id_call = rb_intern("call");
+}
@@ -33,49 +33,118 @@
  *
  */
 #include "rbdpi.h"
+#ifdef HAVE_RB_RACTOR_LOCAL_STORAGE_VALUE_NEWKEY
+#include <ruby/ractor.h>
+#endif
 
 #define HAS_VALUE(v) ((v) != Qundef && !NIL_P(v))
 
+/* frozen and shared by all Ractors */
+static VALUE utf8_name;
+static VALUE ruby_to_oracle_encoding_map;
+static ID common_keyword_ids[4];
+static ID conn_keyword_ids[6];
+static ID pool_keyword_ids[7];
+static ID subscr_keyword_ids[9];
+
+#ifdef HAVE_RB_RACTOR_LOCAL_STORAGE_VALUE_NEWKEY
+/* Default encodings are per Ractor. */
+static rb_ractor_local_key_t default_encoding_key;
+static rb_ractor_local_key_t default_nencoding_key;
+
+static VALUE ractor_local_encoding(rb_ractor_local_key_t key)
+{
+    VALUE val;
+
+    return rb_ractor_local_storage_value_lookup(key, &val) ? val : utf8_name;
+}
+
+#define DEFAULT_ENCODING() ractor_local_encoding(default_encoding_key)
+#define DEFAULT_NENCODING() ractor_local_encoding(default_nencoding_key)
+#define SET_DEFAULT_ENCODING(val) rb_ractor_local_storage_value_set(default_encoding_key, (val))
+#define SET_DEFAULT_NENCODING(val) rb_ractor_local_storage_value_set(default_nencoding_key, (val))
+#else
 static VALUE default_encoding;
 static VALUE default_nencoding;
-static VALUE ruby_to_oracle_encoding_map;
+
+#define DEFAULT_ENCODING() default_encoding
+#define DEFAULT_NENCODING() default_nencoding
+#define SET_DEFAULT_ENCODING(val) (default_encoding = (val))
+#define SET_DEFAULT_NENCODING(val) (default_nencoding = (val))
+#endif
+
+static VALUE encoding_name(VALUE enc)
+{
+    rb_encoding *rbenc = rb_find_encoding(enc);
+    VALUE name = rb_usascii_str_new_cstr(rb_enc_name(rbenc));
+    RB_OBJ_FREEZE(name);
+    return name;
+}
 
 static VALUE get_default_encoding(VALUE module)
 {
-    return default_encoding;
+    return DEFAULT_ENCODING();
 }
 
 static VALUE set_default_encoding(VALUE module, VALUE enc)
 {
-    rb_encoding *rbenc = rb_find_encoding(enc);
-    default_encoding = rb_usascii_str_new_cstr(rb_enc_name(rbenc));
-    RB_OBJ_FREEZE(default_encoding);
+    SET_DEFAULT_ENCODING(encoding_name(enc));
     return Qnil;
 }
 
 static VALUE get_default_nencoding(VALUE module)
 {
-    return default_nencoding;
+    return DEFAULT_NENCODING();
 }
 
 static VALUE set_default_nencoding(VALUE module, VALUE enc)
 {
-    rb_encoding *rbenc = rb_find_encoding(enc);
-    default_nencoding = rb_usascii_str_new_cstr(rb_enc_name(rbenc));
-    RB_OBJ_FREEZE(default_nencoding);
+    SET_DEFAULT_NENCODING(encoding_name(enc));
     return Qnil;
 }
 
 void Init_rbdpi_create_params(VALUE mODPI)
 {
-    default_encoding = rb_usascii_str_new_cstr("UTF-8");
-    RB_OBJ_FREEZE(default_encoding);
-    default_nencoding = rb_usascii_str_new_cstr("UTF-8");
-    RB_OBJ_FREEZE(default_nencoding);
+    common_keyword_ids[0] = rb_intern("event");
+    common_keyword_ids[1] = rb_intern("nencoding");
+    common_keyword_ids[2] = rb_intern("edition");
+    common_keyword_ids[3] = rb_intern("driver_name");
+    conn_keyword_ids[0] = rb_intern("connection_class");
+    conn_keyword_ids[1] = rb_intern("purity");
+    conn_keyword_ids[2] = rb_intern("new_password");
+    conn_keyword_ids[3] = rb_intern("app_context");
+    conn_keyword_ids[4] = rb_intern("tag");
+    conn_keyword_ids[5] = rb_intern("match_any_tag");
+    pool_keyword_ids[0] = rb_intern("min_sessions");
+    pool_keyword_ids[1] = rb_intern("max_sessions");
+    pool_keyword_ids[2] = rb_intern("session_increment");
+    pool_keyword_ids[3] = rb_intern("ping_interval");
+    pool_keyword_ids[4] = rb_intern("ping_timeout");
+    pool_keyword_ids[5] = rb_intern("homogeneous");
+    pool_keyword_ids[6] = rb_intern("get_mode");
+    subscr_keyword_ids[0] = rb_intern("namespace");
+    subscr_keyword_ids[1] = rb_intern("protocol");
+    subscr_keyword_ids[2] = rb_intern("qos");
+    subscr_keyword_ids[3] = rb_intern("operations");
+    subscr_keyword_ids[4] = rb_intern("port");
+    subscr_keyword_ids[5] = rb_intern("timeout");
+    subscr_keyword_ids[6] = rb_intern("name");
+    subscr_keyword_ids[7] = rb_intern("callback");
+    subscr_keyword_ids[8] = rb_intern("recipient");
+
+    utf8_name = rb_usascii_str_new_cstr("UTF-8");
+    RB_OBJ_FREEZE(utf8_name);
     ruby_to_oracle_encoding_map = rb_hash_new();
 
+    rb_global_variable(&utf8_name);
+#ifdef HAVE_RB_RACTOR_LOCAL_STORAGE_VALUE_NEWKEY
+    default_encoding_key = rb_ractor_local_storage_value_newkey();
+    default_nencoding_key = rb_ractor_local_storage_value_newkey();
+#else
+    default_encoding = default_nencoding = utf8_name;
     rb_global_variable(&default_encoding);
     rb_global_variable(&default_nencoding);
+#endif
 
     rb_define_const(mODPI, "RUBY_TO_ORACLE_ENCODING", ruby_to_oracle_encoding_map);
 
@@ -87,8 +156,8 @@ void Init_rbdpi_create_params(VALUE mODPI)
 
 rbdpi_enc_t rbdpi_get_encodings(VALUE params)
 {
-    VALUE enc = default_encoding;
-    VALUE nenc = default_nencoding;
+    VALUE enc = DEFAULT_ENCODING();
+    VALUE nenc = DEFAULT_NENCODING();
     rbdpi_enc_t rbenc;
 
     if (!NIL_P(params)) {
@@ -123,12 +192,11 @@ static VALUE to_oracle_enc(const char **out, rb_encoding *rbenc)
 
 VALUE rbdpi_fill_dpiCommonCreateParams(dpiCommonCreateParams *dpi_params, VALUE params, rb_encoding *enc)
 {
-    static ID keyword_ids[4];
     VALUE kwargs[4];
     VALUE val;
     VALUE ary;
 
-    CHK(dpiContext_initCommonCreateParams(rbdpi_g_context, dpi_params));
+    CHK(dpiContext_initCommonCreateParams(rbdpi_context(), dpi_params));
     dpi_params->createMode = DPI_MODE_CREATE_THREADED;
 
     if (NIL_P(params)) {
@@ -136,13 +204,7 @@ VALUE rbdpi_fill_dpiCommonCreateParams(dpiCommonCreateParams *dpi_params, VALUE
     }
     ary = rb_ary_new_capa(4);
 
-    if (keyword_ids[0] == 0) {
-        keyword_ids[0] = rb_intern("event");
-        keyword_ids[1] = rb_intern("nencoding");
-        keyword_ids[2] = rb_intern("edition");
-        keyword_ids[3] = rb_intern("driver_name");
-    }
-    rb_get_kwargs(params, keyword_ids, 0, -4-1, kwargs);
+    rb_get_kwargs(params, common_keyword_ids, 0, -4-1, kwargs);
     /* event */
     if (kwargs[0] != Qundef) {
         if (RTEST(kwargs[0])) {
@@ -152,7 +214,7 @@ VALUE rbdpi_fill_dpiCommonCreateParams(dpiCommonCreateParams *dpi_params, VALUE
     /* encoding */
     rb_ary_push(ary, to_oracle_enc(&dpi_params->encoding, enc));
     /* nencoding */
-    val = HAS_VALUE(kwargs[1]) ? kwargs[1] : default_nencoding;
+    val = HAS_VALUE(kwargs[1]) ? kwargs[1] : DEFAULT_NENCODING();
     rb_ary_push(ary, to_oracle_enc(&dpi_params->nencoding, rb_find_encoding(val)));
     /* edition */
     if (HAS_VALUE(kwargs[2])) {
@@ -178,24 +240,15 @@ VALUE rbdpi_fill_dpiCommonCreateParams(dpiCommonCreateParams *dpi_params, VALUE
 
 VALUE rbdpi_fill_dpiConnCreateParams(dpiConnCreateParams *dpi_params, VALUE params, VALUE auth_mode, rb_encoding *enc)
 {
-    static ID keyword_ids[6];
     VALUE kwargs[6];
     VALUE ary;
 
-    CHK(dpiContext_initConnCreateParams(rbdpi_g_context, dpi_params));
+    CHK(dpiContext_initConnCreateParams(rbdpi_context(), dpi_params));
     dpi_params->authMode = rbdpi_to_dpiAuthMode(auth_mode);
     if (NIL_P(params)) {
         return Qnil;
     }
-    if (keyword_ids[0] == 0) {
-        keyword_ids[0] = rb_intern("connection_class");
-        keyword_ids[1] = rb_intern("purity");
-        keyword_ids[2] = rb_intern("new_password");
-        keyword_ids[3] = rb_intern("app_context");
-        keyword_ids[4] = rb_intern("tag");
-        keyword_ids[5] = rb_intern("match_any_tag");
-    }
-    rb_get_kwargs(params, keyword_ids, 0, -6-1, kwargs);
+    rb_get_kwargs(params, conn_keyword_ids, 0, -6-1, kwargs);
     if (rb_type_p(kwargs[3], T_ARRAY)) {
         ary = rb_ary_new_capa(4 + RARRAY_LEN(kwargs[3]) * 3);
     } else {
@@ -282,23 +335,13 @@ VALUE rbdpi_fill_dpiConnCreateParams(dpiConnCreateParams *dpi_params, VALUE para
 
 VALUE rbdpi_fill_dpiPoolCreateParams(dpiPoolCreateParams *dpi_params, VALUE params, rb_encoding *enc)
 {
-    static ID keyword_ids[7];
     VALUE kwargs[7];
 
-    CHK(dpiContext_initPoolCreateParams(rbdpi_g_context, dpi_params));
+    CHK(dpiContext_initPoolCreateParams(rbdpi_context(), dpi_params));
     if (NIL_P(params)) {
         return Qnil;
     }
-    if (keyword_ids[0] == 0) {
-        keyword_ids[0] = rb_intern("min_sessions");
-        keyword_ids[1] = rb_intern("max_sessions");
-        keyword_ids[2] = rb_intern("session_increment");
-        keyword_ids[3] = rb_intern("ping_interval");
-        keyword_ids[4] = rb_intern("ping_timeout");
-        keyword_ids[5] = rb_intern("homogeneous");
-        keyword_ids[6] = rb_intern("get_mode");
-    }
-    rb_get_kwargs(params, keyword_ids, 0, -7-1, kwargs);
+    rb_get_kwargs(params, pool_keyword_ids, 0, -7-1, kwargs);
     /* min_sessions */
     if (HAS_VALUE(kwargs[0])) {
         dpi_params->minSessions = NUM2UINT(kwargs[0]);
@@ -332,26 +375,14 @@ VALUE rbdpi_fill_dpiPoolCreateParams(dpiPoolCreateParams *dpi_params, VALUE para
 
 VALUE rbdpi_fill_dpiSubscrCreateParams(dpiSubscrCreateParams *dpi_params, VALUE params, rb_encoding *enc)
 {
-    static ID keyword_ids[9];
     VALUE kwargs[9];
     VALUE ary;
 
-    CHK(dpiContext_initSubscrCreateParams(rbdpi_g_context, dpi_params));
+    CHK(dpiContext_initSubscrCreateParams(rbdpi_context(), dpi_params));
     if (NIL_P(params)) {
         return Qnil;
     }
-    if (keyword_ids[0] == 0) {
-        keyword_ids[0] = rb_intern("namespace");
-        keyword_ids[1] = rb_intern("protocol");
-        keyword_ids[2] = rb_intern("qos");
-        keyword_ids[3] = rb_intern("operations");
-        keyword_ids[4] = rb_intern("port");
-        keyword_ids[5] = rb_intern("timeout");
-        keyword_ids[6] = rb_intern("name");
-        keyword_ids[7] = rb_intern("callback");
-        keyword_ids[8] = rb_intern("recipient");
-    }
-    rb_get_kwargs(params, keyword_ids, 0, -9-1, kwargs);
+    rb_get_kwargs(params, subscr_keyword_ids, 0, -9-1, kwargs);
     ary = rb_ary_new_capa(2);
 
     /* namespace */
@@ -42,6 +42,8 @@ typedef struct {
 
 static VALUE sym_unknown;
 
+/* The caches are filled at load time and read-only afterwards
+ * so that they can be used from any Ractor. */
 static void init_sym_cache(sym_cache_t *cache)
 {
     while (cache->name != NULL) {
@@ -63,9 +65,6 @@ static int sym_to_enum(VALUE val, int default_val, sym_cache_t *cache, int bit_f
         }
         return rv;
     } else if (rb_type_p(val, T_SYMBOL)) {
-        if (cache->sym == 0) {
-            init_sym_cache(cache);
-        }
         while (cache->name != NULL) {
             if (cache->sym == val) {
                 return cache->num;
@@ -81,9 +80,6 @@ static int sym_to_enum(VALUE val, int default_val, sym_cache_t *cache, int bit_f
 
 static VALUE enum_to_sym(int val, sym_cache_t *cache, int bit_flag, VALUE not_found_obj)
 {
-    if (cache->sym == 0) {
-        init_sym_cache(cache);
-    }
     if (bit_flag) {
         if (val == 0) {
             return Qnil;
@@ -108,11 +104,6 @@ static VALUE enum_to_sym(int val, sym_cache_t *cache, int bit_flag, VALUE not_fo
     }
 }
 
-void Init_rbdpi_enum(void)
-{
-    sym_unknown = ID2SYM(rb_intern("unknown"));
-}
-
 // connection/pool authorization modes
 static sym_cache_t dpiAuthMode_cache[] = {
     {0, "default", DPI_MODE_AUTH_DEFAULT},
@@ -529,3 +520,37 @@ dpiVisibility rbdpi_to_dpiVisibility(VALUE val)
 {
     return sym_to_enum(val, -1, dpiVisibility_cache, 0, "visibility");
 }
+
+void Init_rbdpi_enum(void)
+{
+    static sym_cache_t *const caches[] = {
+        dpiAuthMode_cache,
+        dpiConnCloseMode_cache,
+        dpiDeqMode_cache,
+        dpiDeqNavigation_cache,
+        dpiEventType_cache,
+        dpiExecMode_cache,
+        dpiFetchMode_cache,
+        dpiMessageDeliveryMode_cache,
+        dpiMessageState_cache,
+        dpiNativeTypeNum_cache,
+        dpiOpCode_cache,
+        dpiOracleTypeNum_cache,
+        dpiPoolCloseMode_cache,
+        dpiPoolGetMode_cache,
+        dpiPurity_cache,
+        dpiShutdownMode_cache,
+        dpiStartupMode_cache,
+        dpiStatementType_cache,
+        dpiSubscrNamespace_cache,
+        dpiSubscrProtocol_cache,
+        dpiSubscrQOS_cache,
+        dpiVisibility_cache,
+    };
+    size_t idx;
+
+    sym_unknown = ID2SYM(rb_intern("unknown"));
+    for (idx = 0; idx < sizeof(caches) / sizeof(caches[0]); idx++) {
+        init_sym_cache(caches[idx]);
+    }
+}
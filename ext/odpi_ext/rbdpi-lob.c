@@ -38,7 +38,12 @@ static VALUE cLob;
 
 static void lob_free(void *arg)
 {
-    dpiLob_release(((lob_t*)arg)->handle);
+    lob_t *lob = (lob_t *)arg;
+
+    /* A handle inherited from the parent process is abandoned. */
+    if (lob->handle != NULL && lob->pid == rbdpi_pid) {
+        dpiLob_release(lob->handle);
+    }
     xfree(arg);
 }
 
@@ -271,6 +276,7 @@ VALUE rbdpi_from_lob(dpiLob *handle, const rbdpi_enc_t *enc, dpiOracleTypeNum or
 
     lob->handle = handle;
     lob->enc = *enc;
+    lob->pid = rbdpi_pid;
     lob->oracle_type = oracle_type;
     return obj;
 }
@@ -282,5 +288,8 @@ lob_t *rbdpi_to_lob(VALUE obj)
     if (lob->handle == NULL) {
         rb_raise(rb_eRuntimeError, "%s isn't initialized", rb_obj_classname(obj));
     }
+    if (lob->pid != rbdpi_pid) {
+        rb_raise(rb_eRuntimeError, "%s was created by the parent process", rb_obj_classname(obj));
+    }
     return lob;
 }
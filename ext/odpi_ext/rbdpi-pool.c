@@ -36,7 +36,12 @@
 
 static void pool_free(void *arg)
 {
-    dpiPool_release(((pool_t*)arg)->handle);
+    pool_t *pool = (pool_t *)arg;
+
+    /* A handle inherited from the parent process is abandoned. */
+    if (pool->handle != NULL && pool->pid == rbdpi_pid) {
+        dpiPool_release(pool->handle);
+    }
     xfree(arg);
 }
 
@@ -73,11 +78,12 @@ static VALUE pool_initialize(VALUE self, VALUE username, VALUE password, VALUE d
     if (NIL_P(username) && NIL_P(password)) {
         create_params.externalAuth = 1;
     }
-    CHK(dpiPool_create_without_gvl(rbdpi_g_context,
+    CHK(dpiPool_create_without_gvl(rbdpi_context(),
                                    NSTR_PTR(username), NSTR_LEN(username),
                                    NSTR_PTR(password), NSTR_LEN(password),
                                    NSTR_PTR(database), NSTR_LEN(database),
                                    &common_params, &create_params, &pool->handle));
+    pool->pid = rbdpi_pid;
     RB_GC_GUARD(username);
     RB_GC_GUARD(password);
     RB_GC_GUARD(database);
@@ -91,6 +97,8 @@ static VALUE pool_get_connection(VALUE self, VALUE username, VALUE password, VAL
     pool_t *pool = rbdpi_to_pool(self);
     dpiConn *conn;
     dpiConnCreateParams create_params;
+    uint32_t open_count;
+    uint64_t start;
     VALUE gc_guard;
 
     CHK_NSTR_ENC(username, pool->enc.enc);
@@ -99,10 +107,27 @@ static VALUE pool_get_connection(VALUE self, VALUE username, VALUE password, VAL
     if (NIL_P(username) && NIL_P(password)) {
         create_params.externalAuth = 1;
     }
+    /* ODPI-C 2 doesn't tell whether a session is new, so this estimates
+     * sessions created as the growth of the open count over each acquire.
+     * It misses sessions which another thread's acquire creates between
+     * this refresh and its own update, and sessions closed and reopened
+     * between the two reads. */
+    if (dpiPool_getOpenCount(pool->handle, &open_count) == DPI_SUCCESS) {
+        pool->open_count_seen = open_count;
+    }
+    start = rbdpi_clock_ns();
     CHK(dpiPool_acquireConnection_without_gvl(pool->handle,
                                               NSTR_PTR(username), NSTR_LEN(username),
                                               NSTR_PTR(password), NSTR_LEN(password),
                                               &create_params, &conn));
+    pool->acquires++;
+    pool->acquire_ns += rbdpi_clock_ns() - start;
+    if (dpiPool_getOpenCount(pool->handle, &open_count) == DPI_SUCCESS) {
+        if (open_count > pool->open_count_seen) {
+            pool->session_growth += open_count - pool->open_count_seen;
+        }
+        pool->open_count_seen = open_count;
+    }
     RB_GC_GUARD(username);
     RB_GC_GUARD(password);
     RB_GC_GUARD(gc_guard);
@@ -162,6 +187,18 @@ static VALUE pool_get_open_count(VALUE self)
     return UINT2NUM(val);
 }
 
+/* counters of connections acquired through Dpi::Pool#connection */
+static VALUE pool_get_stats(VALUE self)
+{
+    pool_t *pool = rbdpi_to_pool(self);
+    VALUE hash = rb_hash_new();
+
+    rb_hash_aset(hash, ID2SYM(rb_intern("acquires")), ULL2NUM(pool->acquires));
+    rb_hash_aset(hash, ID2SYM(rb_intern("acquire_time")), DBL2NUM(pool->acquire_ns / 1e9));
+    rb_hash_aset(hash, ID2SYM(rb_intern("session_growth")), ULL2NUM(pool->session_growth));
+    return hash;
+}
+
 static VALUE pool_get_stmt_cache_size(VALUE self)
 {
     pool_t *pool = rbdpi_to_pool(self);
@@ -224,12 +261,13 @@ void Init_rbdpi_pool(VALUE mDpi)
     rb_define_method(cPool, "get_mode", pool_get_get_mode, 0);
     rb_define_method(cPool, "max_lifetime_session", pool_get_max_lifetime_session, 0);
     rb_define_method(cPool, "open_count", pool_get_open_count, 0);
+    rb_define_method(cPool, "stats", pool_get_stats, 0);
     rb_define_method(cPool, "stmt_cache_size", pool_get_stmt_cache_size, 0);
     rb_define_method(cPool, "timeout", pool_get_timeout, 0);
     rb_define_method(cPool, "get_mode=", pool_set_get_mode, 1);
-    rb_define_method(cPool, "max_lifetime_session=", pool_set_max_lifetime_session, 0);
-    rb_define_method(cPool, "stmt_cache_size=", pool_set_stmt_cache_size, 0);
-    rb_define_method(cPool, "timeout=", pool_set_timeout, 0);
+    rb_define_method(cPool, "max_lifetime_session=", pool_set_max_lifetime_session, 1);
+    rb_define_method(cPool, "stmt_cache_size=", pool_set_stmt_cache_size, 1);
+    rb_define_method(cPool, "timeout=", pool_set_timeout, 1);
 }
 
 pool_t *rbdpi_to_pool(VALUE obj)
@@ -239,5 +277,8 @@ pool_t *rbdpi_to_pool(VALUE obj)
     if (pool->handle == NULL) {
         rb_raise(rb_eRuntimeError, "%s isn't initialized", rb_obj_classname(obj));
     }
+    if (pool->pid != rbdpi_pid) {
+        rb_raise(rb_eRuntimeError, "%s was created by the parent process", rb_obj_classname(obj));
+    }
     return pool;
 }
@@ -47,7 +47,8 @@ static void stmt_free(void *arg)
 {
     stmt_t *stmt = (stmt_t *)arg;
 
-    if (stmt->handle != NULL) {
+    /* A handle inherited from the parent process is abandoned. */
+    if (stmt->handle != NULL && stmt->pid == rbdpi_pid) {
         dpiStmt_release(stmt->handle);
     }
     xfree(arg);
@@ -167,12 +168,25 @@ static VALUE stmt_define(VALUE self, VALUE pos, VALUE var)
     return self;
 }
 
-static VALUE stmt_execute(VALUE self, VALUE mode)
+/* When conn is given, the GVL is released during the round trip. */
+static VALUE stmt_execute(int argc, VALUE *argv, VALUE self)
 {
     stmt_t *stmt = rbdpi_to_stmt(self);
+    VALUE mode, conn;
     uint32_t num_cols;
 
-    CHK(dpiStmt_execute(stmt->handle, rbdpi_to_dpiExecMode(mode), &num_cols));
+    rb_scan_args(argc, argv, "11", &mode, &conn);
+    if (NIL_P(conn)) {
+        CHK(dpiStmt_execute(stmt->handle, rbdpi_to_dpiExecMode(mode), &num_cols));
+    } else {
+        conn_t *c = rbdpi_to_conn(conn);
+        uint64_t start = rbdpi_clock_ns();
+
+        CHK(dpiStmt_execute_without_gvl(c->handle, stmt->handle,
+                                        rbdpi_to_dpiExecMode(mode), &num_cols));
+        c->stats.executes++;
+        c->stats.execute_ns += rbdpi_clock_ns() - start;
+    }
     return UINT2NUM(num_cols);
 }
 
@@ -184,24 +198,49 @@ static VALUE stmt_execute_many(VALUE self, VALUE mode, VALUE num_iters)
     return Qnil;
 }
 
-static VALUE stmt_fetch(VALUE self)
+static VALUE stmt_fetch(int argc, VALUE *argv, VALUE self)
 {
     stmt_t *stmt = rbdpi_to_stmt(self);
+    VALUE conn;
     int found;
     uint32_t index;
 
-    CHK(dpiStmt_fetch(stmt->handle, &found, &index));
+    rb_scan_args(argc, argv, "01", &conn);
+    if (NIL_P(conn)) {
+        CHK(dpiStmt_fetch(stmt->handle, &found, &index));
+    } else {
+        conn_t *c = rbdpi_to_conn(conn);
+        uint64_t start = rbdpi_clock_ns();
+
+        CHK(dpiStmt_fetch_without_gvl(c->handle, stmt->handle, &found, &index));
+        c->stats.fetches++;
+        c->stats.fetch_ns += rbdpi_clock_ns() - start;
+        c->stats.fetched_rows += found ? 1 : 0;
+    }
     return found ? UINT2NUM(index) : Qnil;
 }
 
-static VALUE stmt_fetch_rows(VALUE self, VALUE max_rows)
+static VALUE stmt_fetch_rows(int argc, VALUE *argv, VALUE self)
 {
     stmt_t *stmt = rbdpi_to_stmt(self);
+    VALUE max_rows, conn;
     uint32_t index;
     uint32_t rows;
     int more_rows;
 
-    CHK(dpiStmt_fetchRows(stmt->handle, NUM2UINT(max_rows), &index, &rows, &more_rows));
+    rb_scan_args(argc, argv, "11", &max_rows, &conn);
+    if (NIL_P(conn)) {
+        CHK(dpiStmt_fetchRows(stmt->handle, NUM2UINT(max_rows), &index, &rows, &more_rows));
+    } else {
+        conn_t *c = rbdpi_to_conn(conn);
+        uint64_t start = rbdpi_clock_ns();
+
+        CHK(dpiStmt_fetchRows_without_gvl(c->handle, stmt->handle,
+                                          NUM2UINT(max_rows), &index, &rows, &more_rows));
+        c->stats.fetches++;
+        c->stats.fetch_ns += rbdpi_clock_ns() - start;
+        c->stats.fetched_rows += rows;
+    }
     if (rows) {
         return rb_ary_new_from_args(3, UINT2NUM(index), UINT2NUM(rows), more_rows ? Qtrue : Qfalse);
     } else {
@@ -361,11 +400,15 @@ void Init_rbdpi_stmt(VALUE mDpi)
     rb_define_method(cStmt, "bind_by_name", stmt_bind_by_name, 2);
     rb_define_method(cStmt, "bind_by_pos", stmt_bind_by_pos, 2);
     rb_define_method(cStmt, "close", stmt_close, 1);
+    rb_define_method(cStmt, "copy_from", rbdpi_stmt_copy_from, 5);
+    rb_define_method(cStmt, "copy_from_arrow", rbdpi_stmt_copy_from_arrow, 4);
+    rb_define_method(cStmt, "copy_from_columns", rbdpi_stmt_copy_from_columns, 4);
+    rb_define_method(cStmt, "copy_to", rbdpi_stmt_copy_to, 5);
     rb_define_method(cStmt, "define", stmt_define, 2);
-    rb_define_method(cStmt, "execute", stmt_execute, 1);
+    rb_define_method(cStmt, "execute", stmt_execute, -1);
     rb_define_method(cStmt, "execute_many", stmt_execute_many, 2);
-    rb_define_method(cStmt, "fetch", stmt_fetch, 0);
-    rb_define_method(cStmt, "fetch_rows", stmt_fetch_rows, 1);
+    rb_define_method(cStmt, "fetch", stmt_fetch, -1);
+    rb_define_method(cStmt, "fetch_rows", stmt_fetch_rows, -1);
     rb_define_method(cStmt, "batch_errors", stmt_get_batch_errors, 0);
     rb_define_method(cStmt, "bind_names", stmt_get_bind_names, 0);
     rb_define_method(cStmt, "fetch_array_size", stmt_get_fetch_array_size, 0);
@@ -385,6 +428,7 @@ VALUE rbdpi_from_stmt(dpiStmt *handle, const rbdpi_enc_t *enc)
 
     stmt->handle = handle;
     stmt->enc = *enc;
+    stmt->pid = rbdpi_pid;
     CHK(dpiStmt_getInfo(handle, &stmt->info));
     return obj;
 }
@@ -396,5 +440,8 @@ stmt_t *rbdpi_to_stmt(VALUE obj)
     if (stmt->handle == NULL) {
         rb_raise(rb_eRuntimeError, "%s isn't initialized", rb_obj_classname(obj));
     }
+    if (stmt->pid != rbdpi_pid) {
+        rb_raise(rb_eRuntimeError, "%s was created by the parent process", rb_obj_classname(obj));
+    }
     return stmt;
 }
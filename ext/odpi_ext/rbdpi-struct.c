@@ -638,7 +638,7 @@ VALUE rbdpi_from_dpiErrorInfo(const dpiErrorInfo *error)
     VALUE args[7];
     dpiErrorInfo errbuf;
 
-    if (error == NULL) {
+    if (error == NULL && (error = rbdpi_async_take_error()) == NULL) {
         dpiContext_getError(rbdpi_g_context, &errbuf);
         error = &errbuf;
     }
@@ -45,7 +45,11 @@ static void var_mark(void *arg)
 static void var_free(void *arg)
 {
     var_t *var = (var_t*)arg;
-    dpiVar_release(var->handle);
+
+    /* A handle inherited from the parent process is abandoned. */
+    if (var->handle != NULL && var->pid == rbdpi_pid) {
+        dpiVar_release(var->handle);
+    }
     xfree(arg);
 }
 
@@ -82,8 +86,18 @@ static VALUE var_initialize(VALUE self, VALUE rb_conn, VALUE oracle_type, VALUE
                        &handle, &data));
     var->handle = handle;
     var->enc = conn->enc;
+    var->pid = rbdpi_pid;
     var->oracle_type = oracle_type_num;
     var->native_type = native_type_num;
+    if (native_type_num == DPI_NATIVE_TYPE_BYTES) {
+        /* same as the buffer size computed by ODPI-C */
+        if (RTEST(size_is_bytes)) {
+            var->max_bytes = NUM2UINT(size);
+        } else {
+            rb_encoding *enc = (rb_encoding *)(rbdpi_ora2enc_type(oracle_type_num) == ENC_TYPE_NCHAR ? conn->enc.nenc : conn->enc.enc);
+            var->max_bytes = NUM2UINT(size) * rb_enc_mbmaxlen(enc);
+        }
+    }
     var->objtype = objtype;
     return Qnil;
 }
@@ -212,6 +226,7 @@ VALUE rbdpi_from_var(dpiVar *handle, const rbdpi_enc_t *enc, dpiOracleTypeNum or
 
     var->handle = handle;
     var->enc = *enc;
+    var->pid = rbdpi_pid;
     var->oracle_type = oracle_type;
     var->native_type = native_type;
     var->objtype = objtype;
@@ -224,5 +239,8 @@ var_t *rbdpi_to_var(VALUE obj)
     if (var->handle == NULL) {
         rb_raise(rb_eRuntimeError, "%s isn't initialized", rb_obj_classname(obj));
     }
+    if (var->pid != rbdpi_pid) {
+        rb_raise(rb_eRuntimeError, "%s was created by the parent process", rb_obj_classname(obj));
+    }
     return var;
 }
@@ -33,10 +33,67 @@
  *
  */
 #include "rbdpi.h"
+#include <ruby/thread.h>
 
+/* Created by the first call of rbdpi_context(). Only error handling of
+ * calls which have used the context reads it directly. */
 const dpiContext *rbdpi_g_context;
 VALUE rbdpi_sym_encoding;
 VALUE rbdpi_sym_nencoding;
+rb_pid_t rbdpi_pid;
+static mutex_t context_mutex;
+static rb_pid_t context_pid;
+static double context_init_time = -1.0;
+
+typedef struct {
+    int status;
+    dpiErrorInfo error;
+} create_context_arg_t;
+
+static void *create_context_without_gvl(void *data)
+{
+    create_context_arg_t *arg = (create_context_arg_t *)data;
+    dpiContext *context;
+    uint64_t start;
+
+    arg->status = DPI_SUCCESS;
+    mutex_lock(&context_mutex);
+    /* A context inherited from the parent process is abandoned. */
+    if (rbdpi_g_context == NULL || context_pid != rbdpi_pid) {
+        start = rbdpi_clock_ns();
+        arg->status = dpiContext_create(DPI_MAJOR_VERSION, DPI_MINOR_VERSION, &context, &arg->error);
+        if (arg->status == DPI_SUCCESS) {
+            context_init_time = (rbdpi_clock_ns() - start) / 1e9;
+            context_pid = rbdpi_pid;
+            rbdpi_g_context = context;
+        }
+    }
+    mutex_unlock(&context_mutex);
+    return NULL;
+}
+
+/* Returns the context, loading Oracle client libraries on the first call
+ * in the process. */
+const dpiContext *rbdpi_context(void)
+{
+    create_context_arg_t arg;
+
+    if (rbdpi_g_context != NULL && context_pid == rbdpi_pid) {
+        return rbdpi_g_context;
+    }
+    rb_thread_call_without_gvl(create_context_without_gvl, &arg, NULL, NULL);
+    if (arg.status != DPI_SUCCESS) {
+        rbdpi_raise_error(&arg.error);
+    }
+    return rbdpi_g_context;
+}
+
+#ifndef WIN32
+static void update_pid(void)
+{
+    rbdpi_pid = getpid();
+}
+#endif
 
 VALUE rbdpi_initialize_error(VALUE self)
 {
@@ -49,30 +106,46 @@ static VALUE oracle_client_version(VALUE klass)
 {
     dpiVersionInfo ver;
 
-    CHK(dpiContext_getClientVersion(rbdpi_g_context, &ver));
+    CHK(dpiContext_getClientVersion(rbdpi_context(), &ver));
     return rbdpi_from_dpiVersionInfo(&ver);
 }
 
+/* ODPI::Dpi.context_init_time
+ *
+ * Seconds spent to create the context, or nil before it is created.
+ */
+static VALUE get_context_init_time(VALUE klass)
+{
+    return context_init_time >= 0 ? DBL2NUM(context_init_time) : Qnil;
+}
+
 void
 Init_odpi_ext()
 {
     VALUE mODPI = rb_define_module("ODPI");
     VALUE mDpi = rb_define_module_under(mODPI, "Dpi");
-    dpiErrorInfo error;
-    dpiContext *context;
 
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+    rb_ext_ractor_safe(true);
+#endif
     rbdpi_sym_encoding = ID2SYM(rb_intern("encoding"));
     rbdpi_sym_nencoding = ID2SYM(rb_intern("nencoding"));
 
-    if (dpiContext_create(DPI_MAJOR_VERSION, DPI_MINOR_VERSION, &context, &error) != DPI_SUCCESS) {
-        rb_raise(rb_eLoadError, "%.*s", error.messageLength, error.message);
-    }
-    rbdpi_g_context = context;
+    mutex_init(&context_mutex);
+    rbdpi_pid = getpid();
+#ifndef WIN32
+    pthread_atfork(NULL, NULL, update_pid);
+#endif
 
     rb_define_const(mDpi, "ODPI_C_VERSION", rb_usascii_str_new_cstr(DPI_VERSION_STRING));
     rb_define_singleton_method(mDpi, "oracle_client_version", oracle_client_version, 0);
+    rb_define_singleton_method(mDpi, "context_init_time", get_context_init_time, 0);
 
+    Init_rbdpi_arrow();
+    Init_rbdpi_async(mODPI);
     Init_rbdpi_conn(mDpi);
+    Init_rbdpi_copy_from();
+    Init_rbdpi_copy_to();
     Init_rbdpi_create_params(mODPI);
     Init_rbdpi_data_type(mDpi);
     Init_rbdpi_deq_options(mDpi);
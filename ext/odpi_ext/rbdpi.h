@@ -36,9 +36,18 @@
 #define RBDPI_H 1
 #include <ruby.h>
 #include <ruby/encoding.h>
+#include <time.h>
 #include <dpi.h>
 #include "rbdpi-func.h"
 
+static inline uint64_t rbdpi_clock_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 #define DEFAULT_DRIVER_NAME "ruby-odpi : " RBODPI_VERSION
 
 #ifdef WIN32
@@ -49,6 +58,7 @@
 #define mutex_unlock(mutex) LeaveCriticalSection(&mutex)
 #else
 #include "pthread.h"
+#include <unistd.h>
 #define mutex_t pthread_mutex_t
 #define mutex_init(mutex) pthread_mutex_init(mutex, NULL)
 #define mutex_destroy(mutex) pthread_mutex_destroy(mutex)
@@ -63,10 +73,23 @@ typedef struct {
 
 typedef struct subscr_callback_ctx subscr_callback_ctx_t;
 
+/* Counters of calls on a connection. They are updated with the GVL held
+ * and need no lock. Times are in nanoseconds.
+ */
+typedef struct {
+    uint64_t executes;
+    uint64_t execute_ns;
+    uint64_t fetches;
+    uint64_t fetch_ns;
+    uint64_t fetched_rows;
+} conn_stats_t;
+
 typedef struct {
     dpiConn *handle;
     rbdpi_enc_t enc;
     VALUE tag;
+    conn_stats_t stats;
+    rb_pid_t pid; /* the process which created the handle */
 } conn_t;
 
 /* ODPI::Dpi::DataType
@@ -96,6 +119,7 @@ typedef struct {
     dpiLob *handle;
     rbdpi_enc_t enc;
     dpiOracleTypeNum oracle_type;
+    rb_pid_t pid; /* the process which created the handle */
 } lob_t;
 
 typedef struct {
@@ -126,6 +150,11 @@ typedef struct {
 typedef struct {
     dpiPool *handle;
     rbdpi_enc_t enc;
+    uint64_t acquires;
+    uint64_t acquire_ns;
+    uint64_t session_growth; /* estimate of sessions created; see pool_connection() */
+    uint32_t open_count_seen;
+    rb_pid_t pid; /* the process which created the handle */
 } pool_t;
 
 typedef struct {
@@ -133,6 +162,7 @@ typedef struct {
     rbdpi_enc_t enc;
     dpiStmtInfo info;
     VALUE query_columns_cache;
+    rb_pid_t pid; /* the process which created the handle */
 } stmt_t;
 
 typedef struct {
@@ -150,9 +180,14 @@ typedef struct {
     rbdpi_enc_t enc;
     dpiOracleTypeNum oracle_type;
     dpiNativeTypeNum native_type;
+    uint32_t max_bytes; /* maximum length of a bytes element, 0 if unknown */
     VALUE objtype;
+    rb_pid_t pid; /* the process which created the handle */
 } var_t;
 
+/* dpiStmt_getBatchErrors reports row offsets as uint16_t. */
+#define RBDPI_MAX_BATCH_SIZE 65535
+
 #define rbdpi_raise_error(error) rb_exc_raise(rbdpi_from_dpiErrorInfo(error))
 
 /* Check whether nil or safe string */
@@ -214,13 +249,34 @@ static inline enum enc_type rbdpi_ora2enc_type(dpiOracleTypeNum oratype)
 extern const dpiContext *rbdpi_g_context;
 extern VALUE rbdpi_sym_encoding;
 extern VALUE rbdpi_sym_nencoding;
+extern rb_pid_t rbdpi_pid; /* the current process, cheaper than getpid() */
 VALUE rbdpi_initialize_error(VALUE self);
+const dpiContext *rbdpi_context(void);
+
+/* rbdpi-arrow.c */
+void Init_rbdpi_arrow(void);
+VALUE rbdpi_stmt_copy_to_arrow(VALUE self, VALUE conn, VALUE vars, VALUE io, VALUE format, VALUE params);
+VALUE rbdpi_stmt_copy_from_arrow(VALUE self, VALUE conn, VALUE io, VALUE batch_size, VALUE params);
+VALUE rbdpi_stmt_copy_from_columns(VALUE self, VALUE conn, VALUE columns, VALUE batch_size, VALUE params);
+
+/* rbdpi-async.c */
+void Init_rbdpi_async(VALUE mODPI);
+void *rbdpi_call_without_gvl(void *(*func)(void *), void *arg, rb_unblock_function_t *ubf, void *ubf_arg);
+const dpiErrorInfo *rbdpi_async_take_error(void);
 
 /* rbdpi-conn.c */
 void Init_rbdpi_conn(VALUE mDpi);
 VALUE rbdpi_from_conn(dpiConn *conn, dpiConnCreateParams *params, rbdpi_enc_t *enc);
 conn_t *rbdpi_to_conn(VALUE obj);
 
+/* rbdpi-copy-from.c */
+void Init_rbdpi_copy_from(void);
+VALUE rbdpi_stmt_copy_from(VALUE self, VALUE conn, VALUE vars, VALUE io, VALUE format, VALUE params);
+
+/* rbdpi-copy-to.c */
+void Init_rbdpi_copy_to(void);
+VALUE rbdpi_stmt_copy_to(VALUE self, VALUE conn, VALUE vars, VALUE io, VALUE format, VALUE params);
+
 /* rbdpi-create-params.c */
 void Init_rbdpi_create_params(VALUE mODPI);
 rbdpi_enc_t rbdpi_get_encodings(VALUE params);
@@ -347,6 +403,7 @@ void rbdpi_subscr_start(subscr_t *subscr);
 
 /* rbdpi-var.c */
 void Init_rbdpi_var(VALUE mDpi);
+VALUE rbdpi_from_var(dpiVar *handle, const rbdpi_enc_t *enc, dpiOracleTypeNum oracle_type, dpiNativeTypeNum native_type, VALUE objtype);
 var_t *rbdpi_to_var(VALUE obj);
 
 /* rbdpi-version-info.c */
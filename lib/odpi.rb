@@ -31,11 +31,26 @@
 # or implied, of the authors.
 
 require 'odpi_ext.so'
+require 'odpi/ractor.rb'
 require 'odpi/bindtype.rb'
+require 'odpi/broker.rb'
+require 'odpi/checkout_queue.rb'
+require 'odpi/circuit_breaker.rb'
+require 'odpi/concurrency_limiter.rb'
 require 'odpi/connection.rb'
+require 'odpi/connection_lock.rb'
+require 'odpi/fork.rb'
+require 'odpi/future.rb'
+require 'odpi/health_checker.rb'
+require 'odpi/metrics.rb'
 require 'odpi/object.rb'
+require 'odpi/parallel_query.rb'
 require 'odpi/pool.rb'
+require 'odpi/router.rb'
+require 'odpi/session_affinity.rb'
 require 'odpi/statement.rb'
+require 'odpi/tenant_pools.rb'
+require 'odpi/transaction_guard.rb'
 require 'odpi/version.rb'
 
 module ODPI
@@ -49,6 +64,11 @@ module ODPI
   # [Japanese] ODPI-C incorrectly maps it to 'JA16SJIS'.
   RUBY_TO_ORACLE_ENCODING['Windows-31J'] = 'JA16SJISTILDE'
 
+  # Tables read by all Ractors must be shareable.
+  make_shareable(RUBY_TO_ORACLE_ENCODING)
+  make_shareable(BindType::Mapping)
+  make_shareable(BindType::ObjectAttrMapping)
+
   # @private
   def self.parse_connect_string(conn_str)
     if /^([^(\s|\@)]*)\/([^(\s|\@)]*)(?:\@(\S+))?(?:\s+as\s+(\S*)\s*)?$/i =~ conn_str
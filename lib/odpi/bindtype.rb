@@ -101,21 +101,21 @@ module ODPI
     end
 
     class BinaryDouble < Base
-      TYPES = [:native_double, :double]
+      TYPES = [:native_double, :double].freeze
       def initialize(conn, value, type, params, array_size, is_array)
         super(conn, array_size, 0, false, is_array, nil)
       end
     end
 
     class BinaryFloat < Base
-      TYPES = [:native_float, :float]
+      TYPES = [:native_float, :float].freeze
       def initialize(conn, value, type, params, array_size, is_array)
         super(conn, array_size, 0, false, is_array, nil)
       end
     end
 
     class TimestampBase < Base
-      @@datetime_fsec_base = (1 / ::DateTime.parse('0001-01-01 00:00:00.000000001').sec_fraction).to_i
+      DATETIME_FSEC_BASE = (1 / ::DateTime.parse('0001-01-01 00:00:00.000000001').sec_fraction).to_i
 
       def self.convert_in(conn, val)
         # year
@@ -156,7 +156,7 @@ module ODPI
         end
         # fractional second
         if val.respond_to? :sec_fraction
-          fsec = (val.sec_fraction * @@datetime_fsec_base).to_i
+          fsec = (val.sec_fraction * DATETIME_FSEC_BASE).to_i
         elsif val.respond_to? :nsec
           fsec = val.nsec
         elsif val.respond_to? :usec
@@ -202,35 +202,35 @@ module ODPI
     end
 
     class Date < TimestampBase
-      TYPES = [:date, :timestamp]
+      TYPES = [:date, :timestamp].freeze
       def initialize(conn, value, type, params, array_size, is_array)
         super(conn, array_size, 0, false, is_array, nil)
       end
     end
 
     class Timestamp < TimestampBase
-      TYPES = [:timestamp, :timestamp]
+      TYPES = [:timestamp, :timestamp].freeze
       def initialize(conn, value, type, params, array_size, is_array)
         super(conn, array_size, 0, false, is_array, nil)
       end
     end
 
     class TimestampTZ < TimestampBase
-      TYPES = [:timestamp_tz, :timestamp]
+      TYPES = [:timestamp_tz, :timestamp].freeze
       def initialize(conn, value, type, params, array_size, is_array)
         super(conn, array_size, 0, false, is_array, nil)
       end
     end
 
     class TimestampLTZ < TimestampBase
-      TYPES = [:timestamp_ltz, :timestamp]
+      TYPES = [:timestamp_ltz, :timestamp].freeze
       def initialize(conn, value, type, params, array_size, is_array)
         super(conn, array_size, 0, false, is_array, nil)
       end
     end
 
     class Float < Base
-      TYPES = [:number, :bytes]
+      TYPES = [:number, :bytes].freeze
       def initialize(conn, value, type, params, array_size, is_array)
         super(conn, array_size, 0, false, is_array, nil)
       end
@@ -245,7 +245,7 @@ module ODPI
     end
 
     class Integer < Base
-      TYPES = [:number, :bytes]
+      TYPES = [:number, :bytes].freeze
       def initialize(conn, value, type, params, array_size, is_array)
         super(conn, array_size, 0, false, is_array, nil)
       end
@@ -260,7 +260,7 @@ module ODPI
     end
 
     class Int64 < Base
-      TYPES = [:number, :int64]
+      TYPES = [:number, :int64].freeze
       def initialize(conn, value, type, params, array_size, is_array)
         super(conn, array_size, 0, false, is_array, nil)
       end
@@ -284,7 +284,7 @@ module ODPI
     end
 
     class Raw < Base
-      TYPES = [:raw, :bytes]
+      TYPES = [:raw, :bytes].freeze
       def initialize(conn, value, type, params, array_size, is_array)
         if params.is_a? Hash
           size = params[:length]
@@ -303,14 +303,14 @@ module ODPI
     end
 
     class Rowid < Base
-      TYPES = [:rowid, :rowid]
+      TYPES = [:rowid, :rowid].freeze
       def initialize(conn, value, type, params, array_size, is_array)
         super(conn, array_size, 0, false, is_array, nil)
       end
     end
 
     class String < Base
-      TYPES = [:varchar, :bytes]
+      TYPES = [:varchar, :bytes].freeze
       def initialize(conn, value, type, params, array_size, is_array)
         if params.is_a? Hash
           size = params[:length]
@@ -329,7 +329,7 @@ module ODPI
     end
 
     class Object < Base
-      TYPES = [:object, :object]
+      TYPES = [:object, :object].freeze
       def initialize(conn, value, type, params, array_size, is_array)
         if type.is_a?(Class) && type < ODPI::Object::Base
           objtype = conn.object_type(ODPI::Object.find_name_by_class(type))
@@ -0,0 +1,682 @@
+# broker.rb -- part of ruby-odpi
+#
+# URL: https://github.com/kubo/ruby-odpi
+#
+# ------------------------------------------------------
+#
+# Copyright 2017 Kubo Takehiro <kubo@jiubao.org>
+#
+# Redistribution and use in source and binary forms, with or without modification, are
+# permitted provided that the following conditions are met:
+#
+#    1. Redistributions of source code must retain the above copyright notice, this list of
+#       conditions and the following disclaimer.
+#
+#    2. Redistributions in binary form must reproduce the above copyright notice, this list
+#       of conditions and the following disclaimer in the documentation and/or other materials
+#       provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY EXPRESS OR IMPLIED
+# WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+# FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+# ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+# NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+# ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+# The views and conclusions contained in the software and documentation are those of the
+# authors and should not be interpreted as representing official policies, either expressed
+# or implied, of the authors.
+
+require 'bigdecimal'
+require 'socket'
+require 'stringio'
+
+module ODPI
+  # A broker process owns a pool and runs statements sent by worker
+  # processes of a prefork server over a Unix socket, so the number of
+  # sessions follows the number of concurrent statements rather than
+  # the number of workers.
+  #
+  #   # broker process
+  #   server = ODPI::Broker::Server.new('/run/app/odpi.sock', ODPI::Broker::PoolBackend.new(pool))
+  #   server.run
+  #
+  #   # worker processes
+  #   client = ODPI::Broker::Client.new('/run/app/odpi.sock')
+  #   client.execute('SELECT id, name FROM emp WHERE dept = :1', [10])  # => [[1, 'Scott'], ...]
+  #
+  # Each request is executed on a connection checked out for that request
+  # only, so a transaction can't span requests. Pass <tt>commit: true</tt>
+  # to commit DML before the connection is returned.
+  #
+  # The backend may be any object responding to
+  # <tt>execute(sql, binds, batch_size, commit) { |columns, rows| ... }</tt>.
+  # It yields column names and each batch of rows of a query, at least once,
+  # and returns the row count of other statements. FakeBackend returns
+  # canned results, so the broker and its clients run without a database.
+  module Broker
+    # Raised by Client for errors raised by the backend.
+    class RemoteError < StandardError
+      # Oracle error code, or 0 for other errors.
+      attr_reader :code
+
+      def initialize(code, message)
+        super(message)
+        @code = code
+      end
+    end
+
+    # Raised for malformed frames.
+    class ProtocolError < StandardError; end
+
+    # Frames are a 4-byte big-endian length, which includes the 1-byte
+    # type, followed by the payload. Integers in payloads are little-endian.
+    #
+    # EXECUTE::  flags (bit 0: commit), SQL (u32 length + UTF-8), number of
+    #            binds (u16) and binds, each a name (u8 length, empty for
+    #            positional) and a value.
+    # COLUMNS::  number of columns (u16) and names (u16 length + UTF-8).
+    # BATCH::    number of rows (u32), number of columns (u16) and columns,
+    #            each a type, a validity bitmap (LSB first, set for non-nil)
+    #            and values: int64, float64 or nanoseconds since the epoch
+    #            for INT, FLOAT and TIME; a bitmap for BOOL; u32 offsets
+    #            (rows + 1) and data for STRING, DECIMAL and BINARY;
+    #            nothing for NIL.
+    #
+    # BINARY values are ASCII-8BIT strings, such as RAW and BLOB data,
+    # which are sent as is. Other strings are sent in UTF-8.
+    # DONE::     total number of rows of a query (u64).
+    # COUNT::    row count of other statements (u64).
+    # ERROR::    error code (i32) and message (u32 length + UTF-8).
+    module Protocol
+      EXECUTE = 1
+      COLUMNS = 2
+      BATCH = 3
+      DONE = 4
+      COUNT = 5
+      ERROR = 6
+
+      FLAG_COMMIT = 1
+
+      # Value and column types.
+      NIL = 0
+      INT = 1
+      FLOAT = 2
+      STRING = 3
+      TIME = 4
+      DECIMAL = 5
+      TRUE = 6
+      FALSE = 7
+      BINARY = 8
+      # Column type of true and false.
+      BOOL = 9
+
+      INT64_RANGE = (-2**63)...(2**63)
+
+      # Frames larger than this are rejected.
+      MAX_FRAME_SIZE = 256 * 1024 * 1024
+
+      module_function
+
+      def write_frame(io, type, payload)
+        io.write([payload.bytesize + 1, type].pack('NC') << payload)
+      end
+
+      # Returns +[type, payload]+, or nil at end of stream.
+      def read_frame(io)
+        header = read_exactly(io, 5, true)
+        return nil if header.nil?
+        len, type = header.unpack('NC')
+        raise ProtocolError, "invalid frame length: #{len}" if len < 1 || len > MAX_FRAME_SIZE
+        [type, read_exactly(io, len - 1, false)]
+      end
+
+      def read_exactly(io, len, eof_ok)
+        buf = io.read(len)
+        return buf if buf && buf.bytesize == len
+        return nil if eof_ok && (buf.nil? || buf.empty?)
+        raise ProtocolError, 'unexpected end of stream'
+      end
+
+      def encode_execute(sql, binds, commit)
+        buf = [commit ? FLAG_COMMIT : 0].pack('C')
+        encode_string(buf, sql, 'V')
+        case binds
+        when Hash
+          buf << [binds.length].pack('v')
+          binds.each do |key, val|
+            encode_string(buf, key.to_s, 'C')
+            encode_value(buf, val)
+          end
+        when Array
+          buf << [binds.length].pack('v')
+          binds.each do |val|
+            buf << "\0"
+            encode_value(buf, val)
+          end
+        else
+          buf << [0].pack('v')
+        end
+        buf
+      end
+
+      # Returns +[sql, binds, commit]+. Binds are an Array when positional.
+      def decode_execute(payload)
+        io = StringIO.new(payload)
+        flags = io.read(1).unpack1('C')
+        sql = decode_string(io, 'V', 4)
+        binds = nil
+        io.read(2).unpack1('v').times do
+          name = decode_string(io, 'C', 1)
+          val = decode_value(io)
+          if name.empty?
+            (binds ||= []) << val
+          else
+            (binds ||= {})[name] = val
+          end
+        end
+        [sql, binds, flags & FLAG_COMMIT != 0]
+      end
+
+      def encode_columns(names)
+        buf = [names.length].pack('v')
+        names.each { |name| encode_string(buf, name.to_s, 'v') }
+        buf
+      end
+
+      def decode_columns(payload)
+        io = StringIO.new(payload)
+        Array.new(io.read(2).unpack1('v')) { decode_string(io, 'v', 2) }
+      end
+
+      def encode_batch(rows, num_cols)
+        buf = [rows.length, num_cols].pack('Vv')
+        num_cols.times do |col|
+          vals = rows.collect { |row| row[col] }
+          type = column_type(vals)
+          buf << [type].pack('C')
+          next if type == NIL
+          buf << [vals.collect { |val| val.nil? ? '0' : '1' }.join].pack('b*')
+          case type
+          when INT
+            buf << vals.collect { |val| val || 0 }.pack('q<*')
+          when FLOAT
+            buf << vals.collect { |val| val || 0.0 }.pack('E*')
+          when TIME
+            buf << vals.collect { |val| val ? val.to_i * 1_000_000_000 + val.nsec : 0 }.pack('q<*')
+          when BOOL
+            buf << [vals.collect { |val| val ? '1' : '0' }.join].pack('b*')
+          else
+            strs = vals.collect do |val|
+              case val
+              when nil then ''
+              when BigDecimal then val.to_s('F')
+              when String then type == BINARY ? val : val.encode(Encoding::UTF_8)
+              else val.to_s
+              end
+            end
+            offset = 0
+            offsets = [0] + strs.collect { |str| offset += str.bytesize }
+            buf << offsets.pack('V*')
+            strs.each { |str| buf << str.b }
+          end
+        end
+        buf
+      end
+
+      def decode_batch(payload)
+        io = StringIO.new(payload)
+        num_rows, num_cols = io.read(6).unpack('Vv')
+        columns = Array.new(num_cols) do
+          type = io.read(1).unpack1('C')
+          next Array.new(num_rows) if type == NIL
+          valid = io.read((num_rows + 7) / 8).unpack1('b*')
+          vals = case type
+                 when INT
+                   io.read(num_rows * 8).unpack('q<*')
+                 when FLOAT
+                   io.read(num_rows * 8).unpack('E*')
+                 when TIME
+                   io.read(num_rows * 8).unpack('q<*').collect do |ns|
+                     Time.at(ns / 1_000_000_000, ns % 1_000_000_000, :nsec)
+                   end
+                 when BOOL
+                   io.read((num_rows + 7) / 8).unpack1('b*')[0, num_rows].each_char.collect { |c| c == '1' }
+                 when STRING, DECIMAL, BINARY
+                   offsets = io.read((num_rows + 1) * 4).unpack('V*')
+                   data = io.read(offsets.last) || ''
+                   Array.new(num_rows) do |i|
+                     next if valid[i] == '0'
+                     str = data.byteslice(offsets[i], offsets[i + 1] - offsets[i])
+                     case type
+                     when DECIMAL then BigDecimal(str)
+                     when STRING then str.force_encoding(Encoding::UTF_8)
+                     else str
+                     end
+                   end
+                 else
+                   raise ProtocolError, "unknown column type: #{type}"
+                 end
+          vals.each_index { |i| vals[i] = nil if valid[i] == '0' }
+          vals
+        end
+        columns.empty? ? Array.new(num_rows) { [] } : columns[0].zip(*columns[1..-1])
+      end
+
+      def encode_error(exc)
+        code = exc.respond_to?(:code) && exc.code.is_a?(Integer) ? exc.code : 0
+        buf = [code].pack('l<')
+        encode_string(buf, "#{exc.message} (#{exc.class})", 'V')
+      end
+
+      def decode_error(payload)
+        io = StringIO.new(payload)
+        code = io.read(4).unpack1('l<')
+        RemoteError.new(code, decode_string(io, 'V', 4))
+      end
+
+      def column_type(vals)
+        type = NIL
+        vals.each do |val|
+          t = case val
+              when nil then next
+              when Integer then INT64_RANGE.cover?(val) ? INT : DECIMAL
+              when Float then FLOAT
+              when BigDecimal then DECIMAL
+              when Time then TIME
+              when true, false then BOOL
+              when String then val.encoding == Encoding::BINARY ? BINARY : STRING
+              else STRING
+              end
+          if type == NIL
+            type = t
+          elsif type != t
+            numeric = [INT, FLOAT, DECIMAL]
+            type = if type == BINARY || t == BINARY
+                     BINARY
+                   elsif numeric.include?(type) && numeric.include?(t)
+                     DECIMAL
+                   else
+                     STRING
+                   end
+          end
+        end
+        type
+      end
+
+      def encode_value(buf, val)
+        case val
+        when nil
+          buf << [NIL].pack('C')
+        when Integer
+          if INT64_RANGE.cover?(val)
+            buf << [INT, val].pack('Cq<')
+          else
+            buf << [DECIMAL].pack('C')
+            encode_string(buf, val.to_s, 'V')
+          end
+        when Float
+          buf << [FLOAT, val].pack('CE')
+        when BigDecimal
+          buf << [DECIMAL].pack('C')
+          encode_string(buf, val.to_s('F'), 'V')
+        when Time
+          buf << [TIME, val.to_i * 1_000_000_000 + val.nsec].pack('Cq<')
+        when true
+          buf << [TRUE].pack('C')
+        when false
+          buf << [FALSE].pack('C')
+        when String, Symbol
+          val = val.to_s
+          if val.encoding == Encoding::BINARY
+            buf << [BINARY, val.bytesize].pack('CV') << val
+          else
+            buf << [STRING].pack('C')
+            encode_string(buf, val, 'V')
+          end
+        else
+          raise ArgumentError, "unsupported bind value for the broker: #{val.class}"
+        end
+      end
+
+      def decode_value(io)
+        case type = io.read(1).unpack1('C')
+        when NIL then nil
+        when INT then io.read(8).unpack1('q<')
+        when FLOAT then io.read(8).unpack1('E')
+        when STRING then decode_string(io, 'V', 4)
+        when BINARY then io.read(io.read(4).unpack1('V')) || ''.b
+        when DECIMAL then BigDecimal(decode_string(io, 'V', 4))
+        when TIME
+          ns = io.read(8).unpack1('q<')
+          Time.at(ns / 1_000_000_000, ns % 1_000_000_000, :nsec)
+        when TRUE then true
+        when FALSE then false
+        else raise ProtocolError, "unknown value type: #{type}"
+        end
+      end
+
+      def encode_string(buf, str, len_fmt)
+        str = str.encode(Encoding::UTF_8)
+        buf << [str.bytesize].pack(len_fmt) << str.b
+      end
+
+      def decode_string(io, len_fmt, len_size)
+        len = io.read(len_size).unpack1(len_fmt)
+        (io.read(len) || '').force_encoding(Encoding::UTF_8)
+      end
+    end
+
+    # Runs statements on connections of an ODPI::Pool. +params+ are
+    # passed to Pool#with_connection.
+    class PoolBackend
+      def initialize(pool, **params)
+        @pool = pool
+        @params = params
+      end
+
+      def execute(sql, binds, batch_size, commit)
+        @pool.with_connection(**@params) do |conn|
+          stmt = conn.prepare(sql)
+          begin
+            stmt.fetch_array_size = batch_size
+            case binds
+            when Array
+              binds.each_with_index do |val, idx|
+                stmt.bind(idx + 1, val, bind_type(val))
+              end
+            when Hash
+              binds.each do |key, val|
+                stmt.bind(key, val, bind_type(val))
+              end
+            end
+            stmt.execute
+            unless stmt.query?
+              count = stmt.row_count
+              conn.commit if commit
+              return count
+            end
+            columns = stmt.query_columns.collect(&:name)
+            yielded = false
+            while rows = stmt.fetch_rows(batch_size)
+              yield columns, rows
+              yielded = true
+            end
+            yield columns, [] unless yielded
+            nil
+          ensure
+            stmt.close
+          end
+        end
+      end
+
+      private
+
+      def bind_type(val)
+        :raw if val.is_a?(String) && val.encoding == Encoding::BINARY
+      end
+    end
+
+    # Backend returning canned results, which runs a broker and its
+    # clients without a database, e.g. in tests of applications.
+    #
+    #   backend = ODPI::Broker::FakeBackend.new
+    #   backend.add('SELECT id, name FROM emp', %w[ID NAME], [[1, 'Scott'], [2, 'Adams']])
+    #   backend.add(/\AUPDATE /, 3)
+    #   backend.add('DELETE FROM dept', ODPI::Broker::RemoteError.new(2292, 'ORA-02292'))
+    #
+    # A result is column names and rows of a query, a row count or an
+    # exception to raise. SQL without a canned result is passed to the
+    # block, which returns the same, or raises an ArgumentError.
+    class FakeBackend
+      # Requests received so far as <tt>[sql, binds, commit]</tt>.
+      attr_reader :requests
+
+      def initialize(&block)
+        @block = block
+        @results = []
+        @requests = []
+        @mutex = Mutex.new
+      end
+
+      # +sql+ is a String or a Regexp.
+      def add(sql, columns_or_result, rows = nil)
+        result = rows ? [columns_or_result, rows] : columns_or_result
+        @mutex.synchronize { @results.unshift([sql, result]) }
+        self
+      end
+
+      def execute(sql, binds, batch_size, commit)
+        result = @mutex.synchronize do
+          @requests << [sql, binds, commit]
+          _, res = @results.find { |key, _| key === sql }
+          res
+        end
+        result = @block.call(sql, binds) if result.nil? && @block
+        case result
+        when Integer
+          result
+        when Exception
+          raise result
+        when Array
+          columns, rows = result
+          rows.each_slice(batch_size) { |batch| yield columns, batch }
+          yield columns, [] if rows.empty?
+          nil
+        else
+          raise ArgumentError, "no result for #{sql}"
+        end
+      end
+    end
+
+    # Accepts workers on a Unix socket and serves each one on its own
+    # thread. Requests of a worker connection are run one at a time.
+    class Server
+      attr_reader :path
+
+      def initialize(path, backend, batch_size: 1000, umask: 0o077)
+        @path = path
+        @backend = backend
+        @batch_size = batch_size
+        @umask = umask
+        @server = nil
+        @threads = []
+        @mutex = Mutex.new
+        @clients = 0
+        @requests = 0
+        @errors = 0
+        @active = 0
+      end
+
+      # Listens on the socket, replacing a stale one, and returns self.
+      def start
+        File.unlink(@path) if File.socket?(@path)
+        old_umask = File.umask(@umask)
+        begin
+          @server = UNIXServer.new(@path)
+        ensure
+          File.umask(old_umask)
+        end
+        @acceptor = Thread.new { accept_loop }
+        self
+      end
+
+      # Serves until #stop is called.
+      def run
+        start unless @server
+        @acceptor.join
+      end
+
+      def stats
+        @mutex.synchronize do
+          {clients: @clients, active: @active, requests: @requests, errors: @errors}
+        end
+      end
+
+      def stop
+        server, @server = @server, nil
+        return unless server
+        server.close
+        @acceptor.join
+        threads = @mutex.synchronize { @threads.dup }
+        threads.each do |thread|
+          thread.raise(IOError, 'broker stopped') if thread.alive?
+        end
+        threads.each(&:join)
+        File.unlink(@path) if File.socket?(@path)
+      end
+
+      private
+
+      def accept_loop
+        while server = @server
+          begin
+            sock = server.accept
+          rescue IOError, SystemCallError
+            break
+          end
+          @mutex.synchronize do
+            @clients += 1
+            @threads << Thread.new(sock) { |s| serve(s) }
+          end
+        end
+      end
+
+      def serve(sock)
+        while frame = Protocol.read_frame(sock)
+          type, payload = frame
+          raise ProtocolError, "unexpected frame type: #{type}" if type != Protocol::EXECUTE
+          handle_execute(sock, payload)
+        end
+      rescue IOError, SystemCallError, ProtocolError
+      ensure
+        sock.close unless sock.closed?
+        @mutex.synchronize do
+          @clients -= 1
+          @threads.delete(Thread.current)
+        end
+      end
+
+      def handle_execute(sock, payload)
+        @mutex.synchronize do
+          @requests += 1
+          @active += 1
+        end
+        sql, binds, commit = Protocol.decode_execute(payload)
+        total = 0
+        sent_columns = false
+        count = @backend.execute(sql, binds, @batch_size, commit) do |columns, rows|
+          unless sent_columns
+            Protocol.write_frame(sock, Protocol::COLUMNS, Protocol.encode_columns(columns))
+            sent_columns = true
+          end
+          Protocol.write_frame(sock, Protocol::BATCH, Protocol.encode_batch(rows, columns.length)) unless rows.empty?
+          total += rows.length
+        end
+        if sent_columns
+          Protocol.write_frame(sock, Protocol::DONE, [total].pack('Q<'))
+        else
+          Protocol.write_frame(sock, Protocol::COUNT, [count || 0].pack('Q<'))
+        end
+      rescue IOError, SystemCallError
+        raise
+      rescue StandardError => e
+        @mutex.synchronize { @errors += 1 }
+        # Rows already sent are followed by the error, which the client raises.
+        Protocol.write_frame(sock, Protocol::ERROR, Protocol.encode_error(e))
+      ensure
+        @mutex.synchronize { @active -= 1 }
+      end
+    end
+
+    # Sends statements to a broker. Thread-safe; each concurrent caller
+    # uses its own socket, kept for later requests. Sockets inherited
+    # over fork are discarded.
+    class Client
+      def initialize(path, max_idle: 4)
+        @path = path
+        @max_idle = max_idle
+        @mutex = Mutex.new
+        @idle = []
+        @pid = Process.pid
+      end
+
+      # Executes +sql+ with positional (Array) or named (Hash) +binds+.
+      # Returns rows of a query, or yields each batch of rows and the column
+      # names when a block is given, and returns the row count of other statements.
+      def execute(sql, binds = nil, commit: false, &block)
+        with_socket do |sock|
+          Protocol.write_frame(sock, Protocol::EXECUTE, Protocol.encode_execute(sql, binds, commit))
+          rows = block ? nil : []
+          columns = nil
+          loop do
+            type, payload = Protocol.read_frame(sock)
+            case type
+            when Protocol::COLUMNS
+              columns = Protocol.decode_columns(payload)
+            when Protocol::BATCH
+              batch = Protocol.decode_batch(payload)
+              block ? block.call(batch, columns) : rows.concat(batch)
+            when Protocol::DONE
+              return rows || payload.unpack1('Q<')
+            when Protocol::COUNT
+              return payload.unpack1('Q<')
+            when Protocol::ERROR
+              raise Protocol.decode_error(payload)
+            when nil
+              raise ProtocolError, 'connection closed by the broker'
+            else
+              raise ProtocolError, "unexpected frame type: #{type}"
+            end
+          end
+        end
+      end
+
+      def close
+        socks = @mutex.synchronize { @idle.tap { @idle = [] } }
+        socks.each(&:close)
+      end
+
+      private
+
+      def with_socket
+        sock = checkout
+        begin
+          yield sock
+        rescue RemoteError
+          raise
+        rescue Exception
+          # The rest of the response may be left unread.
+          sock.close
+          sock = nil
+          raise
+        ensure
+          checkin(sock) if sock
+        end
+      end
+
+      def checkout
+        @mutex.synchronize do
+          if @pid != Process.pid
+            @idle.each(&:close)
+            @idle = []
+            @pid = Process.pid
+          end
+          @idle.pop
+        end || UNIXSocket.new(@path)
+      end
+
+      def checkin(sock)
+        sock = @mutex.synchronize do
+          next sock if @pid != Process.pid || @idle.length >= @max_idle
+          @idle.push(sock)
+          nil
+        end
+        sock.close if sock
+      end
+    end
+  end
+end
@@ -0,0 +1,254 @@
+# checkout_queue.rb -- part of ruby-odpi
+#
+# URL: https://github.com/kubo/ruby-odpi
+#
+# ------------------------------------------------------
+#
+# Copyright 2017 Kubo Takehiro <kubo@jiubao.org>
+#
+# Redistribution and use in source and binary forms, with or without modification, are
+# permitted provided that the following conditions are met:
+#
+#    1. Redistributions of source code must retain the above copyright notice, this list of
+#       conditions and the following disclaimer.
+#
+#    2. Redistributions in binary form must reproduce the above copyright notice, this list
+#       of conditions and the following disclaimer in the documentation and/or other materials
+#       provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY EXPRESS OR IMPLIED
+# WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+# FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+# ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+# NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+# ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+# The views and conclusions contained in the software and documentation are those of the
+# authors and should not be interpreted as representing official policies, either expressed
+# or implied, of the authors.
+
+
+module ODPI
+  # Counting semaphore handing out permits to priority classes. Each class
+  # is served in FIFO order, and a released permit goes to the oldest
+  # waiter of the highest-priority class which may take it, so later
+  # arrivals can't overtake threads already waiting.
+  #
+  # +classes+ maps class names to options, highest priority first:
+  # +reserved+ permits which other classes can't take, and +max_share+,
+  # the fraction of +size+ the class may hold at once. The first class is
+  # used when none is given. Without +classes+ there is one class.
+  #
+  # #limit caps permits in use below +size+ and may be changed at any
+  # time, e.g. by ODPI::ConcurrencyLimiter.
+  class CheckoutQueue
+    # Raised when no permit is available within the timeout.
+    class TimeoutError < StandardError; end
+    # Raised when +max_waiters+ threads are already waiting.
+    class QueueFullError < StandardError; end
+
+    Waiter = Struct.new(:cond, :granted)
+
+    PriorityClass = Struct.new(:name, :reserved, :max, :waiters, :in_use,
+                               :waits, :wait_time, :max_wait_time, :timeouts)
+
+    attr_reader :size, :limit
+
+    def initialize(size, max_waiters: nil, classes: nil)
+      @size = size
+      @max_waiters = max_waiters
+      @available = size
+      @limit = size
+      @classes = {}
+      (classes || {default: {}}).each do |name, opts|
+        max = opts[:max_share] ? [(size * opts[:max_share]).floor, 1].max : size
+        @classes[name] = PriorityClass.new(name, opts[:reserved] || 0, max, [], 0, 0, 0.0, 0.0, 0)
+      end
+      if @classes.each_value.sum(&:reserved) > size
+        raise ArgumentError, "reserved permits exceed the size #{size}"
+      end
+      @default_class = @classes.each_value.first
+      @mutex = Mutex.new
+      @checkouts = 0
+      @waits = 0
+      @wait_time = 0.0
+      @max_wait_time = 0.0
+      @timeouts = 0
+      @rejections = 0
+    end
+
+    def class_names
+      @classes.keys
+    end
+
+    # Sets the number of permits which may be in use, between 1 and +size+.
+    # Permits already in use beyond a lowered limit are kept until released.
+    def limit=(limit)
+      @mutex.synchronize do
+        @limit = [[limit, 1].max, @size].min
+        dispatch
+      end
+    end
+
+    # Waits for a permit of +klass+ up to +timeout+ seconds, or forever when nil.
+    def acquire(timeout = nil, klass = nil)
+      @mutex.synchronize do
+        cls = lookup(klass)
+        if cls.waiters.empty? && admissible?(cls)
+          take(cls)
+          @checkouts += 1
+          return
+        end
+        if @max_waiters && num_waiters >= @max_waiters
+          @rejections += 1
+          raise QueueFullError, "#{num_waiters} threads are already waiting for a connection"
+        end
+        started = clock
+        deadline = timeout && started + timeout
+        waiter = Waiter.new(ConditionVariable.new, false)
+        cls.waiters << waiter
+        finished = false
+        begin
+          until waiter.granted
+            if deadline
+              rest = deadline - clock
+              break if rest <= 0
+              waiter.cond.wait(@mutex, rest)
+            else
+              waiter.cond.wait(@mutex)
+            end
+          end
+          finished = true
+        ensure
+          # interrupted by Thread#raise or Thread#kill, which skips rescue
+          unless finished
+            if waiter.granted
+              release_locked(cls)
+            else
+              cls.waiters.delete(waiter)
+            end
+          end
+        end
+        cls.waiters.delete(waiter) unless waiter.granted
+        waited = clock - started
+        @waits += 1
+        @wait_time += waited
+        @max_wait_time = waited if waited > @max_wait_time
+        cls.waits += 1
+        cls.wait_time += waited
+        cls.max_wait_time = waited if waited > cls.max_wait_time
+        unless waiter.granted
+          @timeouts += 1
+          cls.timeouts += 1
+          raise TimeoutError, "no connection available within #{timeout} seconds"
+        end
+        @checkouts += 1
+      end
+    end
+
+    # Takes a permit only when one is free, nobody is waiting and no
+    # reserved permit is needed. Permits taken by this method are returned
+    # by #release_untracked and are not counted in #stats.
+    def try_acquire
+      @mutex.synchronize do
+        return false if num_waiters > 0 || @available <= shortfall(nil) || in_use >= @limit
+        @available -= 1
+        true
+      end
+    end
+
+    def release(klass = nil)
+      @mutex.synchronize do
+        release_locked(lookup(klass))
+      end
+    end
+
+    def release_untracked
+      @mutex.synchronize do
+        @available += 1
+        dispatch
+      end
+    end
+
+    # Returns checkout counts and wait time in seconds of waiters, in total
+    # and by class under +:classes+.
+    def stats
+      @mutex.synchronize do
+        {
+          size: @size,
+          limit: @limit,
+          in_use: in_use,
+          waiting: num_waiters,
+          checkouts: @checkouts,
+          waits: @waits,
+          wait_time: @wait_time,
+          max_wait_time: @max_wait_time,
+          timeouts: @timeouts,
+          rejections: @rejections,
+          classes: @classes.collect do |name, cls|
+            [name, {in_use: cls.in_use, waiting: cls.waiters.length, waits: cls.waits,
+                    wait_time: cls.wait_time, max_wait_time: cls.max_wait_time,
+                    timeouts: cls.timeouts}]
+          end.to_h,
+        }
+      end
+    end
+
+    private
+
+    def lookup(klass)
+      return @default_class if klass.nil?
+      @classes.fetch(klass) do
+        raise ArgumentError, "unknown priority class #{klass.inspect} (expect one of #{@classes.keys.inspect})"
+      end
+    end
+
+    def in_use
+      @size - @available
+    end
+
+    def num_waiters
+      @classes.each_value.sum { |cls| cls.waiters.length }
+    end
+
+    # Number of reserved permits not in use by classes other than +cls+.
+    def shortfall(cls)
+      @classes.each_value.sum do |other|
+        other.equal?(cls) ? 0 : [other.reserved - other.in_use, 0].max
+      end
+    end
+
+    def admissible?(cls)
+      in_use < @limit && cls.in_use < cls.max && @available > shortfall(cls)
+    end
+
+    def take(cls)
+      @available -= 1
+      cls.in_use += 1
+    end
+
+    def release_locked(cls)
+      cls.in_use -= 1
+      @available += 1
+      dispatch
+    end
+
+    # Grants permits to the oldest waiters of the highest-priority classes
+    # which may take them.
+    def dispatch
+      while cls = @classes.each_value.find { |c| !c.waiters.empty? && admissible?(c) }
+        waiter = cls.waiters.shift
+        take(cls)
+        waiter.granted = true
+        waiter.cond.signal
+      end
+    end
+
+    def clock
+      Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    end
+  end
+end
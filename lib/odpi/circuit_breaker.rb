@@ -0,0 +1,188 @@
+# circuit_breaker.rb -- part of ruby-odpi
+#
+# URL: https://github.com/kubo/ruby-odpi
+#
+# ------------------------------------------------------
+#
+# Copyright 2017 Kubo Takehiro <kubo@jiubao.org>
+#
+# Redistribution and use in source and binary forms, with or without modification, are
+# permitted provided that the following conditions are met:
+#
+#    1. Redistributions of source code must retain the above copyright notice, this list of
+#       conditions and the following disclaimer.
+#
+#    2. Redistributions in binary form must reproduce the above copyright notice, this list
+#       of conditions and the following disclaimer in the documentation and/or other materials
+#       provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY EXPRESS OR IMPLIED
+# WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+# FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+# ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+# NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+# ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+# The views and conclusions contained in the software and documentation are those of the
+# authors and should not be interpreted as representing official policies, either expressed
+# or implied, of the authors.
+
+
+module ODPI
+  # Fails connection attempts fast while the database is unreachable.
+  #
+  # After +failure_threshold+ consecutive failures with +error_codes+, the
+  # breaker opens and #run raises OpenError without calling the block.
+  # After +reset_timeout+ seconds one caller is let through as a probe
+  # (half-open); the breaker closes when it succeeds and opens again when
+  # it fails. Other errors, such as invalid passwords, show that the
+  # database is reachable and count as successes.
+  #
+  # +on_state_change+ is called with the old and new states, which are
+  # +:closed+, +:open+ and +:half_open+.
+  class CircuitBreaker
+    # Raised while the breaker is open.
+    class OpenError < StandardError; end
+
+    # ORA- error codes of unreachable listeners, instances and networks.
+    CONNECTION_ERROR_CODES = [
+      1033,  # ORACLE initialization or shutdown in progress
+      1034,  # ORACLE not available
+      1089,  # immediate shutdown in progress
+      3113,  # end-of-file on communication channel
+      3114,  # not connected to ORACLE
+      3135,  # connection lost contact
+      12170, # TNS:Connect timeout occurred
+      12505, # TNS:listener does not currently know of SID
+      12514, # TNS:listener does not currently know of service
+      12516, # TNS:listener could not find available handler
+      12520, # TNS:listener could not find available handler for requested type of server
+      12528, # TNS:listener: all appropriate instances are blocking new connections
+      12537, # TNS:connection closed
+      12541, # TNS:no listener
+      12543, # TNS:destination host unreachable
+      12545, # Connect failed because target host or object does not exist
+      12547, # TNS:lost contact
+      12560, # TNS:protocol adapter error
+      12571, # TNS:packet writer failure
+    ].freeze
+
+    attr_reader :state
+
+    def initialize(failure_threshold: 5, reset_timeout: 10, error_codes: CONNECTION_ERROR_CODES,
+                   on_state_change: nil)
+      @failure_threshold = failure_threshold
+      @reset_timeout = reset_timeout
+      @error_codes = error_codes
+      @on_state_change = on_state_change
+      @mutex = Mutex.new
+      @state = :closed
+      @failures = 0
+      @opened_at = nil
+      @probing = false
+      @rejections = 0
+    end
+
+    # Returns a breaker for the +circuit_breaker+ parameter of
+    # ODPI.connect and ODPI::Pool.new.
+    # @private
+    def self.from_param(param)
+      case param
+      when nil, false then nil
+      when true then new
+      when Hash then new(**param)
+      else param
+      end
+    end
+
+    # Runs the block unless the breaker is open.
+    def run
+      notify(@mutex.synchronize { admit })
+      outcome = nil
+      begin
+        result = yield
+        outcome = :success
+      rescue Dpi::Error => e
+        outcome = @error_codes.include?(e.code) ? :failure : :success
+        raise
+      ensure
+        # Other errors and Thread#kill, which skips rescue, only end a probe.
+        notify(@mutex.synchronize do
+          case outcome
+          when :success
+            success
+          when :failure
+            failure
+          else
+            @probing = false
+            nil
+          end
+        end)
+      end
+      result
+    end
+
+    def stats
+      @mutex.synchronize do
+        {state: @state, failures: @failures, rejections: @rejections}
+      end
+    end
+
+    private
+
+    # The following methods are called with the mutex held and return
+    # a state transition to be notified, or nil.
+
+    def admit
+      case @state
+      when :closed
+        nil
+      when :open
+        if clock - @opened_at < @reset_timeout
+          @rejections += 1
+          raise OpenError, "circuit breaker is open after #{@failures} connection failures"
+        end
+        @probing = true
+        transition(:half_open)
+      when :half_open
+        if @probing
+          @rejections += 1
+          raise OpenError, "circuit breaker is half-open and probing"
+        end
+        @probing = true
+        nil
+      end
+    end
+
+    def success
+      @failures = 0
+      @probing = false
+      @state == :closed ? nil : transition(:closed)
+    end
+
+    def failure
+      @failures += 1
+      @probing = false
+      if @state == :half_open || (@state == :closed && @failures >= @failure_threshold)
+        @opened_at = clock
+        transition(:open)
+      end
+    end
+
+    def transition(state)
+      from, @state = @state, state
+      [from, state]
+    end
+
+    def notify(change)
+      @on_state_change.call(*change) if change && @on_state_change
+    end
+
+    def clock
+      Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    end
+  end
+end
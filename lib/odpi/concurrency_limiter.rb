@@ -0,0 +1,101 @@
+# concurrency_limiter.rb -- part of ruby-odpi
+#
+# URL: https://github.com/kubo/ruby-odpi
+#
+# ------------------------------------------------------
+#
+# Copyright 2017 Kubo Takehiro <kubo@jiubao.org>
+#
+# Redistribution and use in source and binary forms, with or without modification, are
+# permitted provided that the following conditions are met:
+#
+#    1. Redistributions of source code must retain the above copyright notice, this list of
+#       conditions and the following disclaimer.
+#
+#    2. Redistributions in binary form must reproduce the above copyright notice, this list
+#       of conditions and the following disclaimer in the documentation and/or other materials
+#       provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY EXPRESS OR IMPLIED
+# WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+# FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+# ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+# NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+# ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+# The views and conclusions contained in the software and documentation are those of the
+# authors and should not be interpreted as representing official policies, either expressed
+# or implied, of the authors.
+
+
+module ODPI
+  # Adjusts the number of sessions a pool hands out at once by additive
+  # increase and multiplicative decrease (AIMD) of the ODPI::CheckoutQueue
+  # limit, so that more concurrency isn't added when the database slows down.
+  #
+  # Each returned connection reports its average execute latency. When it
+  # exceeds +tolerance+ times the baseline, the lowest latency seen recently,
+  # the limit is multiplied by +backoff+, at most once per +cooldown+
+  # seconds. Otherwise, while the limit is fully used, it grows by one per
+  # limit's worth of samples. Requests beyond the limit wait in the queue
+  # and are rejected beyond +max_waiters+ of the pool.
+  class ConcurrencyLimiter
+    def initialize(checkout_queue, min_limit: 1, max_limit: nil, initial_limit: nil,
+                   tolerance: 2.0, backoff: 0.9, cooldown: 1.0)
+      @checkout_queue = checkout_queue
+      @min_limit = min_limit
+      @max_limit = max_limit || checkout_queue.size
+      @limit = (initial_limit || @max_limit).to_f
+      @tolerance = tolerance
+      @backoff = backoff
+      @cooldown = cooldown
+      @baseline = nil
+      @decreased_at = nil
+      @mutex = Mutex.new
+      @checkout_queue.limit = @limit.floor
+    end
+
+    # Feeds the counters of a returned connection (see Dpi::Conn#stats).
+    def observe(conn_stats)
+      return if conn_stats[:executes] == 0
+      observe_latency(conn_stats[:execute_time] / conn_stats[:executes])
+    end
+
+    def observe_latency(latency)
+      @mutex.synchronize do
+        # the baseline follows drops at once and rises slowly
+        @baseline = if @baseline.nil? || latency < @baseline
+                      latency
+                    else
+                      @baseline + 0.01 * (latency - @baseline)
+                    end
+        now = clock
+        if latency > @baseline * @tolerance
+          return if @decreased_at && now - @decreased_at < @cooldown
+          @decreased_at = now
+          @limit = [@limit * @backoff, @min_limit].max
+        elsif @checkout_queue.stats[:in_use] >= @limit.floor
+          @limit = [@limit + 1.0 / @limit, @max_limit].min
+        else
+          return
+        end
+        @checkout_queue.limit = @limit.floor
+      end
+    end
+
+    def stats
+      @mutex.synchronize do
+        {limit: @limit.floor, baseline_latency: @baseline}
+      end
+    end
+
+    private
+
+    def clock
+      Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    end
+  end
+end
@@ -45,30 +45,146 @@ module ODPI
     else
       username, password, database, auth_mode = args
     end
-    Connection.new(Dpi::Conn.new(username, password, database, auth_mode, params), true)
+    params = params.dup
+    thread_safe = params.delete(:thread_safe)
+    breaker = CircuitBreaker.from_param(params.delete(:circuit_breaker))
+    create = lambda do
+      Dpi::Conn.new(username, password, database, auth_mode, params)
+    end
+    Connection.new(breaker ? breaker.run(&create) : create.call, true, thread_safe)
   end
 
   class Connection
-    def initialize(conn, is_standalone)
+    # When +thread_safe+ is true, calls on this connection and its statements
+    # are serialized so that threads can share it. +on_close+ is called
+    # once when a pooled connection is closed.
+    def initialize(conn, is_standalone, thread_safe = false, on_close = nil)
       @conn = conn
       @is_standalone = is_standalone
+      @lock = thread_safe ? ConnectionLock.new : nil
+      @on_close = on_close
+      @on_prepare = nil
+      @tag = nil
+    end
+
+    # @private
+    attr_accessor :on_prepare
+
+    # The tag of the session acquired from a pool.
+    def tag
+      @conn.tag
+    end
+
+    # Sets the tag given to the session when it is returned to the pool.
+    def tag=(tag)
+      @tag = tag
+    end
+
+    # Returns counts and seconds of execute and fetch calls on this connection.
+    def stats
+      @conn.stats
+    end
+
+    def thread_safe?
+      !@lock.nil?
+    end
+
+    # Returns the statistics of ODPI::ConnectionLock, or nil unless thread-safe.
+    def lock_stats
+      @lock && @lock.stats
     end
 
     def close
-      @conn.close(nil, nil)
+      if @tag
+        close_session(:retag, @tag)
+      else
+        close_session(nil, nil)
+      end
+    end
+
+    # Closes the connection and drops the session from the pool instead
+    # of returning it, e.g. when its state is unknown.
+    def drop
+      close_session(@is_standalone ? nil : :drop, nil)
+    end
+
+    def commit
+      synchronize { @conn.commit }
+    end
+
+    def rollback
+      synchronize { @conn.rollback }
     end
 
     def new_subscription(params)
-      @conn.new_subscription(params)
+      synchronize { @conn.new_subscription(params) }
     end
 
+    # Note that calls on the returned object are not serialized.
     def raw_connection
       @conn
     end
 
     def prepare(sql, scrollable: false, tag: nil)
-      stmt = @conn.prepare_stmt(scrollable, sql, tag)
-      Statement.new(@conn, stmt)
+      synchronize do
+        stmt = @conn.prepare_stmt(scrollable, sql, tag)
+        @on_prepare.call(sql) if @on_prepare
+        Statement.new(@conn, stmt, @lock)
+      end
+    end
+
+    # Runs the block with the connection lock held in thread-safe mode.
+    def synchronize
+      @lock ? @lock.synchronize { yield } : yield
+    end
+
+    # Executes +sql+ on a worker thread and returns an ODPI::Future whose
+    # value is the array of fetched rows, or the row count for non-queries.
+    # +binds+ is an array of positional values or a hash keyed by names.
+    # Unless thread-safe, don't use this connection until the future is complete.
+    def execute_async(sql, binds = nil, deadline: nil)
+      Future.execute(self, deadline: deadline) do
+        execute_and_fetch(sql, binds)
+      end
+    end
+
+    # @private
+    def execute_and_fetch(sql, binds)
+      synchronize { execute_and_fetch_unlocked(sql, binds) }
+    end
+
+    private
+
+    def close_session(mode, tag)
+      synchronize { @conn.close(mode, tag) }
+    ensure
+      on_close, @on_close = @on_close, nil
+      on_close.call if on_close
+    end
+
+    def execute_and_fetch_unlocked(sql, binds)
+      stmt = prepare(sql)
+      begin
+        case binds
+        when Array
+          binds.each_with_index do |val, idx|
+            stmt.bind(idx + 1, val)
+          end
+        when Hash
+          binds.each do |key, val|
+            stmt.bind(key, val)
+          end
+        end
+        stmt.execute
+        return stmt.row_count unless stmt.query?
+        rows = []
+        while batch = stmt.fetch_rows
+          rows.concat(batch)
+        end
+        rows
+      ensure
+        stmt.close
+      end
     end
   end # Connection
 end
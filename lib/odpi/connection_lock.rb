@@ -0,0 +1,80 @@
+# connection_lock.rb -- part of ruby-odpi
+#
+# URL: https://github.com/kubo/ruby-odpi
+#
+# ------------------------------------------------------
+#
+# Copyright 2017 Kubo Takehiro <kubo@jiubao.org>
+#
+# Redistribution and use in source and binary forms, with or without modification, are
+# permitted provided that the following conditions are met:
+#
+#    1. Redistributions of source code must retain the above copyright notice, this list of
+#       conditions and the following disclaimer.
+#
+#    2. Redistributions in binary form must reproduce the above copyright notice, this list
+#       of conditions and the following disclaimer in the documentation and/or other materials
+#       provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY EXPRESS OR IMPLIED
+# WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+# FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+# ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+# NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+# ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+# The views and conclusions contained in the software and documentation are those of the
+# authors and should not be interpreted as representing official policies, either expressed
+# or implied, of the authors.
+
+
+require 'monitor'
+
+module ODPI
+  # Reentrant lock serializing calls on a connection shared by threads.
+  # Waiting threads sleep without holding the GVL. The time spent waiting
+  # is recorded for #stats.
+  class ConnectionLock
+    def initialize
+      @monitor = Monitor.new
+      @acquisitions = 0
+      @contentions = 0
+      @wait_time = 0.0
+      @max_wait_time = 0.0
+    end
+
+    def synchronize
+      return yield if @monitor.mon_owned?
+      unless @monitor.try_enter
+        started = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+        @monitor.enter
+        waited = Process.clock_gettime(Process::CLOCK_MONOTONIC) - started
+        @contentions += 1
+        @wait_time += waited
+        @max_wait_time = waited if waited > @max_wait_time
+      end
+      begin
+        @acquisitions += 1
+        yield
+      ensure
+        @monitor.exit
+      end
+    end
+
+    # Returns counts of acquisitions and of acquisitions which had to wait,
+    # and the total and maximum wait time in seconds.
+    def stats
+      @monitor.synchronize do
+        {
+          acquisitions: @acquisitions,
+          contentions: @contentions,
+          wait_time: @wait_time,
+          max_wait_time: @max_wait_time,
+        }
+      end
+    end
+  end
+end
@@ -0,0 +1,78 @@
+# fork.rb -- part of ruby-odpi
+#
+# URL: https://github.com/kubo/ruby-odpi
+#
+# ------------------------------------------------------
+#
+# Copyright 2017 Kubo Takehiro <kubo@jiubao.org>
+#
+# Redistribution and use in source and binary forms, with or without modification, are
+# permitted provided that the following conditions are met:
+#
+#    1. Redistributions of source code must retain the above copyright notice, this list of
+#       conditions and the following disclaimer.
+#
+#    2. Redistributions in binary form must reproduce the above copyright notice, this list
+#       of conditions and the following disclaimer in the documentation and/or other materials
+#       provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY EXPRESS OR IMPLIED
+# WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+# FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+# ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+# NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+# ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+# The views and conclusions contained in the software and documentation are those of the
+# authors and should not be interpreted as representing official policies, either expressed
+# or implied, of the authors.
+
+
+module ODPI
+  # Support of forking servers such as Unicorn and Puma in clustered mode.
+  #
+  # Sessions, pools and the ODPI-C context inherited from the parent
+  # process can't be used in a child. The extension refuses calls on
+  # inherited Dpi::Conn and Dpi::Pool and abandons them without closing,
+  # which would send messages on sockets shared with the parent. Pools
+  # open again on the next checkout in the child, or at once by
+  # ODPI.after_fork.
+
+  # @private
+  def self.register_pool(pool)
+    ractor_local(:odpi_pools) { ObjectSpace::WeakMap.new }[pool] = true
+  end
+
+  # Resets state whose threads didn't survive fork. Called in the child
+  # by Process._fork on Ruby 3.1 or later.
+  # @private
+  def self.forked
+    clear_ractor_local(:odpi_future_executor)
+    clear_ractor_local(:odpi_future_deadlines)
+  end
+
+  # Opens all pools again in a forked child process, in parallel, and
+  # repeats their last Pool#warm_up. Call it where the server starts a
+  # worker, such as +on_worker_boot+ of Puma or +after_fork+ of Unicorn.
+  def self.after_fork
+    forked
+    pools = ractor_local(:odpi_pools) { ObjectSpace::WeakMap.new }.keys
+    pools.collect do |pool|
+      Thread.new { pool.reopen_after_fork(warm_up: true) }
+    end.each(&:value)
+    nil
+  end
+
+  # @private
+  module ForkHook
+    def _fork
+      pid = super
+      ODPI.forked if pid == 0
+      pid
+    end
+  end
+  Process.singleton_class.prepend(ForkHook) if Process.respond_to?(:_fork)
+end
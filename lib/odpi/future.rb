@@ -0,0 +1,282 @@
+# future.rb -- part of ruby-odpi
+#
+# URL: https://github.com/kubo/ruby-odpi
+#
+# ------------------------------------------------------
+#
+# Copyright 2017 Kubo Takehiro <kubo@jiubao.org>
+#
+# Redistribution and use in source and binary forms, with or without modification, are
+# permitted provided that the following conditions are met:
+#
+#    1. Redistributions of source code must retain the above copyright notice, this list of
+#       conditions and the following disclaimer.
+#
+#    2. Redistributions in binary form must reproduce the above copyright notice, this list
+#       of conditions and the following disclaimer in the documentation and/or other materials
+#       provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY EXPRESS OR IMPLIED
+# WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+# FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+# ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+# NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+# ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+# The views and conclusions contained in the software and documentation are those of the
+# authors and should not be interpreted as representing official policies, either expressed
+# or implied, of the authors.
+
+
+module ODPI
+  # Result of a block run on a worker thread, such as a query executed
+  # by Connection#execute_async. The GVL is released while the worker
+  # waits for the server, so several futures on different connections
+  # overlap their round trips.
+  #
+  # A future with +deadline+ (seconds) is cancelled when it isn't complete
+  # by then. Cancelling a running future breaks the current call on its
+  # connection by <tt>dpiConn_breakExecution</tt>.
+  class Future
+    class Cancelled < StandardError; end
+    class DeadlineExceeded < Cancelled; end
+
+    # Maximum number of worker threads used by futures in each Ractor.
+    @max_threads = 16
+
+    class << self
+      attr_accessor :max_threads
+
+      def execute(conn = nil, deadline: nil, &block)
+        future = new(conn, deadline: deadline, &block)
+        executor.post(future)
+        future
+      end
+
+      # @private
+      def executor
+        ODPI.ractor_local(:odpi_future_executor) { Executor.new(Future.max_threads) }
+      end
+
+      # @private
+      def deadlines
+        ODPI.ractor_local(:odpi_future_deadlines) { Deadlines.new }
+      end
+
+      # @private
+      def clock
+        Process.clock_gettime(Process::CLOCK_MONOTONIC)
+      end
+    end
+
+    # The block is called with the future. +conn+ is the ODPI::Connection
+    # broken on cancellation. It may be set later by #connection=.
+    def initialize(conn = nil, deadline: nil, &block)
+      @conn = conn
+      @block = block
+      @mutex = Mutex.new
+      @cond = ConditionVariable.new
+      @state = :pending
+      @value = nil
+      @error = nil
+      @cancel_error = nil
+      @breaking = false
+      @deadline = deadline
+      Future.deadlines.add(self, Future.clock + deadline) if deadline
+    end
+
+    # Raises the cancellation error when +conn+ is set after the future
+    # was cancelled, e.g. while the block waited for a pool checkout.
+    def connection=(conn)
+      error = @mutex.synchronize do
+        # Don't return the connection while #cancel breaks its call.
+        @cond.wait(@mutex) while @breaking
+        @conn = conn
+        conn && @cancel_error
+      end
+      raise error if error
+    end
+
+    # @private
+    def run
+      @mutex.synchronize do
+        return unless @state == :pending
+        @state = :running
+      end
+      begin
+        value = @block.call(self)
+        # The block may finish before the cancellation breaks it.
+        error = @mutex.synchronize { @cancel_error }
+        if error
+          complete(:failed, nil, error)
+        else
+          complete(:done, value, nil)
+        end
+      rescue Exception => e
+        complete(:failed, nil, @cancel_error || e)
+      end
+    end
+
+    def done?
+      @state == :done || @state == :failed
+    end
+
+    # Waits for the future. Returns false when +timeout+ seconds elapse first.
+    def wait(timeout = nil)
+      @mutex.synchronize do
+        deadline = timeout && Future.clock + timeout
+        until done?
+          if deadline
+            rest = deadline - Future.clock
+            return false if rest <= 0
+            @cond.wait(@mutex, rest)
+          else
+            @cond.wait(@mutex)
+          end
+        end
+      end
+      true
+    end
+
+    # Returns the result, raising the exception if the block failed.
+    # Returns nil when +timeout+ seconds elapse first.
+    def value(timeout = nil)
+      return nil unless wait(timeout)
+      raise @error if @state == :failed
+      @value
+    end
+
+    # Returns true unless the future is already complete.
+    def cancel(error = Cancelled.new("cancelled"))
+      conn = @mutex.synchronize do
+        case @state
+        when :pending
+          @state = :failed
+          @error = error
+          @cond.broadcast
+          return true
+        when :running
+          return true if @cancel_error
+          @cancel_error = error
+          @breaking = true if @conn
+          @conn
+        else
+          return false
+        end
+      end
+      # The break is a round trip, so it's made without the mutex held.
+      begin
+        conn.raw_connection.break if conn
+      ensure
+        if conn
+          @mutex.synchronize do
+            @breaking = false
+            @cond.broadcast
+          end
+        end
+      end
+      true
+    end
+
+    private
+
+    def complete(state, value, error)
+      @mutex.synchronize do
+        @state = state
+        @value = value
+        @error = error
+        @cond.broadcast
+      end
+      Future.deadlines.delete(self) if @deadline
+    end
+
+    # Threads started on demand up to +max_threads+, then reused.
+    class Executor
+      def initialize(max_threads)
+        @max_threads = max_threads
+        @queue = Queue.new
+        @mutex = Mutex.new
+        @threads = []
+        @num_idle = 0
+        @num_pending = 0
+      end
+
+      def post(future)
+        @mutex.synchronize do
+          @num_pending += 1
+          if @num_pending > @num_idle && @threads.length < @max_threads
+            @num_idle += 1
+            @threads << Thread.new { work }
+          end
+        end
+        @queue << future
+      end
+
+      private
+
+      def work
+        loop do
+          future = @queue.pop
+          @mutex.synchronize do
+            @num_idle -= 1
+            @num_pending -= 1
+          end
+          future.run
+          @mutex.synchronize { @num_idle += 1 }
+        end
+      end
+    end
+
+    # A thread cancelling futures whose deadlines have passed.
+    class Deadlines
+      def initialize
+        @mutex = Mutex.new
+        @cond = ConditionVariable.new
+        @entries = []
+        @thread = nil
+      end
+
+      def add(future, at)
+        @mutex.synchronize do
+          idx = @entries.bsearch_index { |entry| entry[0] > at } || @entries.length
+          @entries.insert(idx, [at, future])
+          @thread ||= Thread.new { run }
+          @cond.signal
+        end
+      end
+
+      def delete(future)
+        @mutex.synchronize do
+          @entries.delete_if { |entry| entry[1].equal? future }
+        end
+      end
+
+      private
+
+      def run
+        loop do
+          expired = []
+          @mutex.synchronize do
+            loop do
+              rest = @entries.empty? ? nil : @entries[0][0] - Future.clock
+              break if rest && rest <= 0
+              @cond.wait(@mutex, rest)
+            end
+            expired << @entries.shift[1] while !@entries.empty? && @entries[0][0] <= Future.clock
+          end
+          expired.each do |future|
+            begin
+              future.cancel(DeadlineExceeded.new("deadline exceeded"))
+            rescue StandardError
+              # e.g. the session is dead. The future fails with the error
+              # anyway, and later deadlines must still fire.
+            end
+          end
+        end
+      end
+    end
+  end
+end
@@ -0,0 +1,148 @@
+# health_checker.rb -- part of ruby-odpi
+#
+# URL: https://github.com/kubo/ruby-odpi
+#
+# ------------------------------------------------------
+#
+# Copyright 2017 Kubo Takehiro <kubo@jiubao.org>
+#
+# Redistribution and use in source and binary forms, with or without modification, are
+# permitted provided that the following conditions are met:
+#
+#    1. Redistributions of source code must retain the above copyright notice, this list of
+#       conditions and the following disclaimer.
+#
+#    2. Redistributions in binary form must reproduce the above copyright notice, this list
+#       of conditions and the following disclaimer in the documentation and/or other materials
+#       provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY EXPRESS OR IMPLIED
+# WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+# FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+# ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+# NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+# ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+# The views and conclusions contained in the software and documentation are those of the
+# authors and should not be interpreted as representing official policies, either expressed
+# or implied, of the authors.
+
+
+module ODPI
+  # Pings idle sessions of a pool on a background thread and drops dead
+  # ones before they are handed out, so that checkouts don't need a round
+  # trip to validate sessions.
+  #
+  # ODPI-C can't enumerate sessions in a pool. The checker looks at the
+  # number of idle sessions every +interval+ seconds and, once some have
+  # stayed idle for +idle_time+ seconds, checks out all idle sessions that
+  # no thread is waiting for, pings them with the GVL released and closes
+  # dead ones with DPI_MODE_CONN_CLOSE_DROP.
+  class HealthChecker
+    def initialize(pool, checkout_queue, idle_time:, interval: nil)
+      @pool = pool
+      @checkout_queue = checkout_queue
+      @idle_time = idle_time
+      @interval = interval || idle_time / 2.0
+      @mutex = Mutex.new
+      @cond = ConditionVariable.new
+      @stopped = false
+      @idle_since = nil
+      @checks = 0
+      @pinged = 0
+      @dropped = 0
+      @last_error = nil
+      @thread = Thread.new { run }
+    end
+
+    def stop
+      @mutex.synchronize do
+        @stopped = true
+        @cond.signal
+      end
+      @thread.join
+    end
+
+    # Returns counts of sweeps, pinged sessions and dropped sessions,
+    # and the last error raised while checking.
+    def stats
+      {checks: @checks, pinged: @pinged, dropped: @dropped, last_error: @last_error}
+    end
+
+    private
+
+    def run
+      until wait_interval
+        begin
+          check if idle_too_long?
+        rescue StandardError => e
+          @last_error = e
+        end
+      end
+    end
+
+    # Returns true when stopped.
+    def wait_interval
+      @mutex.synchronize do
+        @cond.wait(@mutex, @interval) unless @stopped
+        @stopped
+      end
+    end
+
+    def idle_too_long?
+      now = clock
+      if @pool.open_count > @pool.busy_count
+        @idle_since ||= now
+        now - @idle_since >= @idle_time
+      else
+        @idle_since = nil
+        false
+      end
+    end
+
+    def check
+      conns = []
+      dead = []
+      begin
+        (@pool.open_count - @pool.busy_count).times do
+          break unless @checkout_queue.try_acquire
+          conn = nil
+          begin
+            conn = @pool.connection(nil, nil, nil, {})
+          ensure
+            # also reached by Thread#kill, which skips rescue
+            @checkout_queue.release_untracked unless conn
+          end
+          conns << conn
+        end
+        conns.each do |conn|
+          @pinged += 1
+          begin
+            conn.ping
+          rescue StandardError
+            @dropped += 1
+            dead << conn
+          end
+        end
+      ensure
+        conns.each do |conn|
+          begin
+            conn.close(dead.include?(conn) ? :drop : nil, nil)
+          rescue StandardError
+          ensure
+            @checkout_queue.release_untracked
+          end
+        end
+        @checks += 1
+        @idle_since = clock
+      end
+    end
+
+    def clock
+      Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    end
+  end
+end
@@ -0,0 +1,209 @@
+# metrics.rb -- part of ruby-odpi
+#
+# URL: https://github.com/kubo/ruby-odpi
+#
+# ------------------------------------------------------
+#
+# Copyright 2017 Kubo Takehiro <kubo@jiubao.org>
+#
+# Redistribution and use in source and binary forms, with or without modification, are
+# permitted provided that the following conditions are met:
+#
+#    1. Redistributions of source code must retain the above copyright notice, this list of
+#       conditions and the following disclaimer.
+#
+#    2. Redistributions in binary form must reproduce the above copyright notice, this list
+#       of conditions and the following disclaimer in the documentation and/or other materials
+#       provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY EXPRESS OR IMPLIED
+# WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+# FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+# ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+# NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+# ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+# The views and conclusions contained in the software and documentation are those of the
+# authors and should not be interpreted as representing official policies, either expressed
+# or implied, of the authors.
+
+
+module ODPI
+  # Registry of pool metrics, rendered as a Hash by #snapshot or in the
+  # Prometheus text exposition format by #to_prometheus.
+  #
+  # Pools register themselves with ODPI::Metrics.default under their +name+.
+  # Gauges and counters kept in the C extension are read at scrape time.
+  # Checkout wait times by priority class and hold times are recorded in
+  # histograms, and counters
+  # of execute and fetch calls are added up when connections are returned.
+  class Metrics
+    # Upper bounds in seconds of histogram buckets.
+    BUCKETS = [0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05,
+               0.1, 0.25, 0.5, 1, 2.5, 5, 10].freeze
+
+    class Histogram
+      attr_reader :sum, :count
+
+      def initialize(buckets = BUCKETS)
+        @buckets = buckets
+        @counts = Array.new(buckets.length, 0)
+        @sum = 0.0
+        @count = 0
+      end
+
+      def observe(value)
+        idx = @buckets.bsearch_index { |bound| bound >= value }
+        @counts[idx] += 1 if idx
+        @sum += value
+        @count += 1
+      end
+
+      # Returns cumulative counts keyed by upper bounds.
+      def buckets
+        total = 0
+        @buckets.each_with_index.collect do |bound, idx|
+          [bound, total += @counts[idx]]
+        end.to_h
+      end
+
+      def to_h
+        {buckets: buckets, sum: @sum, count: @count}
+      end
+    end
+
+    CONNECTION_COUNTERS = [:executes, :execute_time, :fetches, :fetch_time, :fetched_rows].freeze
+
+    # [name, type, help, key in snapshots]
+    POOL_METRICS = [
+      ['odpi_pool_open_sessions', 'gauge', 'Sessions open in the pool.', :open_count],
+      ['odpi_pool_busy_sessions', 'gauge', 'Sessions checked out of the pool.', :busy_count],
+      ['odpi_pool_waiting_threads', 'gauge', 'Threads waiting for a session.', :waiting],
+      ['odpi_pool_session_growth_total', 'counter', 'Open session count growth seen at checkout, an estimate of sessions created.', :session_growth],
+      ['odpi_pool_acquires_total', 'counter', 'Sessions acquired from ODPI-C.', :acquires],
+      ['odpi_pool_acquire_seconds_total', 'counter', 'Time spent in dpiPool_acquireConnection.', :acquire_time],
+      ['odpi_pool_checkout_timeouts_total', 'counter', 'Checkouts which timed out.', :timeouts],
+      ['odpi_pool_checkout_rejections_total', 'counter', 'Checkouts rejected by max_waiters.', :rejections],
+      ['odpi_executes_total', 'counter', 'Statement executions.', :executes],
+      ['odpi_execute_seconds_total', 'counter', 'Time spent executing statements.', :execute_time],
+      ['odpi_fetches_total', 'counter', 'Fetch calls.', :fetches],
+      ['odpi_fetch_seconds_total', 'counter', 'Time spent fetching rows.', :fetch_time],
+      ['odpi_fetched_rows_total', 'counter', 'Rows fetched.', :fetched_rows],
+    ].freeze
+
+    HISTOGRAMS = [
+      ['odpi_pool_checkout_wait_seconds', 'Time to check out a session by priority class.', :checkout_wait],
+      ['odpi_pool_checkout_hold_seconds', 'Time a session was checked out.', :checkout_hold],
+    ].freeze
+
+    # The registry used by pools of the current Ractor.
+    def self.default
+      ODPI.ractor_local(:odpi_metrics) { new }
+    end
+
+    Entry = Struct.new(:pool, :checkout_wait, :checkout_hold, :counters)
+
+    def initialize
+      @mutex = Mutex.new
+      @entries = {}
+    end
+
+    # Registers a pool, which must respond to +stats+.
+    def register_pool(name, pool)
+      @mutex.synchronize do
+        counters = CONNECTION_COUNTERS.collect { |key| [key, 0] }.to_h
+        @entries[name] = Entry.new(pool, {}, Histogram.new, counters)
+      end
+    end
+
+    # Unregisters +name+, only when it is registered for +pool+ if given.
+    def unregister_pool(name, pool = nil)
+      @mutex.synchronize do
+        entry = @entries[name]
+        @entries.delete(name) if entry && (pool.nil? || entry.pool.equal?(pool))
+      end
+    end
+
+    # @private
+    def observe_checkout(name, seconds, priority = :default)
+      @mutex.synchronize do
+        entry = @entries[name]
+        (entry.checkout_wait[priority] ||= Histogram.new).observe(seconds) if entry
+      end
+    end
+
+    # Records the hold time of a returned connection and adds up
+    # its counters of execute and fetch calls.
+    # @private
+    def observe_checkin(name, seconds, conn_stats)
+      @mutex.synchronize do
+        entry = @entries[name]
+        return unless entry
+        entry.checkout_hold.observe(seconds)
+        CONNECTION_COUNTERS.each do |key|
+          entry.counters[key] += conn_stats[key]
+        end
+      end
+    end
+
+    # Returns metrics of each pool keyed by the pool name.
+    def snapshot
+      entries = @mutex.synchronize { @entries.dup }
+      entries.collect do |name, entry|
+        stats = entry.pool.stats
+        @mutex.synchronize do
+          stats.merge!(entry.counters)
+          stats[:checkout_wait] = entry.checkout_wait.transform_values(&:to_h)
+          stats[:checkout_hold] = entry.checkout_hold.to_h
+        end
+        [name, stats]
+      end.to_h
+    end
+
+    def to_prometheus
+      snap = snapshot
+      out = String.new
+      POOL_METRICS.each do |metric, type, help, key|
+        out << "# HELP #{metric} #{help}\n# TYPE #{metric} #{type}\n"
+        snap.each do |name, stats|
+          out << "#{metric}{pool=#{label(name)}} #{format_value(stats[key])}\n"
+        end
+      end
+      HISTOGRAMS.each do |metric, help, key|
+        out << "# HELP #{metric} #{help}\n# TYPE #{metric} histogram\n"
+        snap.each do |name, stats|
+          if key == :checkout_wait
+            stats[key].each do |priority, hist|
+              render_histogram(out, metric, "pool=#{label(name)},priority=#{label(priority)}", hist)
+            end
+          else
+            render_histogram(out, metric, "pool=#{label(name)}", stats[key])
+          end
+        end
+      end
+      out
+    end
+
+    private
+
+    def render_histogram(out, metric, labels, hist)
+      hist[:buckets].each do |bound, count|
+        out << "#{metric}_bucket{#{labels},le=\"#{format_value(bound)}\"} #{count}\n"
+      end
+      out << "#{metric}_bucket{#{labels},le=\"+Inf\"} #{hist[:count]}\n"
+      out << "#{metric}_sum{#{labels}} #{format_value(hist[:sum])}\n"
+      out << "#{metric}_count{#{labels}} #{hist[:count]}\n"
+    end
+
+    def label(name)
+      '"' + name.to_s.gsub(/[\\"\n]/) { |c| c == "\n" ? '\n' : "\\#{c}" } + '"'
+    end
+
+    def format_value(val)
+      val.is_a?(Float) ? val.to_s : val.to_i.to_s
+    end
+  end
+end
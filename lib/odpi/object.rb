@@ -33,8 +33,34 @@
 module ODPI
 
   module Object
-    @@oracle_type_to_ruby_class = {}
-    @@ruby_class_to_oracle_type = {}
+    # Frozen maps shared by Ractors, replaced by the main Ractor on update.
+    # Other Ractors register classes to Ractor-local maps.
+    @oracle_type_to_ruby_class = ODPI.make_shareable({})
+    @ruby_class_to_oracle_type = ODPI.make_shareable({})
+
+    def self.oracle_type_to_ruby_class(name)
+      @oracle_type_to_ruby_class[name] || (ODPI.main_ractor? ? nil : local_types[0][name])
+    end
+
+    def self.ruby_class_to_oracle_type(klass)
+      @ruby_class_to_oracle_type[klass] || (ODPI.main_ractor? ? nil : local_types[1][klass])
+    end
+
+    def self.register_type(name, klass)
+      name = -name
+      if ODPI.main_ractor?
+        @oracle_type_to_ruby_class = ODPI.make_shareable(@oracle_type_to_ruby_class.merge(name => klass))
+        @ruby_class_to_oracle_type = ODPI.make_shareable(@ruby_class_to_oracle_type.merge(klass => name))
+      else
+        types = local_types
+        types[0][name] = klass
+        types[1][klass] = name
+      end
+    end
+
+    def self.local_types
+      ODPI.ractor_local(:odpi_object_types) { [{}, {}] }
+    end
 
     def self.oracle_name_to_ruby_constant_name(name)
       name = if name !~ /[[:lower:]]/
@@ -59,8 +85,8 @@ module ODPI
 
     def self.find_class(schema, name)
       fullname = "#{schema}.#{name}"
-      klass = @@oracle_type_to_ruby_class[fullname]
-      klass = @@oracle_type_to_ruby_class[name] if klass.nil?
+      klass = oracle_type_to_ruby_class(fullname)
+      klass = oracle_type_to_ruby_class(name) if klass.nil?
       if klass.nil?
         module_name = oracle_name_to_ruby_constant_name(schema)
         class_name = oracle_name_to_ruby_constant_name(name)
@@ -76,19 +102,17 @@ module ODPI
         else
           klass = mod.const_set(class_name, Class.new(Base))
         end
-        @@oracle_type_to_ruby_class[fullname] = klass
-        @@ruby_class_to_oracle_type[klass] = fullname
+        register_type(fullname, klass)
       end
       klass
     end
 
     def self.find_name_by_class(klass)
-      @@ruby_class_to_oracle_type[klass]
+      ruby_class_to_oracle_type(klass)
     end
 
     def self.set_typename(klass, name)
-      @@ruby_class_to_oracle_type[klass] = name
-      @@oracle_type_to_ruby_class[name] = klass
+      register_type(name, klass)
     end
 
     module NamedCollection
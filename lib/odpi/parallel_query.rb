@@ -0,0 +1,246 @@
+# parallel_query.rb -- part of ruby-odpi
+#
+# URL: https://github.com/kubo/ruby-odpi
+#
+# ------------------------------------------------------
+#
+# Copyright 2017 Kubo Takehiro <kubo@jiubao.org>
+#
+# Redistribution and use in source and binary forms, with or without modification, are
+# permitted provided that the following conditions are met:
+#
+#    1. Redistributions of source code must retain the above copyright notice, this list of
+#       conditions and the following disclaimer.
+#
+#    2. Redistributions in binary form must reproduce the above copyright notice, this list
+#       of conditions and the following disclaimer in the documentation and/or other materials
+#       provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY EXPRESS OR IMPLIED
+# WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+# FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+# ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+# NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+# ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+# The views and conclusions contained in the software and documentation are those of the
+# authors and should not be interpreted as representing official policies, either expressed
+# or implied, of the authors.
+
+module ODPI
+  # Runs a query split into partitions on connections acquired from a pool,
+  # one thread per connection. The GVL is released while each thread waits
+  # for the server, so partitions are fetched concurrently.
+  #
+  # When +table+ is given, the table's extents are split into +partitions+
+  # ROWID ranges and +sql+ must contain <tt>rowid BETWEEN :rowid_lo AND :rowid_hi</tt>.
+  # Otherwise +sql+ must contain a predicate such as <tt>ORA_HASH(key, 31) = :partition</tt>,
+  # which is executed for each +:partition+ from 0 to <tt>partitions - 1</tt>.
+  #
+  # Partitions are distributed among +threads+ workers. A worker which has
+  # run out of its own partitions takes the last one of the busiest worker.
+  # Rows are yielded as they arrive, or in partition order when +ordered+ is true.
+  # Note that ordered mode buffers rows of partitions ahead of the current one.
+  class ParallelQuery
+    include Enumerable
+
+    # Characters used by the extended ROWID format.
+    ROWID_DIGITS = [*'A'..'Z', *'a'..'z', *'0'..'9', '+', '/'].join.freeze
+
+    def initialize(pool, sql, threads: 4, partitions: nil, table: nil, owner: nil,
+                   binds: {}, ordered: false, batch_size: 1000, queue_size: nil,
+                   connection_params: {})
+      @pool = pool
+      @sql = sql
+      @threads = threads
+      @partitions = partitions || threads * 4
+      @table = table
+      @owner = owner
+      @binds = binds
+      @ordered = ordered
+      @batch_size = batch_size
+      @queue_size = queue_size || threads * 2
+      @connection_params = connection_params
+    end
+
+    def each(&block)
+      return enum_for(__method__) unless block
+      chunks = @table ? rowid_chunks : Array.new(@partitions) { |i| {'partition' => i} }
+      return self if chunks.empty?
+      work = WorkQueue.new(chunks, [@threads, chunks.length].min)
+      out = SizedQueue.new(@queue_size)
+      stop = false
+      workers = Array.new(work.num_workers) do |id|
+        Thread.new do
+          begin
+            run_partitions(id, work, out) { stop }
+          rescue ClosedQueueError
+          rescue Exception => e
+            out.push([:error, e]) rescue nil
+          end
+        end
+      end
+      merger = @ordered ? OrderedMerger.new(block) : nil
+      remaining = chunks.length
+      while remaining > 0
+        idx, rows = out.pop
+        raise rows if idx == :error
+        remaining -= 1 if rows.nil?
+        if merger
+          merger.push(idx, rows)
+        elsif rows
+          rows.each(&block)
+        end
+      end
+      self
+    ensure
+      stop = true
+      out.close if out
+      workers.each(&:join) if workers
+    end
+
+    # Returns the extended ROWID string of the specified row.
+    def self.rowid(data_object_id, file_no, block_no, row_no)
+      [[data_object_id, 6], [file_no, 3], [block_no, 6], [row_no, 3]].collect do |num, len|
+        Array.new(len) { |i| ROWID_DIGITS[(num >> (6 * (len - 1 - i))) & 63] }.join
+      end.join
+    end
+
+    private
+
+    def run_partitions(id, work, out)
+      conn = @pool.connection(@connection_params)
+      begin
+        stmt = conn.prepare(@sql)
+        stmt.fetch_array_size = @batch_size
+        @binds.each do |key, val|
+          stmt.bind(key, val)
+        end
+        bound = false
+        while !yield && (idx, binds = work.pop(id))
+          binds.each do |key, val|
+            if bound
+              stmt[key] = val
+            else
+              stmt.bind(key, val)
+            end
+          end
+          bound = true
+          stmt.execute
+          while !yield && (rows = stmt.fetch_rows(@batch_size))
+            out.push([idx, rows])
+          end
+          out.push([idx, nil])
+        end
+      ensure
+        stmt.close if stmt
+        conn.close
+      end
+    end
+
+    def rowid_chunks
+      dict = @owner ? 'dba' : 'user'
+      sql = <<-EOS
+SELECT o.data_object_id, e.relative_fno, e.block_id, e.blocks
+  FROM #{dict}_extents e, #{dict}_objects o
+ WHERE e.segment_name = :segment_name#{@owner ? ' AND e.owner = :owner AND o.owner = e.owner' : ''}
+   AND o.object_name = e.segment_name
+   AND NVL(o.subobject_name, '-') = NVL(e.partition_name, '-')
+   AND o.object_type LIKE 'TABLE%'
+   AND o.data_object_id IS NOT NULL
+ ORDER BY 1, 2, 3
+EOS
+      extents = []
+      conn = @pool.connection(@connection_params)
+      begin
+        stmt = conn.prepare(sql)
+        stmt.bind('segment_name', @table)
+        stmt.bind('owner', @owner) if @owner
+        stmt.execute
+        while row = stmt.fetch
+          extents << row.collect(&:to_i)
+        end
+        stmt.close
+      ensure
+        conn.close
+      end
+
+      target = (extents.inject(0) { |sum, ext| sum + ext[3] } + @partitions - 1) / @partitions
+      chunks = []
+      lo = nil
+      filled = 0
+      last = nil
+      extents.each do |obj, file, block, blocks|
+        while blocks > 0
+          lo ||= self.class.rowid(obj, file, block, 0)
+          num = [blocks, target - filled].min
+          filled += num
+          block += num
+          blocks -= num
+          last = [obj, file, block - 1]
+          if filled == target
+            chunks << {'rowid_lo' => lo, 'rowid_hi' => self.class.rowid(*last, 32767)}
+            lo = nil
+            filled = 0
+          end
+        end
+      end
+      chunks << {'rowid_lo' => lo, 'rowid_hi' => self.class.rowid(*last, 32767)} if lo
+      chunks
+    end
+
+    # Per-worker deques of partitions. A worker pops from the front of
+    # its own deque and steals from the back of the longest one.
+    class WorkQueue
+      def initialize(chunks, num_workers)
+        @mutex = Mutex.new
+        @deques = Array.new(num_workers) { [] }
+        chunks.each_with_index do |binds, idx|
+          @deques[idx % num_workers] << [idx, binds]
+        end
+      end
+
+      def num_workers
+        @deques.length
+      end
+
+      def pop(worker)
+        @mutex.synchronize do
+          @deques[worker].shift || @deques.max_by(&:length).pop
+        end
+      end
+    end
+
+    # Yields batches in partition order, holding ones which arrive early.
+    class OrderedMerger
+      def initialize(block)
+        @block = block
+        @next_idx = 0
+        @pending = {}
+      end
+
+      # +rows+ is nil when the partition +idx+ is complete.
+      def push(idx, rows)
+        if idx != @next_idx
+          (@pending[idx] ||= []) << rows
+          return
+        end
+        if rows
+          rows.each(&@block)
+          return
+        end
+        @next_idx += 1
+        while batches = @pending.delete(@next_idx)
+          batches.each do |batch|
+            batch.each(&@block) if batch
+          end
+          break unless batches.last.nil?
+          @next_idx += 1
+        end
+      end
+    end
+  end
+end
@@ -32,8 +32,54 @@
 
 module ODPI
   class Pool
+    attr_reader :name
+
+    # In addition to pool creation parameters, +params+ may contain
+    # +max_waiters+, the number of threads allowed to wait for a connection,
+    # and +wait_timeout+, the default seconds to wait in #connection.
+    # Checkouts are limited to +max_sessions+ and granted in FIFO order.
+    # +priorities+ defines priority classes of checkouts, such as
+    # <tt>{interactive: {reserved: 2}, batch: {max_share: 0.5}}</tt>,
+    # highest first (see ODPI::CheckoutQueue), selected by +priority+
+    # of #connection.
+    #
+    # +circuit_breaker+, +true+, a Hash of ODPI::CircuitBreaker options or
+    # a breaker shared with others, makes #connection fail fast while
+    # the database is unreachable.
+    #
+    # When +affinity+ is true, #connection prefers the session last used
+    # by the calling thread or by +affinity_key+ (see ODPI::SessionAffinity).
+    #
+    # +adaptive_limit+, +true+ or a Hash of ODPI::ConcurrencyLimiter
+    # options, lets checkouts be limited below +max_sessions+ by
+    # execute latency.
+    #
+    # When +health_check_idle_time+ is given, sessions idle longer than that
+    # many seconds are pinged on a background thread every
+    # +health_check_interval+ seconds (see ODPI::HealthChecker) and
+    # +ping_interval+ defaults to -1, i.e. no ping at checkout.
+    #
+    # Metrics of the pool are registered with ODPI::Metrics.default
+    # under +name+ until the pool is closed.
+    #
+    # +session_fixup+ is called with a connection and the requested
+    # +session_state+ when #connection returns a session whose tag doesn't
+    # match the state. See #connection.
     def initialize(*args)
-      params = (args.last.is_a? Hash) ? args.pop : {}
+      params = (args.last.is_a? Hash) ? args.pop.dup : {}
+      @name = params.delete(:name) || "pool-#{object_id}"
+      @session_fixup = params.delete(:session_fixup)
+      @session_tag_hits = 0
+      @session_fixups = 0
+      @wait_timeout = params.delete(:wait_timeout)
+      @max_waiters = params.delete(:max_waiters)
+      @priorities = params.delete(:priorities)
+      @breaker = CircuitBreaker.from_param(params.delete(:circuit_breaker))
+      @use_affinity = params.delete(:affinity)
+      @adaptive_limit = params.delete(:adaptive_limit)
+      @health_check_idle_time = params.delete(:health_check_idle_time)
+      @health_check_interval = params.delete(:health_check_interval)
+      params[:ping_interval] ||= -1 if @health_check_idle_time
       case args.length
       when 0
         username = params[:username]
@@ -44,10 +90,22 @@ module ODPI
       else
         username, password, database = args
       end
-      @pool = Dpi::Pool.new(username, password, database, params)
+      # kept to open the pool again in a forked child process
+      @create_args = [username, password, database, params].freeze
+      @warm_up_sessions = nil
+      @warm_up_statements = []
+      @fork_mutex = Mutex.new
+      open_pool
+      ODPI.register_pool(self)
     end
 
+    # When +session_state+ is given, a session tagged with its fingerprint
+    # (see Pool.session_tag) is requested. Only when the session's tag
+    # differs, +session_fixup+ is called to set up the session, such as
+    # NLS parameters, module or current schema. The session is retagged
+    # when it is returned, so steady-state checkouts need no set-up calls.
     def connection(*args)
+      reopen_after_fork if @pid != Process.pid
       params = (args.last.is_a? Hash) ? args.pop : {}
       case args.length
       when 0
@@ -59,11 +117,256 @@ module ODPI
       else
         username, password, auth_mode = args
       end
-      Connection.new(@pool.connection(username, password, auth_mode, params), false)
+      params = params.dup
+      thread_safe = params.delete(:thread_safe)
+      session_state = params.delete(:session_state)
+      if session_state
+        raise ArgumentError, "session_state requires session_fixup of the pool" unless @session_fixup
+        state_tag = self.class.session_tag(session_state)
+        params[:tag] = state_tag
+      end
+      if @affinity
+        affinity_key = params.delete(:affinity_key) || Thread.current.object_id
+        session_tag = @affinity.requested_tag(affinity_key)
+        params[:tag] = [session_tag, state_tag].compact.join(';') if session_tag
+        params[:match_any_tag] = true
+      end
+      wait_timeout = params.key?(:wait_timeout) ? params.delete(:wait_timeout) : @wait_timeout
+      priority = params.delete(:priority) || @checkout_queue.class_names.first
+      started = clock
+      acquire = lambda do
+        @checkout_queue.acquire(wait_timeout, priority)
+        raw = nil
+        begin
+          raw = @pool.connection(username, password, auth_mode, params)
+        ensure
+          # also reached by Thread#kill, which skips rescue
+          @checkout_queue.release(priority) unless raw
+        end
+      end
+      raw_conn = @breaker ? @breaker.run(&acquire) : acquire.call
+      checked_out = clock
+      @metrics.observe_checkout(@name, checked_out - started, priority)
+      conn = Connection.new(raw_conn, false, thread_safe, lambda do
+        begin
+          conn_stats = raw_conn.stats
+          @metrics.observe_checkin(@name, clock - checked_out, conn_stats)
+          @limiter.observe(conn_stats) if @limiter
+        ensure
+          @checkout_queue.release(priority)
+        end
+      end)
+      current_tag = conn.tag
+      if @affinity
+        session_id, current_tag = @affinity.checked_out(affinity_key, current_tag)
+        conn.on_prepare = lambda { |sql| @affinity.prepared(session_id, sql) }
+      end
+      restore_session_state(conn, session_state, state_tag, current_tag) if session_state
+      if @affinity || session_state
+        conn.tag = [@affinity && @affinity.tag(session_id), state_tag].compact.join(';')
+      end
+      conn
+    end
+
+    # Returns the tag of +state+, a String as is or a Hash as
+    # <tt>"key1=value1;key2=value2"</tt> sorted by keys.
+    def self.session_tag(state)
+      return state.to_s unless state.is_a? Hash
+      state.collect { |key, val| "#{key}=#{val}" }.sort.join(';')
+    end
+
+    # Yields a pooled connection and returns it to the pool when the block
+    # exits, even by an exception. Waits up to +timeout+ seconds in FIFO
+    # order when all sessions are in use.
+    def with_connection(timeout: @wait_timeout, **params)
+      conn = connection(params.merge(wait_timeout: timeout))
+      begin
+        yield conn
+      ensure
+        conn.close
+      end
+    end
+
+    # Returns counts of checkouts, waits, timeouts and rejected waiters,
+    # and the total and maximum wait time in seconds.
+    def checkout_stats
+      @checkout_queue.stats
+    end
+
+    # Opens +sessions+ sessions concurrently and prepares +statements+ on
+    # each of them so that they are found in the session's statement cache
+    # (see +stmt_cache_size+). Queries are also parsed on the server by
+    # describe-only execution. +sessions+ defaults to +max_sessions+.
+    # Returns <tt>{sessions: n, statements: n, elapsed: seconds}</tt>.
+    def warm_up(sessions: nil, statements: [], **params)
+      reopen_after_fork if @pid != Process.pid
+      @warm_up_sessions = sessions
+      @warm_up_statements = statements
+      sessions = [sessions || @checkout_queue.size, @checkout_queue.size].min
+      started = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+      conns = Queue.new
+      threads = Array.new(sessions) do
+        Thread.new do
+          conn = connection(params)
+          conns.push(conn)
+          raw = conn.raw_connection
+          statements.each do |sql|
+            stmt = raw.prepare_stmt(false, sql, nil)
+            begin
+              stmt.execute(:describe_only, raw) if stmt.query?
+            ensure
+              stmt.close(nil)
+            end
+            # Lets the affinity model know the statement is cached.
+            conn.on_prepare.call(sql) if conn.on_prepare
+          end
+        end
+      end
+      begin
+        # Sessions are held until all threads finish so that
+        # each thread warms up a distinct session.
+        threads.each(&:join)
+      ensure
+        threads.each { |t| t.join rescue nil }
+        conns.pop.close until conns.empty?
+      end
+      {
+        sessions: sessions,
+        statements: statements.length,
+        elapsed: Process.clock_gettime(Process::CLOCK_MONOTONIC) - started,
+      }
+    end
+
+    # Runs +sql+ split into partitions on pooled connections.
+    # See ODPI::ParallelQuery for parameters.
+    def parallel_query(sql, **params, &block)
+      query = ParallelQuery.new(self, sql, **params)
+      block ? query.each(&block) : query
+    end
+
+    # Executes +queries+ concurrently, each on its own connection, and returns
+    # their results in order. A query is an SQL string, <tt>[sql, binds]</tt>
+    # or <tt>{sql: sql, binds: binds, deadline: seconds}</tt>.
+    # When a query fails, the rest are cancelled and the error is raised,
+    # unless +partial+ is true, in which case the error is returned in place
+    # of the result.
+    def parallel_map(queries, deadline: nil, partial: false, **params)
+      futures = queries.collect do |query|
+        query = {sql: query} if query.is_a? String
+        query = {sql: query[0], binds: query[1]} if query.is_a? Array
+        Future.execute(deadline: query.fetch(:deadline, deadline)) do |future|
+          conn = connection(params)
+          begin
+            future.connection = conn
+            conn.execute_and_fetch(query[:sql], query[:binds])
+          ensure
+            future.connection = nil
+            conn.close
+          end
+        end
+      end
+      begin
+        futures.collect do |future|
+          begin
+            future.value
+          rescue StandardError => e
+            raise unless partial
+            e
+          end
+        end
+      rescue Exception
+        futures.each(&:cancel)
+        raise
+      end
+    end
+
+    # Returns session counts, counters kept by the C extension and
+    # #checkout_stats.
+    def stats
+      stats = @pool.stats
+      stats[:open_count] = @pool.open_count
+      stats[:busy_count] = @pool.busy_count
+      stats[:session_tag_hits] = @session_tag_hits
+      stats[:session_fixups] = @session_fixups
+      stats.merge!(checkout_stats)
+    end
+
+    # Returns the statement cache size, the estimated statement cache hit
+    # rate and how often sessions were reused by the same thread or key,
+    # or nil unless +affinity+ is enabled.
+    def stmt_cache_stats
+      @affinity && @affinity.stats
+    end
+
+    # Returns the state of ODPI::CircuitBreaker, or nil when disabled.
+    def circuit_breaker_stats
+      @breaker && @breaker.stats
+    end
+
+    # Returns the statistics of ODPI::HealthChecker, or nil when disabled.
+    def health_check_stats
+      @health_checker && @health_checker.stats
+    end
+
+    # Opens the pool again when the current process is a forked child,
+    # because sessions inherited from the parent can't be used. They are
+    # abandoned without being closed, which would disturb the parent.
+    # With +warm_up+, the last #warm_up is repeated.
+    def reopen_after_fork(warm_up: false)
+      @fork_mutex.synchronize do
+        return false if @pid == Process.pid
+        open_pool
+      end
+      self.warm_up(sessions: @warm_up_sessions, statements: @warm_up_statements) if warm_up
+      true
     end
 
     def close
-      @pool.close(nil)
+      @health_checker.stop if @health_checker
+      # a pool inherited from the parent process is abandoned
+      @pool.close(nil) if @pid == Process.pid
+      @metrics.unregister_pool(@name, self)
+    end
+
+    private
+
+    def open_pool
+      @checkout_queue = CheckoutQueue.new(@create_args[3][:max_sessions] || 1,
+                                          max_waiters: @max_waiters, classes: @priorities)
+      if @adaptive_limit
+        opts = @adaptive_limit.is_a?(Hash) ? @adaptive_limit : {}
+        @limiter = ConcurrencyLimiter.new(@checkout_queue, **opts)
+      end
+      username, password, database, params = @create_args
+      # Dpi::Pool.new deletes known keys from params.
+      @pool = Dpi::Pool.new(username, password, database, params.dup)
+      @pid = Process.pid
+      @affinity = SessionAffinity.new(@pool.stmt_cache_size) if @use_affinity
+      @metrics = Metrics.default
+      @metrics.register_pool(@name, self)
+      if @health_check_idle_time
+        @health_checker = HealthChecker.new(@pool, @checkout_queue,
+                                            idle_time: @health_check_idle_time,
+                                            interval: @health_check_interval)
+      end
+    end
+
+    def restore_session_state(conn, state, tag, current_tag)
+      if current_tag == tag
+        @session_tag_hits += 1
+      else
+        begin
+          @session_fixup.call(conn, state)
+        rescue Exception
+          conn.drop
+          raise
+        end
+        @session_fixups += 1
+      end
+    end
+
+    def clock
+      Process.clock_gettime(Process::CLOCK_MONOTONIC)
     end
 
   end # pool
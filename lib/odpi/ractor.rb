@@ -0,0 +1,67 @@
+# ractor.rb -- part of ruby-odpi
+#
+# URL: https://github.com/kubo/ruby-odpi
+#
+# ------------------------------------------------------
+#
+# Copyright 2017 Kubo Takehiro <kubo@jiubao.org>
+#
+# Redistribution and use in source and binary forms, with or without modification, are
+# permitted provided that the following conditions are met:
+#
+#    1. Redistributions of source code must retain the above copyright notice, this list of
+#       conditions and the following disclaimer.
+#
+#    2. Redistributions in binary form must reproduce the above copyright notice, this list
+#       of conditions and the following disclaimer in the documentation and/or other materials
+#       provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY EXPRESS OR IMPLIED
+# WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+# FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+# ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+# NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+# ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+# The views and conclusions contained in the software and documentation are those of the
+# authors and should not be interpreted as representing official policies, either expressed
+# or implied, of the authors.
+
+
+module ODPI
+  # Helpers to keep module-level state usable from non-main Ractors.
+  # Without Ractor support, every caller is treated as the main Ractor.
+
+  # @private
+  def self.main_ractor?
+    !defined?(Ractor.main) || Ractor.current == Ractor.main
+  end
+
+  # @private
+  def self.make_shareable(obj)
+    defined?(Ractor) ? Ractor.make_shareable(obj) : obj.freeze
+  end
+
+  # Returns the Ractor-local value of +key+, initialized by the block.
+  # @private
+  def self.ractor_local(key)
+    if defined?(Ractor)
+      Ractor.current[key] ||= yield
+    else
+      (@ractor_local ||= {})[key] ||= yield
+    end
+  end
+
+  # Discards the Ractor-local value of +key+.
+  # @private
+  def self.clear_ractor_local(key)
+    if defined?(Ractor)
+      Ractor.current[key] = nil
+    elsif @ractor_local
+      @ractor_local.delete(key)
+    end
+  end
+end
@@ -0,0 +1,188 @@
+# router.rb -- part of ruby-odpi
+#
+# URL: https://github.com/kubo/ruby-odpi
+#
+# ------------------------------------------------------
+#
+# Copyright 2017 Kubo Takehiro <kubo@jiubao.org>
+#
+# Redistribution and use in source and binary forms, with or without modification, are
+# permitted provided that the following conditions are met:
+#
+#    1. Redistributions of source code must retain the above copyright notice, this list of
+#       conditions and the following disclaimer.
+#
+#    2. Redistributions in binary form must reproduce the above copyright notice, this list
+#       of conditions and the following disclaimer in the documentation and/or other materials
+#       provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY EXPRESS OR IMPLIED
+# WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+# FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+# ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+# NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+# ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+# The views and conclusions contained in the software and documentation are those of the
+# authors and should not be interpreted as representing official policies, either expressed
+# or implied, of the authors.
+
+
+module ODPI
+  # Routes statements to a primary pool and read-only replica pools, such
+  # as Active Data Guard standbys.
+  #
+  # Queries go to the replica with the lowest score, the EWMA of its query
+  # latency weighted by checked-out and waiting sessions. A replica which
+  # raises a recoverable error, times out or has a full queue at checkout,
+  # or whose circuit breaker is open is skipped for +retry_after+ seconds
+  # and the query is retried on the next one, then on the primary. Other statements and all statements in #transaction
+  # go to the primary.
+  #
+  # Statements are classified once per SQL text by preparing them, which
+  # needs no round trip. Pass <tt>hint: :write</tt> for queries which must
+  # see the primary, such as SELECT ... FOR UPDATE outside a transaction.
+  class Router
+    Backend = Struct.new(:pool, :ewma, :down_until)
+
+    # Maximum number of classified SQL texts kept.
+    MAX_CACHED_KINDS = 1000
+
+    # +primary+ and each of +replicas+ are ODPI::Pool or Hash of pool
+    # parameters. Pools are closed by #close.
+    def initialize(primary:, replicas: [], alpha: 0.2, retry_after: 30)
+      @primary = to_pool(primary)
+      @replicas = replicas.collect { |replica| Backend.new(to_pool(replica), nil, nil) }
+      @alpha = alpha
+      @retry_after = retry_after
+      @mutex = Mutex.new
+      @kinds = {}
+      @pin_key = :"odpi_router_#{object_id}"
+    end
+
+    # Executes +sql+ and returns fetched rows for queries or the row count.
+    # +hint+ is +:read+ or +:write+ to skip classification.
+    def execute(sql, binds = nil, hint: nil)
+      conn = Thread.current[@pin_key]
+      return conn.execute_and_fetch(sql, binds) if conn
+      kind = hint || @mutex.synchronize { @kinds[sql] }
+      if kind != :write
+        read_backends.each do |backend|
+          begin
+            result = execute_on_replica(backend, sql, binds, kind)
+            return result unless result.equal?(:write)
+            kind = :write
+            break
+          rescue Dpi::Error, CheckoutQueue::TimeoutError, CheckoutQueue::QueueFullError,
+                 CircuitBreaker::OpenError => e
+            raise if e.is_a?(Dpi::Error) && !e.is_recoverable?
+            mark_down(backend)
+          end
+        end
+      end
+      @primary.with_connection do |conn|
+        conn.execute_and_fetch(sql, binds)
+      end
+    end
+
+    # Runs the block with a primary connection, which is used by #execute
+    # in the block too, and commits unless the block raises.
+    def transaction
+      conn = Thread.current[@pin_key]
+      return yield(conn) if conn
+      @primary.with_connection do |conn|
+        Thread.current[@pin_key] = conn
+        begin
+          result = yield(conn)
+          conn.commit
+          result
+        rescue Exception
+          begin
+            conn.rollback
+          rescue StandardError
+          end
+          raise
+        ensure
+          Thread.current[@pin_key] = nil
+        end
+      end
+    end
+
+    # Returns the EWMA latency in seconds and the state of each replica
+    # keyed by pool name.
+    def stats
+      @mutex.synchronize do
+        now = clock
+        @replicas.collect do |backend|
+          [backend.pool.name, {latency: backend.ewma,
+                               down: !backend.down_until.nil? && backend.down_until > now}]
+        end.to_h
+      end
+    end
+
+    def close
+      @replicas.each { |backend| backend.pool.close }
+      @primary.close
+    end
+
+    private
+
+    def to_pool(pool)
+      pool.is_a?(Hash) ? Pool.new(pool) : pool
+    end
+
+    # Replicas which are up, best first.
+    def read_backends
+      now = clock
+      backends = @mutex.synchronize do
+        @replicas.reject { |backend| backend.down_until && backend.down_until > now }
+      end
+      backends.sort_by do |backend|
+        stats = backend.pool.checkout_stats
+        (backend.ewma || 0.0) * (1 + stats[:waiting] + stats[:in_use].fdiv(stats[:size]))
+      end
+    end
+
+    # Returns :write instead of executing when +sql+ turns out not to be a query.
+    def execute_on_replica(backend, sql, binds, kind)
+      backend.pool.with_connection do |conn|
+        kind ||= classify(conn, sql)
+        return :write if kind == :write
+        started = clock
+        result = conn.execute_and_fetch(sql, binds)
+        elapsed = clock - started
+        @mutex.synchronize do
+          backend.ewma = backend.ewma ? backend.ewma + @alpha * (elapsed - backend.ewma) : elapsed
+          backend.down_until = nil
+        end
+        result
+      end
+    end
+
+    def classify(conn, sql)
+      stmt = conn.prepare(sql)
+      begin
+        kind = stmt.query? ? :read : :write
+      ensure
+        stmt.close
+      end
+      @mutex.synchronize do
+        @kinds.clear if @kinds.length >= MAX_CACHED_KINDS
+        @kinds[sql] = kind
+      end
+    end
+
+    def mark_down(backend)
+      @mutex.synchronize do
+        backend.down_until = clock + @retry_after
+      end
+    end
+
+    def clock
+      Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    end
+  end
+end
@@ -0,0 +1,124 @@
+# session_affinity.rb -- part of ruby-odpi
+#
+# URL: https://github.com/kubo/ruby-odpi
+#
+# ------------------------------------------------------
+#
+# Copyright 2017 Kubo Takehiro <kubo@jiubao.org>
+#
+# Redistribution and use in source and binary forms, with or without modification, are
+# permitted provided that the following conditions are met:
+#
+#    1. Redistributions of source code must retain the above copyright notice, this list of
+#       conditions and the following disclaimer.
+#
+#    2. Redistributions in binary form must reproduce the above copyright notice, this list
+#       of conditions and the following disclaimer in the documentation and/or other materials
+#       provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY EXPRESS OR IMPLIED
+# WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+# FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+# ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+# NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+# ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+# The views and conclusions contained in the software and documentation are those of the
+# authors and should not be interpreted as representing official policies, either expressed
+# or implied, of the authors.
+
+
+module ODPI
+  # Returns threads, or callers with the same workload key, to the pooled
+  # session they used last, so that their SQL is found in the session's
+  # statement cache.
+  #
+  # Sessions are told apart by tags <tt>odpi_session=N</tt> given when they
+  # are returned. A checkout requests the tag of the key's last session
+  # with +match_any_tag+, so any free session is used when that one is busy.
+  #
+  # The hit rate of statement caches is estimated by replaying prepared
+  # SQL against a model of each session's LRU cache of +stmt_cache_size+.
+  class SessionAffinity
+    TAG_PREFIX = 'odpi_session='.freeze
+
+    def initialize(stmt_cache_size, max_keys: 10000, max_sessions: 1000)
+      @stmt_cache_size = stmt_cache_size
+      @max_keys = max_keys
+      @max_sessions = max_sessions
+      @mutex = Mutex.new
+      @last_session = {}  # key => session id
+      @caches = {}        # session id => {sql => true} in LRU order
+      @next_id = 0
+      @prepares = 0
+      @hits = 0
+      @affinity_hits = 0
+      @checkouts = 0
+    end
+
+    # Returns the tag to request for +key+, or nil.
+    def requested_tag(key)
+      id = @mutex.synchronize { @last_session[key] }
+      id && "#{TAG_PREFIX}#{id}"
+    end
+
+    # Records the session checked out for +key+ from its tag. Returns the
+    # session id and the rest of the tag, or nil when nothing remains.
+    def checked_out(key, tag)
+      id, rest = split_tag(tag)
+      @mutex.synchronize do
+        @checkouts += 1
+        @affinity_hits += 1 if id && @last_session[key] == id
+        id ||= (@next_id += 1)
+        @last_session.delete(key)
+        @last_session.shift if @last_session.length >= @max_keys
+        @last_session[key] = id
+        @caches[id] = @caches.delete(id) || {}
+        @caches.shift if @caches.length > @max_sessions
+      end
+      [id, rest]
+    end
+
+    def tag(id)
+      "#{TAG_PREFIX}#{id}"
+    end
+
+    # Records that +sql+ is prepared on the session +id+.
+    def prepared(id, sql)
+      @mutex.synchronize do
+        cache = (@caches[id] ||= {})
+        @prepares += 1
+        if cache.delete(sql)
+          @hits += 1
+        elsif cache.length >= @stmt_cache_size
+          cache.shift
+        end
+        cache[sql] = true if @stmt_cache_size > 0
+      end
+    end
+
+    def stats
+      @mutex.synchronize do
+        {
+          stmt_cache_size: @stmt_cache_size,
+          prepares: @prepares,
+          stmt_cache_hits: @hits,
+          stmt_cache_hit_rate: @prepares == 0 ? nil : @hits.fdiv(@prepares),
+          checkouts: @checkouts,
+          affinity_hits: @affinity_hits,
+        }
+      end
+    end
+
+    private
+
+    def split_tag(tag)
+      return [nil, nil] if tag.nil? || !tag.start_with?(TAG_PREFIX)
+      id, rest = tag[TAG_PREFIX.length..-1].split(';', 2)
+      [Integer(id, exception: false), rest]
+    end
+  end
+end
@@ -32,9 +32,23 @@
 
 module ODPI
   class Statement
-    def initialize(conn, stmt)
+    # Methods which call ODPI-C with the connection's session. They are
+    # serialized by the connection lock when the connection is thread-safe.
+    module Locked
+      [:bind, :[], :[]=, :define, :query_columns, :row_count, :execute, :fetch,
+       :fetch_rows, :copy_to, :copy_from, :copy_from_columns, :close].each do |name|
+        define_method(name) do |*args, **kwargs, &block|
+          return super(*args, **kwargs, &block) if @lock.nil?
+          @lock.synchronize { super(*args, **kwargs, &block) }
+        end
+      end
+    end
+    prepend Locked
+
+    def initialize(conn, stmt, lock = nil)
       @conn = conn
       @stmt = stmt
+      @lock = lock
       @column_vars = []
       @column_info = nil
       @bind_vars = {}
@@ -108,8 +122,12 @@ module ODPI
       @stmt.query_columns
     end
 
+    def row_count
+      @stmt.row_count
+    end
+
     def execute(binds = nil, defines = nil, params = nil)
-      @stmt.execute(:default)
+      @stmt.execute(:default, @conn)
       if @stmt.query?
         @stmt.query_columns.each_with_index do |col, idx|
           unless @column_vars[idx]
@@ -128,7 +146,7 @@ module ODPI
     end
 
     def fetch
-      idx = @stmt.fetch
+      idx = @stmt.fetch(@conn)
       if idx
         @column_vars.collect do |var|
           var[idx]
@@ -136,12 +154,86 @@ module ODPI
       end
     end
 
+    # Returns up to +max_rows+ rows as an array, or nil when no rows remain.
+    # The GVL is released while rows are transferred from the server.
+    def fetch_rows(max_rows = fetch_array_size)
+      idx, num_rows, _ = @stmt.fetch_rows(max_rows, @conn)
+      return nil if idx.nil?
+      (idx...(idx + num_rows)).collect do |i|
+        @column_vars.collect do |var|
+          var[i]
+        end
+      end
+    end
+
+    # Writes remaining rows to +io+ as CSV or TSV (+format+ is +:csv+ or +:tsv+),
+    # JSON objects keyed by column names (+:ndjson+ or +:json_array+)
+    # or as an Arrow IPC stream or file (+:arrow_stream+ or +:arrow_file+).
+    # Arrow NUMBER columns are decimal128 when their precision fits, and
+    # otherwise exact decimal text unless <tt>number: :float64</tt> is given.
+    # Rows are formatted in C and passed to +io.write+ by chunks.
+    # The block, if given, is called with the number of rows written
+    # every +progress_interval+ rows, or after each record batch for Arrow.
+    def copy_to(io, format: :csv, **params, &block)
+      execute unless @executed
+      raise "#{self.class}#copy_to is available only for queries" unless @stmt.query?
+      params[:progress] = block if block
+      @stmt.copy_to(@conn, @column_vars.collect(&:raw_var), io, format, params)
+    end
+
+    # Yields remaining rows encoded as JSON by chunks of about +chunk_size+ bytes.
+    def each_json_chunk(format: :ndjson, **params, &block)
+      return enum_for(__method__, format: format, **params) unless block
+      copy_to(ChunkWriter.new(block), format: format, **params)
+    end
+
+    # Loads CSV or TSV from +io+ by executing this INSERT or MERGE statement
+    # +batch_size+ rows at a time. +columns+ lists the bind types of positional
+    # bind variables, such as <tt>[Integer, [String, {length: 100}], Time]</tt>.
+    # When +format+ is +:arrow+, +io+ is an Arrow IPC stream or file and
+    # bind types are taken from its schema instead.
+    # Rows rejected by the parser or the database don't abort the load.
+    # Returns <tt>[number_of_loaded_rows, [[record_number, exception], ...]]</tt>.
+    def copy_from(io, columns: nil, batch_size: 1000, format: :csv, **params, &block)
+      raise "#{self.class}#copy_from is available only for DML" unless @stmt.dml?
+      params[:progress] = block if block
+      return @stmt.copy_from_arrow(@conn, io, batch_size, params) if format == :arrow
+      raise ArgumentError, "missing keyword: :columns" if columns.nil?
+      vars = columns.each_with_index.collect do |column, idx|
+        type, type_params = column
+        var = make_var(nil, type, {length: 4000}.merge(type_params || {}), batch_size)
+        @stmt.bind_by_pos(idx + 1, var.raw_var)
+        @bind_vars[idx + 1] = var
+      end
+      @stmt.copy_from(@conn, vars.collect(&:raw_var), io, format, params)
+    end
+
+    # Loads packed column buffers laid out as Arrow arrays, keyed by bind
+    # names or positions: <tt>{id: {type: :int64, values: ids.pack('q*')},
+    # name: {type: :utf8, values: str, offsets: offsets.pack('l*'), validity: bitmap}}</tt>.
+    # Types are +:int8+ .. +:int64+, +:uint8+ .. +:uint64+, +:float32+, +:float64+,
+    # +:bool+, +:utf8+, +:binary+, +:date32+ and +:timestamp+ (+unit:+ +:s+, +:ms+,
+    # +:us+ or +:ns+; +tz: true+ for UTC values). +length:+, the number of rows,
+    # is required when all columns are +:bool+. Returns the same as #copy_from.
+    def copy_from_columns(columns, batch_size: 1000, **params, &block)
+      raise "#{self.class}#copy_from_columns is available only for DML" unless @stmt.dml?
+      params[:progress] = block if block
+      @stmt.copy_from_columns(@conn, columns, batch_size, params)
+    end
+
     def close
       @stmt.close(nil)
     end
 
     private
 
+    ChunkWriter = Struct.new(:block) do
+      def write(chunk)
+        block.call(chunk)
+        chunk.bytesize
+      end
+    end
+
     def make_var(value, type, params, array_size)
       is_array = false
       array_size ||= params[:max_array_size]
@@ -0,0 +1,198 @@
+# tenant_pools.rb -- part of ruby-odpi
+#
+# URL: https://github.com/kubo/ruby-odpi
+#
+# ------------------------------------------------------
+#
+# Copyright 2017 Kubo Takehiro <kubo@jiubao.org>
+#
+# Redistribution and use in source and binary forms, with or without modification, are
+# permitted provided that the following conditions are met:
+#
+#    1. Redistributions of source code must retain the above copyright notice, this list of
+#       conditions and the following disclaimer.
+#
+#    2. Redistributions in binary form must reproduce the above copyright notice, this list
+#       of conditions and the following disclaimer in the documentation and/or other materials
+#       provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY EXPRESS OR IMPLIED
+# WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+# FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+# ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+# NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+# ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+# The views and conclusions contained in the software and documentation are those of the
+# authors and should not be interpreted as representing official policies, either expressed
+# or implied, of the authors.
+
+
+module ODPI
+  # Manages small pools created on demand for each tenant, such as
+  # a schema, within a global session budget.
+  #
+  # Each tenant's pool may open up to +max_sessions_per_tenant+ sessions,
+  # which count against +session_budget+. When a new tenant doesn't fit
+  # in the budget, the least recently used idle pools are closed; when
+  # none is idle, the caller waits up to +wait_timeout+ seconds. Pools
+  # idle longer than +idle_timeout+ seconds are also closed.
+  #
+  # Pool parameters are +params+ merged with those returned by the block
+  # for the tenant, e.g. its username and password. SQL prepared in any
+  # tenant is counted, and the +warm_up+ most frequent statements are
+  # prepared on the first session of each new pool (see Pool#warm_up).
+  class TenantPools
+    # Raised when the session budget stays exhausted.
+    class BudgetExceededError < StandardError; end
+
+    Entry = Struct.new(:tenant, :pool, :lock, :active, :last_used)
+
+    # Maximum number of distinct SQL texts counted for warm-up.
+    MAX_HOT_SQL = 1000
+
+    def initialize(params = {}, session_budget:, max_sessions_per_tenant: 2, idle_timeout: 300,
+                   wait_timeout: nil, warm_up: 20, &tenant_params)
+      @params = params
+      @session_budget = session_budget
+      @max_sessions = max_sessions_per_tenant
+      @idle_timeout = idle_timeout
+      @wait_timeout = wait_timeout
+      @warm_up = warm_up
+      @tenant_params = tenant_params
+      @mutex = Mutex.new
+      @cond = ConditionVariable.new
+      @entries = {} # tenant => Entry in LRU order
+      @hot_sql = Hash.new(0)
+      @creations = 0
+      @evictions = 0
+    end
+
+    # Yields a connection of the tenant's pool. See Pool#with_connection.
+    def with_connection(tenant, **params)
+      entry, evicted = checkout_entry(tenant)
+      begin
+        evicted.each { |victim| close_pool(victim) }
+        pool = entry.lock.synchronize { entry.pool ||= create_pool(tenant) }
+        pool.with_connection(**params) do |conn|
+          chained = conn.on_prepare
+          conn.on_prepare = lambda do |sql|
+            chained.call(sql) if chained
+            count_sql(sql)
+          end
+          yield conn
+        end
+      ensure
+        @mutex.synchronize do
+          entry.active -= 1
+          entry.last_used = clock
+          @cond.broadcast
+        end
+      end
+    end
+
+    def stats
+      @mutex.synchronize do
+        {
+          tenants: @entries.length,
+          active_tenants: @entries.each_value.count { |entry| entry.active > 0 },
+          reserved_sessions: @entries.length * @max_sessions,
+          session_budget: @session_budget,
+          creations: @creations,
+          evictions: @evictions,
+        }
+      end
+    end
+
+    def close
+      entries = @mutex.synchronize do
+        @entries.values.tap { @entries.clear }
+      end
+      entries.each { |entry| close_pool(entry) }
+    end
+
+    private
+
+    # Returns the entry of +tenant+, marked active, and evicted entries
+    # whose pools must be closed.
+    def checkout_entry(tenant)
+      evicted = []
+      @mutex.synchronize do
+        deadline = @wait_timeout && clock + @wait_timeout
+        loop do
+          evict_expired(evicted)
+          entry = @entries.delete(tenant)
+          if entry.nil?
+            while @entries.length * @max_sessions + @max_sessions > @session_budget
+              _, victim = @entries.find { |_, e| e.active == 0 }
+              break unless victim
+              @entries.delete(victim.tenant)
+              evicted << victim
+              @evictions += 1
+            end
+            if @entries.length * @max_sessions + @max_sessions <= @session_budget
+              entry = Entry.new(tenant, nil, Mutex.new, 0, clock)
+            end
+          end
+          if entry
+            @entries[tenant] = entry
+            entry.active += 1
+            return entry, evicted
+          end
+          rest = deadline && deadline - clock
+          if rest && rest <= 0
+            raise BudgetExceededError, "all of #{@session_budget} sessions are reserved by active tenants"
+          end
+          @cond.wait(@mutex, rest)
+        end
+      end
+    rescue Exception
+      evicted.each { |victim| close_pool(victim) }
+      raise
+    end
+
+    def evict_expired(evicted)
+      now = clock
+      @entries.delete_if do |_, entry|
+        next false unless entry.active == 0 && now - entry.last_used > @idle_timeout
+        evicted << entry
+        @evictions += 1
+        true
+      end
+    end
+
+    def create_pool(tenant)
+      params = @params.merge(@tenant_params ? @tenant_params.call(tenant) : {})
+      params[:name] ||= "tenant-#{tenant}"
+      params[:min_sessions] = 0
+      params[:max_sessions] = @max_sessions
+      params[:session_increment] = 1
+      pool = Pool.new(params)
+      statements = @mutex.synchronize do
+        @creations += 1
+        @hot_sql.max_by(@warm_up) { |_, count| count }.collect(&:first)
+      end
+      pool.warm_up(sessions: 1, statements: statements) unless statements.empty?
+      pool
+    end
+
+    def close_pool(entry)
+      pool = entry.lock.synchronize { entry.pool.tap { entry.pool = nil } }
+      pool.close if pool
+    end
+
+    def count_sql(sql)
+      @mutex.synchronize do
+        @hot_sql.shift if @hot_sql.length >= MAX_HOT_SQL && !@hot_sql.key?(sql)
+        @hot_sql[sql] += 1
+      end
+    end
+
+    def clock
+      Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    end
+  end
+end
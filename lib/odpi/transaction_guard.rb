@@ -0,0 +1,177 @@
+# transaction_guard.rb -- part of ruby-odpi
+#
+# URL: https://github.com/kubo/ruby-odpi
+#
+# ------------------------------------------------------
+#
+# Copyright 2017 Kubo Takehiro <kubo@jiubao.org>
+#
+# Redistribution and use in source and binary forms, with or without modification, are
+# permitted provided that the following conditions are met:
+#
+#    1. Redistributions of source code must retain the above copyright notice, this list of
+#       conditions and the following disclaimer.
+#
+#    2. Redistributions in binary form must reproduce the above copyright notice, this list
+#       of conditions and the following disclaimer in the documentation and/or other materials
+#       provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHORS ''AS IS'' AND ANY EXPRESS OR IMPLIED
+# WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+# FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+# CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+# ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+# NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+# ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+# The views and conclusions contained in the software and documentation are those of the
+# authors and should not be interpreted as representing official policies, either expressed
+# or implied, of the authors.
+
+
+module ODPI
+  # Runs a transaction on a connection of +pool+ and commits it. When a
+  # recoverable error, such as a RAC node failover, breaks the session,
+  # the transaction is replayed on a new session.
+  #
+  # The session's LTXID (logical transaction ID) is saved before commit.
+  # When the commit itself fails, the outcome is looked up on a new session
+  # with DBMS_APP_CONT.GET_LTXID_OUTCOME, which also blocks the lost
+  # transaction from committing later. The block is replayed only when the
+  # transaction is known not to have committed; otherwise the result of
+  # its last run is returned. Errors raised before commit are replayed
+  # without the lookup.
+  #
+  # The block must not commit by itself. The service needs COMMIT_OUTCOME
+  # enabled and the user needs EXECUTE on DBMS_APP_CONT.
+  #
+  #   guard = ODPI::TransactionGuard.new(pool, retries: 3)
+  #   guard.run do |conn|
+  #     conn.execute_and_fetch('UPDATE accounts SET balance = balance - :1 WHERE id = :2', [amount, id])
+  #   end
+  class TransactionGuard
+    # Raised when the outcome of a failed commit can't be determined, e.g.
+    # no LTXID is available because Transaction Guard isn't enabled.
+    # The original error is available as +cause+.
+    class UnknownOutcomeError < StandardError; end
+
+    OUTCOME_SQL = <<-EOS
+DECLARE
+  committed BOOLEAN;
+  completed BOOLEAN;
+BEGIN
+  DBMS_APP_CONT.GET_LTXID_OUTCOME(:ltxid, committed, completed);
+  :committed := CASE WHEN committed THEN 1 ELSE 0 END;
+END;
+EOS
+
+    # +params+ are passed to <tt>pool.connection</tt>. A failed attempt
+    # waits +retry_delay+ seconds times the number of attempts so far.
+    def initialize(pool, retries: 3, retry_delay: 0.1, **params)
+      @pool = pool
+      @retries = retries
+      @retry_delay = retry_delay
+      @params = params
+      @mutex = Mutex.new
+      @stats = {runs: 0, commits: 0, replays: 0, outcome_lookups: 0, committed_on_failover: 0}
+    end
+
+    # Yields a connection, commits and returns the block's value.
+    def run
+      count(:runs)
+      attempt = 0
+      loop do
+        conn = nil
+        ltxid = nil
+        begin
+          conn = @pool.connection(@params)
+          result = yield conn
+          # An empty LTXID marks that commit was called without one.
+          ltxid = conn.raw_connection.ltxid || ''
+          conn.commit
+        rescue Dpi::Error => e
+          unless e.is_recoverable?
+            release(conn)
+            raise
+          end
+          # The session is broken.
+          begin
+            conn.drop if conn
+          rescue StandardError
+          end
+          if ltxid
+            raise UnknownOutcomeError, "commit failed without LTXID: #{e.message}" if ltxid.empty?
+            if committed?(ltxid)
+              count(:committed_on_failover)
+              return result
+            end
+          end
+          raise if attempt >= @retries
+          attempt += 1
+          count(:replays)
+          sleep(@retry_delay * attempt) if @retry_delay > 0
+          next
+        rescue Exception
+          release(conn)
+          raise
+        end
+        conn.close
+        count(:commits)
+        return result
+      end
+    end
+
+    def stats
+      @mutex.synchronize { @stats.dup }
+    end
+
+    private
+
+    # Rolls back and returns a healthy session to the pool.
+    def release(conn)
+      return unless conn
+      begin
+        conn.rollback
+      ensure
+        conn.close
+      end
+    rescue StandardError
+    end
+
+    # Returns whether the transaction of +ltxid+ committed, retrying
+    # recoverable errors of the lookup itself.
+    def committed?(ltxid)
+      count(:outcome_lookups)
+      attempt = 0
+      begin
+        conn = @pool.connection(@params)
+        begin
+          stmt = conn.prepare(OUTCOME_SQL)
+          begin
+            stmt.bind('ltxid', ltxid, :raw)
+            stmt.bind('committed', nil, Integer)
+            stmt.execute
+            stmt['committed'] == 1
+          ensure
+            stmt.close
+          end
+        ensure
+          conn.close
+        end
+      rescue Dpi::Error => e
+        if e.is_recoverable? && attempt < @retries
+          attempt += 1
+          sleep(@retry_delay * attempt) if @retry_delay > 0
+          retry
+        end
+        raise UnknownOutcomeError, "could not get the outcome of the failed commit: #{e.message}"
+      end
+    end
+
+    def count(key)
+      @mutex.synchronize { @stats[key] += 1 }
+    end
+  end
+end
@@ -0,0 +1,75 @@
+#-----------------------------------------------------------------------------
+# test_broker.rb
+#   Tests round trips between a connection broker and its clients over
+#   a Unix socket. A fake backend stands in for the database, so this
+#   runs without one.
+#-----------------------------------------------------------------------------
+
+require 'odpi'
+require 'tmpdir'
+
+def check(label, expected, actual)
+  if expected != actual
+    raise "#{label}: expected #{expected.inspect} but got #{actual.inspect}"
+  end
+  puts "#{label}: OK"
+end
+
+now = Time.at(1500000000, 123456789, :nsec)
+rows = (1..2500).collect do |i|
+  [i, i.odd? ? "name #{i} é" : nil, i * 0.5, now + i, BigDecimal("1.#{i}"), [i].pack('N') + "\xff".b]
+end
+
+backend = ODPI::Broker::FakeBackend.new do |sql, binds|
+  # echo binds back as a row
+  sql == 'SELECT :binds FROM dual' ? [binds.each_index.collect { |i| "B#{i + 1}" }, [binds]] : nil
+end
+backend.add('SELECT * FROM TestRows', %w[ID NAME HALF TS NUM RAW], rows)
+backend.add('SELECT * FROM TestRows WHERE 1 = 0', %w[ID], [])
+backend.add(/\AUPDATE /, 3)
+backend.add('DELETE FROM TestRows', ODPI::Broker::RemoteError.new(2292, 'ORA-02292: integrity constraint violated'))
+
+Dir.mktmpdir do |dir|
+  server = ODPI::Broker::Server.new(File.join(dir, 'broker.sock'), backend, batch_size: 1000).start
+  client = ODPI::Broker::Client.new(server.path)
+  begin
+    check('query', rows, client.execute('SELECT * FROM TestRows'))
+    check('empty query', [], client.execute('SELECT * FROM TestRows WHERE 1 = 0'))
+
+    batches = []
+    client.execute('SELECT * FROM TestRows') { |batch, columns| batches << [batch.length, columns.length] }
+    check('batches', [[1000, 6], [1000, 6], [500, 6]], batches)
+
+    binds = [1, -2**63, 2**64, 1.5, BigDecimal('0.1'), 'text', "\x00\xff".b, now, nil, true, false]
+    check('binds', [binds], client.execute('SELECT :binds FROM dual', binds))
+    check('binary binds', Encoding::BINARY, client.execute('SELECT :binds FROM dual', ["\xff".b])[0][0].encoding)
+
+    check('dml', 3, client.execute('UPDATE TestRows SET name = :name', {'name' => 'x'}, commit: true))
+    check('commit flag', ['UPDATE TestRows SET name = :name', {'name' => 'x'}, true], backend.requests.last)
+
+    begin
+      client.execute('DELETE FROM TestRows')
+      raise 'no error'
+    rescue ODPI::Broker::RemoteError => e
+      check('error code', 2292, e.code)
+    end
+    check('after error', 3, client.execute('UPDATE TestRows SET id = id'))
+
+    results = Array.new(8) do
+      Thread.new { client.execute('SELECT * FROM TestRows').length }
+    end.collect(&:value)
+    check('threads', [rows.length] * 8, results)
+
+    pid = fork do
+      exit!(client.execute('SELECT * FROM TestRows') == rows ? 0 : 1)
+    end
+    Process.wait(pid)
+    check('forked child', true, $?.success?)
+  ensure
+    client.close
+    server.stop
+  end
+  check('socket removed', false, File.exist?(server.path))
+end
+
+puts "Done."
@@ -0,0 +1,141 @@
+#-----------------------------------------------------------------------------
+# test_checkout_queue.rb
+#   Tests permit accounting and dispatch order of ODPI::CheckoutQueue,
+#   which Pool#connection waits on. No database is needed.
+#-----------------------------------------------------------------------------
+
+require 'odpi'
+
+def check(label, expected, actual)
+  if expected != actual
+    raise "#{label}: expected #{expected.inspect} but got #{actual.inspect}"
+  end
+  puts "#{label}: OK"
+end
+
+def wait_until
+  100.times do
+    return if yield
+    sleep 0.01
+  end
+  raise 'timed out'
+end
+
+# Starts a thread per name in order, each after the previous one waits.
+def start_waiters(queue, names, order, klass = nil)
+  names.collect do |name|
+    waiting = queue.stats[:waiting]
+    thread = Thread.new do
+      queue.acquire(nil, klass.respond_to?(:call) ? klass.call(name) : klass)
+      order << name
+    end
+    wait_until { queue.stats[:waiting] == waiting + 1 }
+    thread
+  end
+end
+
+def timeout?(queue, klass = nil)
+  queue.acquire(0.05, klass)
+  queue.release(klass)
+  false
+rescue ODPI::CheckoutQueue::TimeoutError
+  true
+end
+
+# FIFO dispatch within a class
+queue = ODPI::CheckoutQueue.new(1)
+queue.acquire
+order = Queue.new
+threads = start_waiters(queue, [1, 2, 3], order)
+3.times { queue.release }
+threads.each(&:join)
+check('fifo', [1, 2, 3], Array.new(3) { order.pop })
+queue.release
+check('fifo in_use', 0, queue.stats[:in_use])
+
+# A released permit goes to the highest-priority class first.
+queue = ODPI::CheckoutQueue.new(1, classes: {high: {}, low: {}})
+queue.acquire(nil, :low)
+order = Queue.new
+threads = start_waiters(queue, [:low, :high], order, ->(name) { name })
+queue.release(:low)
+threads[1].join
+check('priority', :high, order.pop)
+queue.release(:high)
+threads[0].join
+check('priority then low', :low, order.pop)
+queue.release(:low)
+
+# reserved permits are kept for their class
+queue = ODPI::CheckoutQueue.new(2, classes: {high: {reserved: 1}, low: {}})
+queue.acquire(nil, :low)
+check('reserved blocks others', true, timeout?(queue, :low))
+check('reserved for its class', false, timeout?(queue, :high))
+check('try_acquire honors reserved', false, queue.try_acquire)
+queue.release(:low)
+
+# max_share caps what a class holds at once.
+queue = ODPI::CheckoutQueue.new(4, classes: {online: {}, batch: {max_share: 0.5}})
+2.times { queue.acquire(nil, :batch) }
+check('max_share', true, timeout?(queue, :batch))
+check('max_share leaves others', false, timeout?(queue, :online))
+stats = queue.stats
+check('class in_use', {online: 0, batch: 2}, stats[:classes].transform_values { |cls| cls[:in_use] })
+check('class timeouts', {online: 0, batch: 1}, stats[:classes].transform_values { |cls| cls[:timeouts] })
+2.times { queue.release(:batch) }
+
+begin
+  ODPI::CheckoutQueue.new(2, classes: {a: {reserved: 2}, b: {reserved: 1}})
+  raise 'no error'
+rescue ArgumentError
+  check('reserved over size', true, true)
+end
+
+# A timed-out waiter leaves nothing behind.
+queue = ODPI::CheckoutQueue.new(1)
+queue.acquire
+check('timeout', true, timeout?(queue))
+stats = queue.stats
+check('timeout waiting', 0, stats[:waiting])
+check('timeout count', 1, stats[:timeouts])
+queue.release
+check('permit not lost', false, timeout?(queue))
+check('in_use after timeout', 0, queue.stats[:in_use])
+
+# A killed waiter leaves nothing behind either.
+queue.acquire
+thread = Thread.new { queue.acquire }
+wait_until { queue.stats[:waiting] == 1 }
+thread.kill.join
+check('killed waiting', 0, queue.stats[:waiting])
+queue.release
+check('in_use after kill', 0, queue.stats[:in_use])
+
+# max_waiters
+queue = ODPI::CheckoutQueue.new(1, max_waiters: 1)
+queue.acquire
+threads = start_waiters(queue, [1], Queue.new)
+begin
+  queue.acquire
+  raise 'no error'
+rescue ODPI::CheckoutQueue::QueueFullError
+  check('queue full', 1, queue.stats[:rejections])
+end
+2.times { queue.release }
+threads.each(&:join)
+
+# Raising the limit dispatches waiters.
+queue = ODPI::CheckoutQueue.new(3)
+queue.limit = 1
+queue.acquire
+check('limit', true, timeout?(queue))
+order = Queue.new
+threads = start_waiters(queue, [1], order)
+queue.limit = 2
+threads.each(&:join)
+check('raised limit', 1, order.pop)
+check('limit in_use', 2, queue.stats[:in_use])
+queue.limit = 0
+check('limit floor', 1, queue.limit)
+
+puts "Done."
@@ -0,0 +1,109 @@
+#-----------------------------------------------------------------------------
+# test_circuit_breaker.rb
+#   Tests state transitions of ODPI::CircuitBreaker with simulated
+#   connection errors. No database is needed.
+#-----------------------------------------------------------------------------
+
+require 'odpi'
+
+def check(label, expected, actual)
+  if expected != actual
+    raise "#{label}: expected #{expected.inspect} but got #{actual.inspect}"
+  end
+  puts "#{label}: OK"
+end
+
+RESET_TIMEOUT = 0.1
+NO_LISTENER = ODPI::Dpi::Error.new('ORA-12541: TNS:no listener', 12541)
+INVALID_PASSWORD = ODPI::Dpi::Error.new('ORA-01017: invalid username/password; logon denied', 1017)
+
+def attempt(breaker, error = nil)
+  breaker.run do
+    raise error if error
+    :connected
+  end
+rescue ODPI::Dpi::Error, ODPI::CircuitBreaker::OpenError => e
+  e.class
+end
+
+def open_breaker(breaker)
+  attempt(breaker, NO_LISTENER) until breaker.state == :open
+end
+
+changes = []
+breaker = ODPI::CircuitBreaker.new(failure_threshold: 2, reset_timeout: RESET_TIMEOUT,
+                                   on_state_change: ->(from, to) { changes << [from, to] })
+
+# closed
+check('closed', :connected, attempt(breaker))
+check('one failure', ODPI::Dpi::Error, attempt(breaker, NO_LISTENER))
+check('failures', 1, breaker.stats[:failures])
+attempt(breaker, INVALID_PASSWORD)
+check('other errors reset failures', 0, breaker.stats[:failures])
+check('still closed', :closed, breaker.state)
+
+# closed -> open
+attempt(breaker, NO_LISTENER)
+attempt(breaker, NO_LISTENER)
+check('open', :open, breaker.state)
+called = false
+begin
+  breaker.run { called = true }
+rescue ODPI::CircuitBreaker::OpenError
+end
+check('open skips the block', false, called)
+check('rejections', 1, breaker.stats[:rejections])
+
+# open -> half_open -> open
+sleep RESET_TIMEOUT
+check('failed probe', ODPI::Dpi::Error, attempt(breaker, NO_LISTENER))
+check('open again', :open, breaker.state)
+
+# open -> half_open -> closed, with one probe at a time
+sleep RESET_TIMEOUT
+probing = Queue.new
+proceed = Queue.new
+probe = Thread.new do
+  breaker.run do
+    probing.push(true)
+    proceed.pop
+    :connected
+  end
+end
+probing.pop
+check('half_open', :half_open, breaker.state)
+check('one probe at a time', ODPI::CircuitBreaker::OpenError, attempt(breaker))
+proceed.push(true)
+check('probe', :connected, probe.value)
+check('closed after probe', :closed, breaker.state)
+
+check('transitions', [[:closed, :open], [:open, :half_open], [:half_open, :open],
+                      [:open, :half_open], [:half_open, :closed]], changes)
+
+# A probe ended by another error or by Thread#kill lets the next caller probe.
+open_breaker(breaker)
+sleep RESET_TIMEOUT
+begin
+  breaker.run { raise 'not a database error' }
+rescue RuntimeError
+end
+check('probe after other error', :connected, attempt(breaker))
+check('closed after other error', :closed, breaker.state)
+
+open_breaker(breaker)
+sleep RESET_TIMEOUT
+probe = Thread.new do
+  breaker.run do
+    probing.push(true)
+    sleep
+  end
+end
+probing.pop
+probe.kill.join
+check('probe after kill', :connected, attempt(breaker))
+check('closed after kill', :closed, breaker.state)
+
+check('from_param', nil, ODPI::CircuitBreaker.from_param(false))
+check('from_param hash', ODPI::CircuitBreaker, ODPI::CircuitBreaker.from_param(reset_timeout: 1).class)
+
+puts "Done."
@@ -0,0 +1,66 @@
+#-----------------------------------------------------------------------------
+# test_concurrency_limiter.rb
+#   Tests AIMD limit changes of ODPI::ConcurrencyLimiter with simulated
+#   execute latencies. No database is needed.
+#-----------------------------------------------------------------------------
+
+require 'odpi'
+
+def check(label, expected, actual)
+  if expected != actual
+    raise "#{label}: expected #{expected.inspect} but got #{actual.inspect}"
+  end
+  puts "#{label}: OK"
+end
+
+COOLDOWN = 0.1
+
+queue = ODPI::CheckoutQueue.new(10)
+limiter = ODPI::ConcurrencyLimiter.new(queue, min_limit: 2, initial_limit: 4, backoff: 0.5, cooldown: COOLDOWN)
+check('initial limit', 4, queue.limit)
+
+# no increase unless the limit is fully used
+limiter.observe_latency(0.01)
+check('not fully used', 4, limiter.stats[:limit])
+check('baseline', 0.01, limiter.stats[:baseline_latency])
+
+# additive increase: one per limit's worth of samples
+4.times { queue.acquire }
+4.times { limiter.observe_latency(0.01) }
+check('before increase', 4, limiter.stats[:limit])
+limiter.observe_latency(0.01)
+check('increase', 5, limiter.stats[:limit])
+check('queue limit', 5, queue.limit)
+
+# multiplicative decrease when latency exceeds tolerance * baseline
+limiter.observe_latency(0.019)
+check('within tolerance', 5, limiter.stats[:limit])
+limiter.observe_latency(0.1)
+check('decrease', 2, limiter.stats[:limit])
+check('queue limit after decrease', 2, queue.limit)
+check('baseline rises slowly', true, limiter.stats[:baseline_latency] < 0.012)
+
+# at most once per cooldown, and never below min_limit
+limiter.observe_latency(0.1)
+check('cooldown', 2, limiter.stats[:limit])
+sleep COOLDOWN
+limiter.observe_latency(0.1)
+check('min_limit', 2, limiter.stats[:limit])
+4.times { queue.release }
+
+# connection stats
+limiter.observe(executes: 0, execute_time: 0.0)
+check('no executes', 2, limiter.stats[:limit])
+limiter.observe(executes: 4, execute_time: 0.02)
+check('lower baseline', 0.005, limiter.stats[:baseline_latency])
+
+# max_limit defaults to the queue size
+queue = ODPI::CheckoutQueue.new(3)
+limiter = ODPI::ConcurrencyLimiter.new(queue, initial_limit: 2)
+2.times { queue.acquire }
+20.times { limiter.observe_latency(0.01) }
+check('max_limit', 3, limiter.stats[:limit])
+check('queue limit at max', 3, queue.limit)
+2.times { queue.release }
+
+puts "Done."
@@ -0,0 +1,114 @@
+#-----------------------------------------------------------------------------
+# test_future.rb
+#   Tests completion, cancellation and deadlines of ODPI::Future.
+#   Fake connections stand in for the database, so this runs without one.
+#-----------------------------------------------------------------------------
+
+require 'odpi'
+
+def check(label, expected, actual)
+  if expected != actual
+    raise "#{label}: expected #{expected.inspect} but got #{actual.inspect}"
+  end
+  puts "#{label}: OK"
+end
+
+def error_of(future)
+  future.value
+  nil
+rescue StandardError => e
+  e.class
+end
+
+# A connection whose break interrupts the call in progress.
+class FakeConnection
+  attr_reader :breaks
+
+  def initialize(break_error = nil)
+    @break_error = break_error
+    @call = Queue.new
+    @breaks = 0
+  end
+
+  def raw_connection
+    self
+  end
+
+  # Blocks until broken.
+  def call
+    @call.pop
+  end
+
+  def break
+    @breaks += 1
+    @call.push(:broken)
+    raise @break_error if @break_error
+  end
+end
+
+ODPI::Future.max_threads = 2
+
+# value and errors
+check('value', 3, ODPI::Future.execute { 1 + 2 }.value)
+check('error', ZeroDivisionError, error_of(ODPI::Future.execute { 1 / 0 }))
+future = ODPI::Future.execute { sleep 0.2; :late }
+check('wait timeout', false, future.wait(0.01))
+check('value timeout', nil, future.value(0.01))
+check('not done', false, future.done?)
+check('late value', :late, future.value)
+check('done', true, future.done?)
+check('cancel done', false, future.cancel)
+
+# A pending future is failed without running the block.
+release = Queue.new
+blockers = Array.new(2) { ODPI::Future.execute { release.pop } }
+ran = false
+pending = ODPI::Future.execute { ran = true }
+check('cancel pending', true, pending.cancel)
+check('cancelled pending', ODPI::Future::Cancelled, error_of(pending))
+2.times { release.push(true) }
+blockers.each(&:value)
+check('block not run', false, ran)
+
+# A running future breaks the call on its connection.
+conn = FakeConnection.new
+started = Queue.new
+future = ODPI::Future.execute(conn) do
+  started.push(true)
+  conn.call
+end
+started.pop
+check('cancel running', true, future.cancel)
+check('cancel twice', true, future.cancel)
+check('cancelled running', ODPI::Future::Cancelled, error_of(future))
+check('one break', 1, conn.breaks)
+
+# connection= after cancellation raises, e.g. after a pool checkout.
+checked_out = Queue.new
+future = ODPI::Future.execute do |f|
+  started.push(true)
+  checked_out.pop
+  f.connection = FakeConnection.new
+  :not_reached
+end
+started.pop
+future.cancel
+checked_out.push(true)
+check('connection= after cancel', ODPI::Future::Cancelled, error_of(future))
+
+# deadlines
+conn = FakeConnection.new
+future = ODPI::Future.execute(conn, deadline: 0.05) { conn.call }
+check('deadline', ODPI::Future::DeadlineExceeded, error_of(future))
+check('deadline break', 1, conn.breaks)
+check('no deadline reached', :fast, ODPI::Future.execute(deadline: 1) { :fast }.value)
+
+# A failing break neither blocks #wait nor stops later deadlines.
+conn = FakeConnection.new(IOError.new('session is dead'))
+future = ODPI::Future.execute(conn, deadline: 0.05) { conn.call }
+check('failing break', ODPI::Future::DeadlineExceeded, error_of(future))
+conn = FakeConnection.new
+future = ODPI::Future.execute(conn, deadline: 0.05) { conn.call }
+check('deadline after failing break', ODPI::Future::DeadlineExceeded, error_of(future))
+
+puts "Done."
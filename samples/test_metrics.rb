@@ -0,0 +1,88 @@
+#-----------------------------------------------------------------------------
+# test_metrics.rb
+#   Tests snapshots and the Prometheus text output of ODPI::Metrics.
+#   A fake pool stands in for ODPI::Pool, so this runs without a database.
+#-----------------------------------------------------------------------------
+
+require 'odpi'
+
+def check(label, expected, actual)
+  if expected != actual
+    raise "#{label}: expected #{expected.inspect} but got #{actual.inspect}"
+  end
+  puts "#{label}: OK"
+end
+
+class FakePool
+  def stats
+    {open_count: 4, busy_count: 2, waiting: 1, session_growth: 4, acquires: 10,
+     acquire_time: 0.25, timeouts: 0, rejections: 1}
+  end
+end
+
+metrics = ODPI::Metrics.new
+pool = FakePool.new
+metrics.register_pool('main', pool)
+metrics.observe_checkout('main', 0.0002, :interactive)
+metrics.observe_checkout('main', 0.003, :interactive)
+metrics.observe_checkout('main', 20, :batch)
+metrics.observe_checkin('main', 0.5, executes: 3, execute_time: 0.125, fetches: 2, fetch_time: 0.5, fetched_rows: 150)
+metrics.observe_checkin('main', 0.75, executes: 1, execute_time: 0.125, fetches: 0, fetch_time: 0.0, fetched_rows: 0)
+metrics.observe_checkout('unknown', 1, :interactive)
+metrics.observe_checkin('unknown', 1, executes: 1)
+
+# Histogram
+hist = ODPI::Metrics::Histogram.new([1, 2, 5])
+[0.5, 1, 1.5, 10].each { |val| hist.observe(val) }
+check('histogram', {buckets: {1 => 2, 2 => 3, 5 => 3}, sum: 13.0, count: 4}, hist.to_h)
+
+# snapshot
+snap = metrics.snapshot
+check('pools', ['main'], snap.keys)
+stats = snap['main']
+check('pool stats', 2, stats[:busy_count])
+check('counters', [4, 0.25, 2, 0.5, 150],
+      ODPI::Metrics::CONNECTION_COUNTERS.collect { |key| stats[key] })
+check('wait classes', [:interactive, :batch], stats[:checkout_wait].keys)
+check('wait count', 2, stats[:checkout_wait][:interactive][:count])
+check('hold', {count: 2, sum: 1.25}, stats[:checkout_hold].slice(:count, :sum))
+
+# Prometheus text
+text = metrics.to_prometheus
+lines = text.lines.collect(&:chomp)
+check('trailing newline', true, text.end_with?("\n"))
+check('gauge', true, lines.include?('odpi_pool_busy_sessions{pool="main"} 2'))
+check('float counter', true, lines.include?('odpi_execute_seconds_total{pool="main"} 0.25'))
+check('help and type', ['# HELP odpi_pool_open_sessions Sessions open in the pool.',
+                        '# TYPE odpi_pool_open_sessions gauge'], lines[0, 2])
+check('bucket', true,
+      lines.include?('odpi_pool_checkout_wait_seconds_bucket{pool="main",priority="interactive",le="0.0025"} 1'))
+check('bucket le', true,
+      lines.include?('odpi_pool_checkout_wait_seconds_bucket{pool="main",priority="interactive",le="0.005"} 2'))
+check('+Inf bucket', true,
+      lines.include?('odpi_pool_checkout_wait_seconds_bucket{pool="main",priority="batch",le="+Inf"} 1'))
+check('bucket beyond the last bound', true,
+      lines.include?('odpi_pool_checkout_wait_seconds_bucket{pool="main",priority="batch",le="10"} 0'))
+check('histogram count', true, lines.include?('odpi_pool_checkout_hold_seconds_count{pool="main"} 2'))
+check('histogram sum', true, lines.include?('odpi_pool_checkout_hold_seconds_sum{pool="main"} 1.25'))
+metric_names = lines.grep(/\A# TYPE /).collect { |line| line.split[2] }
+check('metrics declared once', metric_names.uniq, metric_names)
+samples = lines.grep_v(/\A#/)
+check('sample syntax', [],
+      samples.grep_v(/\A[a-z_]+\{(?:[a-z]+="(?:[^"\\]|\\.)*",?)+\} [-+0-9.eInfNa]+\z/))
+check('samples of declared metrics', [],
+      samples.reject { |line| metric_names.any? { |name| line.start_with?(name) } })
+
+# label escaping
+metrics.register_pool("a\"b\\c\nd", FakePool.new)
+check('label escape', true,
+      metrics.to_prometheus.lines.include?("odpi_pool_busy_sessions{pool=\"a\\\"b\\\\c\\nd\"} 2\n"))
+
+# unregister only the registered pool
+metrics.unregister_pool('main', FakePool.new)
+check('other pool kept', true, metrics.snapshot.key?('main'))
+metrics.unregister_pool('main', pool)
+check('unregistered', false, metrics.snapshot.key?('main'))
+check('default', true, ODPI::Metrics.default.equal?(ODPI::Metrics.default))
+
+puts "Done."
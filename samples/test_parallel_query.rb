@@ -0,0 +1,136 @@
+#-----------------------------------------------------------------------------
+# test_parallel_query.rb
+#   Tests partition scheduling and row merging of ODPI::ParallelQuery.
+#   A fake pool stands in for the database, so this runs without one.
+#-----------------------------------------------------------------------------
+
+require 'odpi'
+
+def check(label, expected, actual)
+  if expected != actual
+    raise "#{label}: expected #{expected.inspect} but got #{actual.inspect}"
+  end
+  puts "#{label}: OK"
+end
+
+ROWS_PER_PARTITION = 25
+
+# Returns ROWS_PER_PARTITION rows of [partition, n] for each partition,
+# taking a random pause before each batch so partitions finish out of order.
+class FakeStatement
+  attr_accessor :fetch_array_size
+
+  def initialize(log, fail_partition)
+    @log = log
+    @fail_partition = fail_partition
+    @binds = {}
+    @rows = nil
+  end
+
+  def bind(key, val)
+    @binds[key] = val
+  end
+
+  def []=(key, val)
+    raise "#{key} is not bound" unless @binds.key?(key)
+    @binds[key] = val
+  end
+
+  def execute
+    partition = @binds['partition']
+    @log << partition
+    raise "partition #{partition} failed" if partition == @fail_partition
+    @rows = Array.new(ROWS_PER_PARTITION) { |n| [partition, n] }
+  end
+
+  def fetch_rows(max_rows)
+    sleep rand * 0.002
+    rows = @rows.shift(max_rows)
+    rows.empty? ? nil : rows
+  end
+
+  def close
+  end
+end
+
+class FakePool
+  attr_reader :log, :open_count, :fail_partition
+
+  def initialize(fail_partition = nil)
+    @fail_partition = fail_partition
+    @log = Queue.new
+    @open_count = 0
+    @mutex = Mutex.new
+  end
+
+  def connection(params)
+    @mutex.synchronize { @open_count += 1 }
+    pool = self
+    Object.new.tap do |conn|
+      conn.define_singleton_method(:prepare) { |sql| FakeStatement.new(pool.log, pool.fail_partition) }
+      conn.define_singleton_method(:close) { pool.closed }
+    end
+  end
+
+  def closed
+    @mutex.synchronize { @open_count -= 1 }
+  end
+end
+
+expected = (0...12).flat_map { |p| Array.new(ROWS_PER_PARTITION) { |n| [p, n] } }
+
+# WorkQueue: own partitions first, then the back of the longest deque
+work = ODPI::ParallelQuery::WorkQueue.new(%w[a b c d e], 2)
+check('work queue workers', 2, work.num_workers)
+check('own partitions', [[0, 'a'], [2, 'c']], [work.pop(0), work.pop(0)])
+check('steal from the back', [4, 'e'], work.pop(0))
+check('rest', [[1, 'b'], [3, 'd'], nil], [work.pop(1), work.pop(0), work.pop(1)])
+
+# OrderedMerger: batches which arrive early are held
+out = []
+merger = ODPI::ParallelQuery::OrderedMerger.new(->(row) { out << row })
+merger.push(1, [:b1])
+merger.push(2, [:c1])
+merger.push(2, nil)
+merger.push(0, [:a1])
+check('merger passes the current partition', [:a1], out)
+merger.push(1, [:b2])
+merger.push(0, nil)
+check('merger releases held batches', [:a1, :b1, :b2], out)
+merger.push(1, nil)
+check('merger releases completed partitions', [:a1, :b1, :b2, :c1], out)
+
+# unordered: all rows, each partition executed once
+pool = FakePool.new
+query = ODPI::ParallelQuery.new(pool, 'SELECT ... WHERE ORA_HASH(id, 11) = :partition',
+                                threads: 3, partitions: 12, batch_size: 10)
+check('unordered rows', expected, query.to_a.sort)
+check('partitions executed once', (0...12).to_a, Array.new(pool.log.size) { pool.log.pop }.sort)
+check('connections returned', 0, pool.open_count)
+
+# ordered: partition order while partitions finish out of order
+query = ODPI::ParallelQuery.new(pool, 'SELECT ... WHERE ORA_HASH(id, 11) = :partition',
+                                threads: 3, partitions: 12, batch_size: 10, ordered: true)
+check('ordered rows', expected, query.to_a)
+
+# breaking out of the loop stops the workers
+count = 0
+query.each { |row| break if (count += 1) == 30 }
+check('break', 30, count)
+check('connections returned after break', 0, pool.open_count)
+
+# an error in a worker is raised to the caller
+pool = FakePool.new(5)
+query = ODPI::ParallelQuery.new(pool, 'SELECT ... WHERE ORA_HASH(id, 11) = :partition',
+                                threads: 3, partitions: 12)
+begin
+  query.to_a
+  raise 'no error'
+rescue RuntimeError => e
+  check('worker error', 'partition 5 failed', e.message)
+end
+check('connections returned after error', 0, pool.open_count)
+
+check('rowid', 'AAAAAkAAEAAAACDAAB', ODPI::ParallelQuery.rowid(36, 4, 131, 1))
+
+puts "Done."